@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+
+	// Hands out memory from a few big blocks and takes it all back at once.
+	// Meant for things that die together, like the channels of a mesh: no
+	// per allocation bookkeeping and no heap fragmentation from thousands of
+	// small vectors.
+	//
+	// Allocations of largeSize bytes or more get a block of their own that
+	// deallocate() frees right away, so a vector growing to gigabytes does
+	// not leave every smaller copy of itself behind, unless reserve() made
+	// room for them. Smaller ones are only taken back if they were the last
+	// one handed out, or all together once none is left. Thread-safe: the
+	// instances of a mesh share its arena and may be on other threads.
+	class Arena {
+
+	private:
+
+		struct Block {
+			Block* previous;
+			Block* next;
+			size_t size;
+		};
+
+		enum {
+			alignment = 16,
+			headerSize = (sizeof(Block) + alignment - 1) / alignment * alignment,
+			largeSize = 64 << 10,
+			firstBlockSize = 4 << 10,
+			maxBlockSize = 256 << 10
+		};
+
+		// Small allocations come from the front of smallBlocks, the newest
+		Block* smallBlocks;
+		size_t used;
+		Block* largeBlocks;
+		size_t liveCount;
+		mutable std::mutex mutex;
+
+		// Not copyable, the memory handed out belongs to this one
+		Arena(const Arena&);
+		Arena& operator=(const Arena&);
+
+		static char* getData(Block* const block) {
+			return reinterpret_cast<char*>(block) + headerSize;
+		}
+
+		static Block* newBlock(const size_t size) {
+			Block* const block = static_cast<Block*>(std::malloc(headerSize + size));
+			if(!block) {
+				throw std::bad_alloc();
+			}
+			block->previous = NULL;
+			block->next = NULL;
+			block->size = size;
+			return block;
+		}
+
+		static void freeBlocks(Block* block) {
+			while(block) {
+				Block* const next = block->next;
+				std::free(block);
+				block = next;
+			}
+		}
+
+		void addSmallBlock(const size_t size) {
+			size_t blockSize = smallBlocks ? smallBlocks->size * 2 : size_t(firstBlockSize);
+			blockSize = blockSize > size_t(maxBlockSize) ? size_t(maxBlockSize) : blockSize;
+			Block* const block = newBlock(blockSize > size ? blockSize : size);
+			block->next = smallBlocks;
+			smallBlocks = block;
+			used = 0;
+		}
+
+		bool isInSmallBlock(const char* const data) const {
+			for(Block* block = smallBlocks; block; block = block->next) {
+				if(data >= getData(block) && data < getData(block) + block->size) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Keeps only the newest small block, to start over in, unless
+		// reserve() made it larger than any addSmallBlock() would
+		void rewind() {
+			if(smallBlocks && smallBlocks->size > size_t(maxBlockSize)) {
+				freeBlocks(smallBlocks);
+				smallBlocks = NULL;
+			}
+			if(smallBlocks) {
+				freeBlocks(smallBlocks->next);
+				smallBlocks->next = NULL;
+			}
+			used = 0;
+		}
+
+	public:
+
+		// What an allocation of size bytes takes up in a shared block
+		static size_t roundUp(const size_t size) {
+			return (size + alignment - 1) / alignment * alignment;
+		}
+
+		Arena() : smallBlocks(NULL), used(0), largeBlocks(NULL), liveCount(0) {
+		}
+
+		~Arena() {
+			release();
+		}
+
+		// Makes the next allocations, size bytes after roundUp() in all, come
+		// from one block of just that size, large ones included. One malloc
+		// for a mesh whose channels are sized up front.
+		void reserve(const size_t size) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(size > 0 && (!smallBlocks || used + size > smallBlocks->size)) {
+				Block* const block = newBlock(size);
+				block->next = smallBlocks;
+				smallBlocks = block;
+				used = 0;
+			}
+		}
+
+		void* allocate(const size_t size) {
+			const size_t rounded = roundUp(size > 0 ? size : 1);
+			std::lock_guard<std::mutex> lock(mutex);
+			if(size >= size_t(largeSize) && !(smallBlocks && used + rounded <= smallBlocks->size)) {
+				Block* const block = newBlock(size);
+				block->next = largeBlocks;
+				if(largeBlocks) {
+					largeBlocks->previous = block;
+				}
+				largeBlocks = block;
+				liveCount++;
+				return getData(block);
+			}
+			if(!smallBlocks || used + rounded > smallBlocks->size) {
+				addSmallBlock(rounded);
+			}
+			void* const result = getData(smallBlocks) + used;
+			used += rounded;
+			liveCount++;
+			return result;
+		}
+
+		// size is what was passed to allocate()
+		void deallocate(void* const data, const size_t size) {
+			if(!data) {
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if(size >= size_t(largeSize) && !isInSmallBlock(static_cast<char*>(data))) {
+				Block* const block = reinterpret_cast<Block*>(static_cast<char*>(data) - headerSize);
+				(block->previous ? block->previous->next : largeBlocks) = block->next;
+				if(block->next) {
+					block->next->previous = block->previous;
+				}
+				std::free(block);
+			} else {
+				const size_t rounded = roundUp(size > 0 ? size : 1);
+				if(static_cast<char*>(data) + rounded == getData(smallBlocks) + used) {
+					used -= rounded;
+				}
+			}
+			if(--liveCount == 0) {
+				rewind();
+			}
+		}
+
+		// Gives every block back. Whatever was handed out must not be used
+		// any more.
+		void release() {
+			std::lock_guard<std::mutex> lock(mutex);
+			freeBlocks(smallBlocks);
+			freeBlocks(largeBlocks);
+			smallBlocks = NULL;
+			largeBlocks = NULL;
+			used = 0;
+			liveCount = 0;
+		}
+
+		// Bytes held from the heap, headers included
+		size_t getReservedBytes() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t bytes = 0;
+			for(const Block* block = smallBlocks; block; block = block->next) {
+				bytes += headerSize + block->size;
+			}
+			for(const Block* block = largeBlocks; block; block = block->next) {
+				bytes += headerSize + block->size;
+			}
+			return bytes;
+		}
+	};
+
+	// Lets standard containers live in an arena. Without one it is the plain
+	// heap, so containers of channels made without a mesh work as before.
+	// Copies of a container keep their own arena, moves and swaps take the
+	// other's along.
+	template<typename T> class ArenaAllocator {
+
+	public:
+
+		typedef T value_type;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		Arena* arena;
+
+		explicit ArenaAllocator(Arena* const arena = NULL) : arena(arena) {
+		}
+
+		template<typename U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {
+		}
+
+		T* allocate(const size_t count) {
+			if(count > size_t(-1) / sizeof(T)) {
+				throw std::bad_alloc();
+			}
+			const size_t size = count * sizeof(T);
+			return static_cast<T*>(arena ? arena->allocate(size) : ::operator new(size));
+		}
+
+		void deallocate(T* const values, const size_t count) {
+			if(arena) {
+				arena->deallocate(values, count * sizeof(T));
+			} else {
+				::operator delete(values);
+			}
+		}
+	};
+
+	template<typename T, typename U> bool operator==(const ArenaAllocator<T>& a,
+		const ArenaAllocator<U>& b) {
+		return a.arena == b.arena;
+	}
+
+	template<typename T, typename U> bool operator!=(const ArenaAllocator<T>& a,
+		const ArenaAllocator<U>& b) {
+		return a.arena != b.arena;
+	}
+
+	// The calling thread's arena for temporaries that come and go, like a
+	// ScratchString or the line the parser joins continued lines into. What is
+	// taken from it has to be given back on the same thread.
+	inline Arena& getScratchArena() {
+		static thread_local Arena arena;
+		return arena;
+	}
+
+	template<typename T> ArenaAllocator<T> getScratchAllocator() {
+		return ArenaAllocator<T>(&getScratchArena());
+	}
+
+	typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ScratchString;
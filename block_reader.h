@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+	// Reads a file front to back on a thread of its own, a few large blocks
+	// ahead of whoever consumes them, so that waiting for the disk (or a
+	// network file system) overlaps with the work done on the block before.
+	// Regular files are read with pread and told to the system as read
+	// sequentially, with the block after the one being read asked for ahead
+	// of time. Pipes and devices are read with read. Blocks end anywhere,
+	// not at line breaks.
+	class BlockReader {
+
+	private:
+
+		struct Block {
+			char* data;
+			size_t size;
+			bool full;
+		};
+
+		size_t blockSize;
+		int blockCount;
+		std::vector<char> storage;
+		std::vector<Block> blocks;
+		int descriptor;
+		bool regularFile;
+		uint64_t bytesRead;
+
+		// The block handed out by next(), -1 before the first
+		int current;
+		bool ended;
+
+		std::thread reader;
+		std::mutex mutex;
+		std::condition_variable changed;
+		bool stopping;
+		std::string error;
+
+		// Not copyable, the reader thread points back at it
+		BlockReader(const BlockReader&);
+		BlockReader& operator=(const BlockReader&);
+
+		// Fills data with up to size bytes from offset, less only at the end
+		// of the file. Returns -1 on an error.
+		int64_t readAt(char* const data, const size_t size, const uint64_t offset) {
+			size_t done = 0;
+			while(done < size) {
+#ifdef _WIN32
+				// Always sequential, offset is where the last read ended
+				(void)offset;
+				const int count = _read(descriptor, data + done,
+					unsigned(std::min(size - done, size_t(1) << 30)));
+#else
+				const ssize_t count = regularFile ?
+					pread(descriptor, data + done, size - done, off_t(offset + done)) :
+					::read(descriptor, data + done, size - done);
+#endif
+				if(count < 0) {
+					if(errno == EINTR) {
+						continue;
+					}
+					return -1;
+				}
+				if(count == 0) {
+					break;
+				}
+				done += size_t(count);
+			}
+			return int64_t(done);
+		}
+
+		void read() {
+			uint64_t offset = 0;
+			for(size_t i = 0; ; i = (i + 1) % blocks.size()) {
+				Block& block = blocks[i];
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					while(!stopping && block.full) {
+						changed.wait(lock);
+					}
+					if(stopping) {
+						return;
+					}
+				}
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+				if(regularFile) {
+					posix_fadvise(descriptor, off_t(offset + blockSize), off_t(blockSize),
+						POSIX_FADV_WILLNEED);
+				}
+#endif
+				const int64_t count = readAt(block.data, blockSize, offset);
+				const int readError = errno;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if(count < 0) {
+					error = std::strerror(readError);
+				}
+				block.size = count < 0 ? 0 : size_t(count);
+				block.full = true;
+				changed.notify_all();
+				if(count <= 0) {
+					return;
+				}
+				offset += uint64_t(count);
+			}
+		}
+
+	public:
+
+		// blockCount blocks of blockSize bytes, each aligned to a page. They
+		// are allocated by the first open().
+		explicit BlockReader(const size_t blockSize = size_t(4) << 20, const int blockCount = 4) :
+			blockSize(blockSize), blockCount(blockCount), descriptor(-1), regularFile(false),
+			bytesRead(0), current(-1), ended(false), stopping(false) {
+		}
+
+		~BlockReader() {
+			close();
+		}
+
+		// Starts reading, false if the file cannot be opened
+		bool open(const std::string& filename) {
+			close();
+			if(blocks.empty()) {
+				const size_t alignment = 4096;
+				storage.resize(blockSize * size_t(blockCount) + alignment);
+				char* const aligned = &storage[0] + (alignment -
+					size_t(reinterpret_cast<uintptr_t>(&storage[0]) % alignment)) % alignment;
+				blocks.resize(size_t(blockCount));
+				for(int i = 0; i < blockCount; i++) {
+					blocks[i].data = aligned + size_t(i) * blockSize;
+					blocks[i].size = 0;
+					blocks[i].full = false;
+				}
+			}
+#ifdef _WIN32
+			descriptor = _open(filename.c_str(), _O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+			if(descriptor < 0) {
+				return false;
+			}
+#else
+			descriptor = ::open(filename.c_str(), O_RDONLY);
+			if(descriptor < 0) {
+				return false;
+			}
+			struct stat info;
+			regularFile = fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode);
+#if defined(POSIX_FADV_SEQUENTIAL)
+			if(regularFile) {
+				posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+			}
+#endif
+#endif
+			reader = std::thread(&BlockReader::read, this);
+			return true;
+		}
+
+		void close() {
+			if(reader.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+					changed.notify_all();
+				}
+				reader.join();
+			}
+			if(descriptor >= 0) {
+#ifdef _WIN32
+				_close(descriptor);
+#else
+				::close(descriptor);
+#endif
+			}
+			descriptor = -1;
+			regularFile = false;
+			bytesRead = 0;
+			current = -1;
+			ended = false;
+			stopping = false;
+			error.clear();
+			for(size_t i = 0; i < blocks.size(); i++) {
+				blocks[i].size = 0;
+				blocks[i].full = false;
+			}
+		}
+
+		// Waits for the next block and hands it out, giving the one before
+		// back to the reader. Returns NULL at the end of the file. Throws
+		// runtime_error if the file could not be read.
+		const char* next(size_t& size) {
+			size = 0;
+			if(ended) {
+				return NULL;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			if(current >= 0) {
+				blocks[current].full = false;
+				changed.notify_all();
+			}
+			current = (current + 1) % int(blocks.size());
+			Block& block = blocks[current];
+			while(!block.full) {
+				changed.wait(lock);
+			}
+			if(!error.empty()) {
+				throw std::runtime_error("Error reading OBJ file: " + error);
+			}
+			if(block.size == 0) {
+				ended = true;
+				return NULL;
+			}
+			size = block.size;
+			bytesRead += size;
+			return block.data;
+		}
+
+		// Whether the file has a modification time to tie a sidecar file to
+		bool isRegularFile() const {
+			return regularFile;
+		}
+
+		uint64_t getBytesRead() const {
+			return bytesRead;
+		}
+	};
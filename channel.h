@@ -5,7 +5,10 @@
 #include <vec4.h>
 
 #include "tri.h"
+#include "arena.h"
 
+#include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -13,14 +16,87 @@ namespace Geometry {
 
 	class Mesh;
 
+	// Where the channels of a mesh keep their values, NULL (the heap) for
+	// channels without one. Defined in mesh.h.
+	inline std::shared_ptr<Arena> getMeshArena(const Mesh* const mesh);
+
+	enum ScalarType {
+		NO_SCALAR,
+		FLOAT_SCALAR,
+		INT_SCALAR
+	};
+
+	// What one value of a channel is made of, so that generic code can walk
+	// the values of any channel without knowing its type
+	struct ElementType {
+		ScalarType scalarType;
+		// Scalars in use, 3 for Vec3f although it is padded to 4
+		int componentCount;
+		// Bytes from one value of a component to the next
+		int stride;
+		// The vertex indices of an Edge, Tri or Tetra
+		bool isSimplex;
+		// One array per component (SoAChannel) instead of one of values
+		bool isPlanar;
+	};
+
+	template<typename T, typename S, ScalarType scalar, int components, bool simplex>
+	struct ElementLayout {
+		typedef S Scalar;
+		enum { componentCount = components };
+
+		static ElementType getElementType() {
+			const ElementType elementType = { scalar, components, int(sizeof(T)), simplex, false };
+			return elementType;
+		}
+
+		static ElementType getPlanarElementType() {
+			const ElementType elementType = { scalar, components, int(sizeof(S)), simplex, true };
+			return elementType;
+		}
+
+		// The components are the first members of every value type
+		static S getComponent(const T& value, const int component) {
+			return reinterpret_cast<const S*>(&value)[component];
+		}
+
+		static void setComponent(T& value, const int component, const S componentValue) {
+			reinterpret_cast<S*>(&value)[component] = componentValue;
+		}
+	};
+
+	// Every value type of a BaseChannel<> needs one
+	template<typename T> struct ElementTraits;
+
+	template<> struct ElementTraits<int> : ElementLayout<int, int, INT_SCALAR, 1, false> {};
+	template<> struct ElementTraits<float> : ElementLayout<float, float, FLOAT_SCALAR, 1, false> {};
+	template<> struct ElementTraits<Vec2f> : ElementLayout<Vec2f, float, FLOAT_SCALAR, 2, false> {};
+	template<> struct ElementTraits<Vec3f> : ElementLayout<Vec3f, float, FLOAT_SCALAR, 3, false> {};
+	template<> struct ElementTraits<Vec4f> : ElementLayout<Vec4f, float, FLOAT_SCALAR, 4, false> {};
+	template<> struct ElementTraits<Edge> : ElementLayout<Edge, int, INT_SCALAR, 2, true> {};
+	template<> struct ElementTraits<Tri> : ElementLayout<Tri, int, INT_SCALAR, 3, true> {};
+	template<> struct ElementTraits<Tetra> : ElementLayout<Tetra, int, INT_SCALAR, 4, true> {};
+
 	class Channel {
 
 		const std::string name;
 		const Mesh* const owner;
+		const ElementType elementType;
+		// Where values written to the channel go, kept alive by it. The
+		// owner's arena when the channel was made, for channels with values.
+		const std::shared_ptr<Arena> arena;
+
+	protected:
+
+		const std::shared_ptr<Arena>& getSharedArena() const {
+			return arena;
+		}
 
 	public:
 
-		Channel(const std::string& name, const Mesh* const owner) : name(name), owner(owner) {
+		Channel(const std::string& name, const Mesh* const owner, const ElementType& elementType,
+			const std::shared_ptr<Arena>& arena = std::shared_ptr<Arena>()) :
+			name(name), owner(owner), elementType(elementType), arena(arena) {
 		}
 		
 		virtual ~Channel() {
@@ -30,55 +106,127 @@ namespace Geometry {
 			return name;
 		}
 
+		const ElementType& getElementType() const {
+			return elementType;
+		}
+
 		virtual int getSize() const = 0;
+		// getSize() values, getElementType().stride bytes apart. NULL if empty
+		// or planar.
+		virtual const void* getRawData() const = 0;
+		// Works for every layout: component c of value i is at
+		// getComponentData(c) + i * getElementType().stride. NULL if empty.
+		virtual const void* getComponentData(const int component) const = 0;
 		virtual int getMemoryUsage() const = 0;
 		virtual std::string convertToString() const = 0;
+		// Same name and values, values in owner's arena
+		virtual Channel* clone(const Mesh* const owner) const = 0;
+		// Same name and the very same values, until either channel is
+		// written to: that one copies them to its own arena first (copy on
+		// write). References to the values taken before are not copied and
+		// must not be written through any more.
+		virtual Channel* makeInstance(const Mesh* const owner) const = 0;
 		const Mesh* getOwner() const {
 			return owner;
 		}
+
+		// NULL for the heap
+		Arena* getArena() const {
+			return arena.get();
+		}
 	};
 
 	template<typename T> class BaseChannel : public Channel {
 
+	public:
+
+		// Not a std::vector<T>: the values live in the owner's arena. Bind
+		// getValues() to a Values& (or auto&), or copy it out with assign().
+		typedef std::vector<T, ArenaAllocator<T> > Values;
+
 	private:
 
-		std::vector<T> values;
+		// The values with the arena they are in, which lives as long as they
+		// do. Shared by the instances of a channel.
+		struct Storage {
+			const std::shared_ptr<Arena> arena;
+			Values values;
+
+			explicit Storage(const std::shared_ptr<Arena>& arena) :
+				arena(arena), values(ArenaAllocator<T>(arena.get())) {
+			}
+		};
+
+		std::shared_ptr<Storage> storage;
+
+		BaseChannel(const std::string& name, const Mesh* const owner,
+			const std::shared_ptr<Storage>& storage) :
+			Channel(name, owner, ElementTraits<T>::getElementType(), getMeshArena(owner)),
+			storage(storage) {
+		}
+
+		// Values of our own, copied to our arena if an instance shares them
+		Values& getWritableValues() {
+			if(storage.use_count() > 1) {
+				const std::shared_ptr<Storage> copy = std::make_shared<Storage>(getSharedArena());
+				copy->values.assign(storage->values.begin(), storage->values.end());
+				storage = copy;
+			}
+			return storage->values;
+		}
 
 	public:
 
-		BaseChannel(const std::string& name, const Mesh* const owner) : Channel(name, owner) {
+		BaseChannel(const std::string& name, const Mesh* const owner) :
+			Channel(name, owner, ElementTraits<T>::getElementType(), getMeshArena(owner)),
+			storage(std::make_shared<Storage>(getSharedArena())) {
 		}
 
+		// Only allocates, getSize() and add() are not affected
 		void reserve(const int size) {
-			values.resize(size);
+			getWritableValues().reserve(size);
+		}
+
+		void resize(const int size) {
+			getWritableValues().resize(size);
 		}
 
 		virtual int getSize() const override {
-			return int(values.size());
+			return int(storage->values.size());
 		}
 
-		std::vector<T>& getValues() {
-			return values;
+		// For writing, see makeInstance()
+		Values& getValues() {
+			return getWritableValues();
 		}
 
-		const std::vector<T>& getValues() const {
-			return values;
+		const Values& getValues() const {
+			return storage->values;
 		}
 
 		const T* getData() const {
-			return values.size() > 0 ? &values[0] : NULL;
+			return storage->values.size() > 0 ? &storage->values[0] : NULL;
+		}
+
+		virtual const void* getRawData() const override {
+			return getData();
+		}
+
+		virtual const void* getComponentData(const int component) const override {
+			const char* const data = reinterpret_cast<const char*>(getData());
+			return data ? data + component * sizeof(typename ElementTraits<T>::Scalar) : NULL;
 		}
 		
 		void add(const T& t) {
-			values.push_back(t);
+			getWritableValues().push_back(t);
 		}
 		
 		T& getAt(const int index) {
-			return values[index];
+			return getWritableValues()[index];
 		}
 
 		const T& getAt(const int index) const {
-			return values[index];
+			return storage->values[index];
 		}
 /*
 		T& operator[](const int index) {
@@ -90,16 +238,26 @@ namespace Geometry {
 		}
 */		
 		void setAt(const int index, const T& t) {
-			values[index] = t;
+			getWritableValues()[index] = t;
 		}
 
 		int getMemoryUsage() const {
-			return sizeof(T) * int(values.size());
+			return sizeof(T) * int(storage->values.size());
 		}
 
 		virtual std::string convertToString() const override {
 			return "";
 		}
+
+		virtual Channel* clone(const Mesh* const owner) const override {
+			BaseChannel<T>* const copy = new BaseChannel<T>(getName(), owner);
+			copy->storage->values.assign(storage->values.begin(), storage->values.end());
+			return copy;
+		}
+
+		virtual Channel* makeInstance(const Mesh* const owner) const override {
+			return new BaseChannel<T>(getName(), owner, storage);
+		}
 	};
 
 	typedef BaseChannel<int> IntChannel;
@@ -115,6 +273,220 @@ namespace Geometry {
 	typedef BaseChannel<Tri> TriChannel;
 	typedef BaseChannel<Tetra> TetraChannel;
 
+	// The values of a BaseChannel<T> as one array per component, x[], y[]
+	// and z[] for a Vec3f, which is what SIMD kernels want. Also saves the
+	// padding of Vec3f. Has the same interface as BaseChannel<>, except that
+	// values are put together on the way out.
+	template<typename T> class SoAChannel : public Channel {
+
+	public:
+
+		typedef ElementTraits<T> Traits;
+		typedef typename Traits::Scalar Scalar;
+
+	private:
+
+		typedef std::vector<Scalar, ArenaAllocator<Scalar> > Values;
+
+		// Like BaseChannel<>::Storage
+		struct Storage {
+			const std::shared_ptr<Arena> arena;
+			Values components[Traits::componentCount];
+
+			explicit Storage(const std::shared_ptr<Arena>& arena) : arena(arena) {
+				for(int i = 0; i < Traits::componentCount; i++) {
+					components[i] = Values(ArenaAllocator<Scalar>(arena.get()));
+				}
+			}
+		};
+
+		std::shared_ptr<Storage> storage;
+
+		SoAChannel(const std::string& name, const Mesh* const owner,
+			const std::shared_ptr<Storage>& storage) :
+			Channel(name, owner, Traits::getPlanarElementType(), getMeshArena(owner)),
+			storage(storage) {
+		}
+
+		Values* getWritableComponents() {
+			if(storage.use_count() > 1) {
+				const std::shared_ptr<Storage> copy = std::make_shared<Storage>(getSharedArena());
+				for(int i = 0; i < Traits::componentCount; i++) {
+					copy->components[i].assign(storage->components[i].begin(), storage->components[i].end());
+				}
+				storage = copy;
+			}
+			return storage->components;
+		}
+
+	public:
+
+		SoAChannel(const std::string& name, const Mesh* const owner) :
+			Channel(name, owner, Traits::getPlanarElementType(), getMeshArena(owner)),
+			storage(std::make_shared<Storage>(getSharedArena())) {
+		}
+
+		void reserve(const int size) {
+			Values* const components = getWritableComponents();
+			for(int i = 0; i < Traits::componentCount; i++) {
+				components[i].reserve(size);
+			}
+		}
+
+		void resize(const int size) {
+			Values* const components = getWritableComponents();
+			for(int i = 0; i < Traits::componentCount; i++) {
+				components[i].resize(size);
+			}
+		}
+
+		virtual int getSize() const override {
+			return int(storage->components[0].size());
+		}
+
+		// For writing, see makeInstance()
+		Scalar* getComponent(const int component) {
+			Values& values = getWritableComponents()[component];
+			return values.size() > 0 ? &values[0] : NULL;
+		}
+
+		const Scalar* getComponent(const int component) const {
+			const Values& values = storage->components[component];
+			return values.size() > 0 ? &values[0] : NULL;
+		}
+
+		virtual const void* getRawData() const override {
+			return NULL;
+		}
+
+		virtual const void* getComponentData(const int component) const override {
+			return getComponent(component);
+		}
+
+		void add(const T& t) {
+			Values* const components = getWritableComponents();
+			for(int i = 0; i < Traits::componentCount; i++) {
+				components[i].push_back(Traits::getComponent(t, i));
+			}
+		}
+
+		T getAt(const int index) const {
+			// Padding included, so copies of it are defined
+			T t;
+			std::memset(static_cast<void*>(&t), 0, sizeof(T));
+			for(int i = 0; i < Traits::componentCount; i++) {
+				Traits::setComponent(t, i, storage->components[i][index]);
+			}
+			return t;
+		}
+
+		void setAt(const int index, const T& t) {
+			Values* const components = getWritableComponents();
+			for(int i = 0; i < Traits::componentCount; i++) {
+				components[i][index] = Traits::getComponent(t, i);
+			}
+		}
+
+		virtual int getMemoryUsage() const override {
+			return int(sizeof(Scalar)) * Traits::componentCount * getSize();
+		}
+
+		virtual std::string convertToString() const override {
+			return "";
+		}
+
+		virtual Channel* clone(const Mesh* const owner) const override {
+			SoAChannel<T>* const copy = new SoAChannel<T>(getName(), owner);
+			for(int i = 0; i < Traits::componentCount; i++) {
+				copy->storage->components[i].assign(storage->components[i].begin(),
+					storage->components[i].end());
+			}
+			return copy;
+		}
+
+		virtual Channel* makeInstance(const Mesh* const owner) const override {
+			return new SoAChannel<T>(getName(), owner, storage);
+		}
+	};
+
+	typedef SoAChannel<Vec2f> SoAVec2fChannel;
+	typedef SoAChannel<Vec3f> SoAVec3fChannel;
+	typedef SoAChannel<Vec4f> SoAVec4fChannel;
+
+	// Reads the values of a BaseChannel<T> and an SoAChannel<T> alike,
+	// through Channel::getComponentData
+	template<typename T> class ChannelReader {
+
+		typedef ElementTraits<T> Traits;
+		typedef typename Traits::Scalar Scalar;
+
+		const char* components[Traits::componentCount];
+		int stride;
+		int size;
+
+	public:
+
+		// Invalid, and empty, unless the channel holds T's in either layout
+		explicit ChannelReader(const Channel* const channel) : stride(0), size(0) {
+			const ElementType expected = Traits::getElementType();
+			const ElementType* const actual = channel ? &channel->getElementType() : NULL;
+			const bool valid = actual && actual->scalarType == expected.scalarType &&
+				actual->componentCount == expected.componentCount &&
+				actual->isSimplex == expected.isSimplex &&
+				actual->stride == (actual->isPlanar ? int(sizeof(Scalar)) : expected.stride);
+			for(int i = 0; i < Traits::componentCount; i++) {
+				components[i] = valid ? static_cast<const char*>(channel->getComponentData(i)) : NULL;
+			}
+			if(valid) {
+				stride = actual->stride;
+				size = channel->getSize();
+			}
+		}
+
+		bool isValid() const {
+			return stride != 0;
+		}
+
+		int getSize() const {
+			return size;
+		}
+
+		T getAt(const int index) const {
+			// Padding included, so copies of it are defined
+			T t;
+			std::memset(static_cast<void*>(&t), 0, sizeof(T));
+			for(int i = 0; i < Traits::componentCount; i++) {
+				Traits::setComponent(t, i,
+					*reinterpret_cast<const Scalar*>(components[i] + size_t(index) * stride));
+			}
+			return t;
+		}
+	};
+
+	// Copies between the layouts, for channels of meshes that were loaded
+	// in the other one
+	template<typename T> SoAChannel<T>* makeSoAChannel(const BaseChannel<T>& channel,
+		const Mesh* const owner) {
+		SoAChannel<T>* const soa = new SoAChannel<T>(channel.getName(), owner);
+		const int size = channel.getSize();
+		soa->resize(size);
+		for(int i = 0; i < size; i++) {
+			soa->setAt(i, channel.getAt(i));
+		}
+		return soa;
+	}
+
+	template<typename T> BaseChannel<T>* makeAoSChannel(const SoAChannel<T>& channel,
+		const Mesh* const owner) {
+		BaseChannel<T>* const aos = new BaseChannel<T>(channel.getName(), owner);
+		const int size = channel.getSize();
+		aos->resize(size);
+		for(int i = 0; i < size; i++) {
+			aos->setAt(i, channel.getAt(i));
+		}
+		return aos;
+	}
+
 	// A channel that maps 1:1 to a complex.
 	// A single value per-vertex, per-edge, per-face or per-tertra.
 	// Use all the BaseChanels<> as realizations of this.
@@ -122,13 +494,27 @@ namespace Geometry {
 
 	public:
 
-		FlatChannel(const std::string& name, const Mesh* const owner) : Channel(name, owner) {
+		FlatChannel(const std::string& name, const Mesh* const owner) :
+			Channel(name, owner, getFlatElementType()) {
+		}
+
+		static ElementType getFlatElementType() {
+			const ElementType elementType = { NO_SCALAR, 0, 0, false, false };
+			return elementType;
 		}
 
 		virtual int getSize() const override { 
 			return 0;
 		}
 
+		virtual const void* getRawData() const override {
+			return NULL;
+		}
+
+		virtual const void* getComponentData(const int /* component */) const override {
+			return NULL;
+		}
+
 		virtual int getMemoryUsage() const override {
 			return 0;
 		}
@@ -136,6 +522,14 @@ namespace Geometry {
 		virtual std::string convertToString() const override {
 			return "";
 		}
+
+		virtual Channel* clone(const Mesh* const owner) const override {
+			return new FlatChannel(getName(), owner);
+		}
+
+		virtual Channel* makeInstance(const Mesh* const owner) const override {
+			return new FlatChannel(getName(), owner);
+		}
 	};
 
 	typedef FlatChannel FlatTriChannel;
@@ -0,0 +1,273 @@
+#include <atomic>
+#include "channel_convert.h"
+#include "channel.h"
+
+// SSE2 is part of every x86-64 build, AVX is looked for at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86
+#define CONVERT_AVX_TARGET __attribute__((target("avx")))
+#include <immintrin.h>
+#ifdef __SSE2__
+#define CONVERT_SSE2
+#endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CONVERT_X86
+#define CONVERT_AVX_TARGET
+#include <intrin.h>
+#include <immintrin.h>
+#if defined(_M_X64) || _M_IX86_FP >= 2
+#define CONVERT_SSE2
+#endif
+#endif
+
+using namespace Geometry;
+using namespace std;
+
+static void convertFloatsScalar(const float* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target) {
+  for(size_t i = 0; i < count; i++) {
+    for(int j = 0; j < componentCount; j++) {
+      target[i * componentCount + j] = double(source[i * sourceStride + j]);
+    }
+  }
+}
+
+static void convertIntsScalar(const int* const source, const int sourceStride,
+  const int componentCount, const size_t count, const int base, double* const target) {
+  for(size_t i = 0; i < count; i++) {
+    for(int j = 0; j < componentCount; j++) {
+      target[i * componentCount + j] = double(source[i * sourceStride + j]) + base;
+    }
+  }
+}
+
+// Both vector kernels handle packed layouts and Vec3f. Vec3f is converted
+// four floats at a time, padding included, and the padding's double is
+// overwritten by the next value, so the last value is done on its own.
+
+#ifdef CONVERT_SSE2
+
+static void convertFloatsSSE2(const float* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target) {
+  if(sourceStride == componentCount) {
+    const size_t total = count * componentCount;
+    size_t i = 0;
+    for(; i + 4 <= total; i += 4) {
+      const __m128 values = _mm_loadu_ps(source + i);
+      _mm_storeu_pd(target + i, _mm_cvtps_pd(values));
+      _mm_storeu_pd(target + i + 2, _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+    }
+    convertFloatsScalar(source + i, 1, 1, total - i, target + i);
+  } else if(sourceStride == 4 && componentCount == 3 && count > 0) {
+    for(size_t i = 0; i + 1 < count; i++) {
+      const __m128 values = _mm_loadu_ps(source + i * 4);
+      _mm_storeu_pd(target + i * 3, _mm_cvtps_pd(values));
+      _mm_storeu_pd(target + i * 3 + 2, _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+    }
+    convertFloatsScalar(source + (count - 1) * 4, 4, 3, 1, target + (count - 1) * 3);
+  } else {
+    convertFloatsScalar(source, sourceStride, componentCount, count, target);
+  }
+}
+
+static void convertIntsSSE2(const int* const source, const int sourceStride,
+  const int componentCount, const size_t count, const int base, double* const target) {
+  if(sourceStride != componentCount) {
+    convertIntsScalar(source, sourceStride, componentCount, count, base, target);
+    return;
+  }
+  const size_t total = count * componentCount;
+  const __m128d offset = _mm_set1_pd(base);
+  size_t i = 0;
+  for(; i + 4 <= total; i += 4) {
+    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    _mm_storeu_pd(target + i, _mm_add_pd(_mm_cvtepi32_pd(values), offset));
+    _mm_storeu_pd(target + i + 2,
+      _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(values, 0xEE)), offset));
+  }
+  convertIntsScalar(source + i, 1, 1, total - i, base, target + i);
+}
+
+#endif
+
+#ifdef CONVERT_X86
+
+CONVERT_AVX_TARGET static void convertFloatsAVX(const float* const source,
+  const int sourceStride, const int componentCount, const size_t count,
+  double* const target) {
+  if(sourceStride == componentCount) {
+    const size_t total = count * componentCount;
+    size_t i = 0;
+    for(; i + 8 <= total; i += 8) {
+      _mm256_storeu_pd(target + i, _mm256_cvtps_pd(_mm_loadu_ps(source + i)));
+      _mm256_storeu_pd(target + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(source + i + 4)));
+    }
+    convertFloatsScalar(source + i, 1, 1, total - i, target + i);
+  } else if(sourceStride == 4 && componentCount == 3 && count > 0) {
+    for(size_t i = 0; i + 1 < count; i++) {
+      _mm256_storeu_pd(target + i * 3, _mm256_cvtps_pd(_mm_loadu_ps(source + i * 4)));
+    }
+    convertFloatsScalar(source + (count - 1) * 4, 4, 3, 1, target + (count - 1) * 3);
+  } else {
+    convertFloatsScalar(source, sourceStride, componentCount, count, target);
+  }
+}
+
+CONVERT_AVX_TARGET static void convertIntsAVX(const int* const source,
+  const int sourceStride, const int componentCount, const size_t count, const int base,
+  double* const target) {
+  if(sourceStride != componentCount) {
+    convertIntsScalar(source, sourceStride, componentCount, count, base, target);
+    return;
+  }
+  const size_t total = count * componentCount;
+  const __m256d offset = _mm256_set1_pd(base);
+  size_t i = 0;
+  for(; i + 4 <= total; i += 4) {
+    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    _mm256_storeu_pd(target + i, _mm256_add_pd(_mm256_cvtepi32_pd(values), offset));
+  }
+  convertIntsScalar(source + i, 1, 1, total - i, base, target + i);
+}
+
+static bool hasAVX() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  const bool osSavesRegisters = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  return osSavesRegisters && avx && (_xgetbv(0) & 6) == 6;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+
+#endif
+
+static bool canRun(const ConversionKernel kernel) {
+  switch(kernel) {
+  case SCALAR_CONVERSION:
+    return true;
+  case SSE2_CONVERSION:
+#ifdef CONVERT_SSE2
+    return true;
+#else
+    return false;
+#endif
+  case AVX_CONVERSION:
+#ifdef CONVERT_X86
+    return hasAVX();
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+static ConversionKernel findFastestKernel() {
+  return canRun(AVX_CONVERSION) ? AVX_CONVERSION :
+    canRun(SSE2_CONVERSION) ? SSE2_CONVERSION : SCALAR_CONVERSION;
+}
+
+// -1 until the first conversion looks at the CPU
+static atomic<int> currentKernel(-1);
+
+ConversionKernel getConversionKernel() {
+  int kernel = currentKernel.load(memory_order_relaxed);
+  if(kernel < 0) {
+    kernel = findFastestKernel();
+    currentKernel.store(kernel, memory_order_relaxed);
+  }
+  return ConversionKernel(kernel);
+}
+
+bool setConversionKernel(const ConversionKernel kernel) {
+  if(!canRun(kernel)) {
+    return false;
+  }
+  currentKernel.store(kernel, memory_order_relaxed);
+  return true;
+}
+
+const char* getConversionKernelName(const ConversionKernel kernel) {
+  switch(kernel) {
+  case SSE2_CONVERSION:
+    return "sse2";
+  case AVX_CONVERSION:
+    return "avx";
+  default:
+    return "scalar";
+  }
+}
+
+void convertFloatsToDoubles(const float* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target) {
+  switch(getConversionKernel()) {
+#ifdef CONVERT_X86
+  case AVX_CONVERSION:
+    convertFloatsAVX(source, sourceStride, componentCount, count, target);
+    break;
+#endif
+#ifdef CONVERT_SSE2
+  case SSE2_CONVERSION:
+    convertFloatsSSE2(source, sourceStride, componentCount, count, target);
+    break;
+#endif
+  default:
+    convertFloatsScalar(source, sourceStride, componentCount, count, target);
+    break;
+  }
+}
+
+void convertIntsToDoubles(const int* const source, const int sourceStride,
+  const int componentCount, const size_t count, const int base, double* const target) {
+  switch(getConversionKernel()) {
+#ifdef CONVERT_X86
+  case AVX_CONVERSION:
+    convertIntsAVX(source, sourceStride, componentCount, count, base, target);
+    break;
+#endif
+#ifdef CONVERT_SSE2
+  case SSE2_CONVERSION:
+    convertIntsSSE2(source, sourceStride, componentCount, count, base, target);
+    break;
+#endif
+  default:
+    convertIntsScalar(source, sourceStride, componentCount, count, base, target);
+    break;
+  }
+}
+
+void convertChannelToDoubles(const Channel& channel, const int base, double* const target) {
+  const ElementType& elementType = channel.getElementType();
+  const size_t count = size_t(channel.getSize());
+  if(!count) {
+    return;
+  }
+  if(elementType.isPlanar) {
+    // One strided pass per component, each array read in order
+    for(int c = 0; c < elementType.componentCount; c++) {
+      const char* const component = static_cast<const char*>(channel.getComponentData(c));
+      for(size_t i = 0; i < count; i++) {
+        const char* const value = component + i * elementType.stride;
+        target[i * elementType.componentCount + c] = elementType.scalarType == FLOAT_SCALAR ?
+          double(*reinterpret_cast<const float*>(value)) :
+          double(*reinterpret_cast<const int*>(value)) + base;
+      }
+    }
+    return;
+  }
+  switch(elementType.scalarType) {
+  case FLOAT_SCALAR:
+    convertFloatsToDoubles(static_cast<const float*>(channel.getRawData()),
+      elementType.stride / int(sizeof(float)), elementType.componentCount, count, target);
+    break;
+  case INT_SCALAR:
+    convertIntsToDoubles(static_cast<const int*>(channel.getRawData()),
+      elementType.stride / int(sizeof(int)), elementType.componentCount, count, base, target);
+    break;
+  default:
+    break;
+  }
+}
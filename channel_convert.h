@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Geometry {
+	class Channel;
+};
+
+// Widening copies from the channel layouts in channel.h to the packed
+// matrices MATLAB wants: count values of componentCount components each,
+// read sourceStride elements apart (4 for Vec3f, which is padded to 16
+// bytes) and written next to each other. Every float and int is exactly a
+// double, so all kernels give the same bits as the scalar loop.
+
+enum ConversionKernel {
+  SCALAR_CONVERSION,
+  SSE2_CONVERSION,
+  AVX_CONVERSION
+};
+
+// The kernel the conversions run, the fastest one the CPU has unless
+// setConversionKernel picked another.
+ConversionKernel getConversionKernel();
+
+// For benchmarks and tests. False, with nothing changed, if the CPU or the
+// build cannot run the kernel.
+bool setConversionKernel(const ConversionKernel kernel);
+
+const char* getConversionKernelName(const ConversionKernel kernel);
+
+void convertFloatsToDoubles(const float* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target);
+
+// Adds base to every value as well, 1 turns 0-based indices into MATLAB's
+void convertIntsToDoubles(const int* const source, const int sourceStride,
+  const int componentCount, const size_t count, const int base, double* const target);
+
+// The strided copy for any channel, whatever its type, driven by its
+// ElementType: getSize() values of componentCount doubles each. base is
+// added to int channels, which hold indices. Channels without scalars
+// write nothing, planar ones (SoAChannel) take the scalar loop.
+void convertChannelToDoubles(const Geometry::Channel& channel, const int base,
+  double* const target);
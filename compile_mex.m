@@ -1,4 +1,7 @@
 clc; clearvars; close all;
-mex -v -largeArrayDims -I.\ obj_read.cpp obj_common.cpp 
+mex -v -largeArrayDims -I.\ obj_read.cpp obj_common.cpp obj_index.cpp number_scanner.cpp mesh_cache.cpp channel_convert.cpp decoding_reader.cpp number_formatter.cpp
+% To read .obj.gz and .obj.zst files, add -DOBJ_HAVE_ZLIB -lz and/or
+% -DOBJ_HAVE_ZSTD -lzstd to the line above.
+mex -v -largeArrayDims -I.\ obj_write.cpp obj_common.cpp obj_index.cpp number_scanner.cpp mesh_cache.cpp channel_convert.cpp decoding_reader.cpp number_formatter.cpp
 
 display('ALL DONE!');
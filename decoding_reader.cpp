@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "decoding_reader.h"
+#ifdef OBJ_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJ_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+Compression getCompression(const char* const data, const size_t size) {
+  const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(data);
+  if(size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+    return COMPRESSION_GZIP;
+  }
+  if(size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+    return COMPRESSION_ZSTD;
+  }
+  return COMPRESSION_NONE;
+}
+
+// Decompressed blocks are about this big
+static const size_t outputBlockSize = size_t(4) << 20;
+
+// The bytes of the file, starting with the block open() looked at
+struct DecoderInput {
+  BlockReader* reader;
+  const char* first;
+  size_t firstSize;
+
+  const char* next(size_t& size) {
+    if(first) {
+      const char* const block = first;
+      size = firstSize;
+      first = NULL;
+      return block;
+    }
+    return reader->next(size);
+  }
+};
+
+class Decoder {
+
+public:
+
+  virtual ~Decoder() {
+  }
+
+  // As DecodingReader::next
+  virtual const char* next(size_t& size) = 0;
+};
+
+namespace {
+
+class PlainDecoder : public Decoder {
+
+private:
+
+  DecoderInput input;
+
+public:
+
+  explicit PlainDecoder(const DecoderInput& input) : input(input) {
+  }
+
+  const char* next(size_t& size) {
+    return input.next(size);
+  }
+};
+
+#ifdef OBJ_HAVE_ZLIB
+
+class GzipDecoder : public Decoder {
+
+private:
+
+  DecoderInput input;
+  z_stream stream;
+  vector<char> output;
+  // At the end of a gzip member, another one may follow
+  bool memberEnded;
+  bool finished;
+
+public:
+
+  explicit GzipDecoder(const DecoderInput& input) : input(input), output(outputBlockSize),
+    memberEnded(false), finished(false) {
+    memset(&stream, 0, sizeof(stream));
+    // 15 for the largest window, plus 32 to take a gzip or zlib header
+    if(inflateInit2(&stream, 15 + 32) != Z_OK) {
+      throw runtime_error("Cannot initialize zlib");
+    }
+  }
+
+  ~GzipDecoder() {
+    inflateEnd(&stream);
+  }
+
+  const char* next(size_t& size) {
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = uInt(output.size());
+    while(stream.avail_out > 0 && !finished) {
+      if(stream.avail_in == 0) {
+        size_t blockSize;
+        const char* const block = input.next(blockSize);
+        if(!block) {
+          if(!memberEnded) {
+            throw runtime_error("Truncated gzip OBJ file");
+          }
+          finished = true;
+          break;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block));
+        stream.avail_in = uInt(blockSize);
+      }
+      if(memberEnded) {
+        // Like gzip, anything but another member after one is ignored
+        if(stream.next_in[0] != 0x1f) {
+          finished = true;
+          break;
+        }
+        inflateReset(&stream);
+        memberEnded = false;
+      }
+      const int result = inflate(&stream, Z_NO_FLUSH);
+      if(result == Z_STREAM_END) {
+        memberEnded = true;
+      } else if(result != Z_OK) {
+        throw runtime_error(string("Corrupt gzip OBJ file: ") +
+          (stream.msg ? stream.msg : "cannot decompress"));
+      }
+    }
+    size = output.size() - stream.avail_out;
+    return size ? &output[0] : NULL;
+  }
+};
+
+#endif
+
+#ifdef OBJ_HAVE_ZSTD
+
+static void checkZstd(const size_t result) {
+  if(ZSTD_isError(result)) {
+    throw runtime_error(string("Corrupt zstd OBJ file: ") + ZSTD_getErrorName(result));
+  }
+}
+
+// A frame header fits in this many bytes
+static const size_t frameHeaderMaxSize = 18;
+
+// Frames that decompress to more than this are streamed, not held whole
+static const unsigned long long maxWholeFrameSize = 64 << 20;
+
+// A whole frame whose size is known, or a skippable one
+static vector<char> decompressFrame(const string& frame) {
+  const unsigned long long contentSize = ZSTD_getFrameContentSize(frame.data(), frame.size());
+  vector<char> output(static_cast<size_t>(contentSize));
+  unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+  const size_t size = ZSTD_decompressDCtx(context.get(), output.empty() ? NULL : &output[0],
+    output.size(), frame.data(), frame.size());
+  checkZstd(size);
+  output.resize(size);
+  return output;
+}
+
+// Frames whose sizes are in their headers go to threads of their own as
+// soon as they have been read whole, threadCount at a time. Anything else
+// (sizes left out, as when compressing a pipe, or too big) is streamed on
+// this thread once the frames before it have been handed out.
+class ZstdDecoder : public Decoder {
+
+private:
+
+  DecoderInput input;
+  const int threadCount;
+  // Read, not yet decompressed
+  string pending;
+  bool inputEnded;
+  deque<future<vector<char> > > frames;
+  vector<char> frame;
+
+  unique_ptr<ZSTD_DStream, size_t (*)(ZSTD_DStream*)> stream;
+  bool streamNext;
+  bool streaming;
+  vector<char> output;
+
+  void readMore() {
+    size_t size;
+    const char* const block = input.next(size);
+    if(block) {
+      pending.append(block, size);
+    } else {
+      inputEnded = true;
+    }
+  }
+
+  void queueFrames() {
+    while(frames.size() < size_t(threadCount) && !streamNext) {
+      if(pending.size() < frameHeaderMaxSize && !inputEnded) {
+        readMore();
+        continue;
+      }
+      if(pending.empty()) {
+        return;
+      }
+      const unsigned long long contentSize = ZSTD_getFrameContentSize(pending.data(),
+        pending.size());
+      if(contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR ||
+        contentSize > maxWholeFrameSize) {
+        streamNext = true;
+        return;
+      }
+      const size_t frameSize = ZSTD_findFrameCompressedSize(pending.data(), pending.size());
+      if(ZSTD_isError(frameSize)) {
+        // Not read whole yet. Streaming says what is wrong with a bad one.
+        if(inputEnded) {
+          streamNext = true;
+          return;
+        }
+        readMore();
+        continue;
+      }
+      frames.push_back(async(threadCount > 1 ? launch::async : launch::deferred,
+        decompressFrame, pending.substr(0, frameSize)));
+      pending.erase(0, frameSize);
+    }
+  }
+
+  // The next piece of the streamed frame, up to its end
+  void decompressStreamed(size_t& size) {
+    ZSTD_outBuffer out = { &output[0], output.size(), 0 };
+    while(out.pos < out.size) {
+      if(pending.empty()) {
+        if(inputEnded) {
+          throw runtime_error("Truncated zstd OBJ file");
+        }
+        readMore();
+        continue;
+      }
+      ZSTD_inBuffer in = { pending.data(), pending.size(), 0 };
+      const size_t result = ZSTD_decompressStream(stream.get(), &out, &in);
+      checkZstd(result);
+      pending.erase(0, in.pos);
+      if(result == 0) {
+        streaming = false;
+        break;
+      }
+    }
+    size = out.pos;
+  }
+
+public:
+
+  ZstdDecoder(const DecoderInput& input, const int threadCount) : input(input),
+    threadCount(threadCount), inputEnded(false), stream(ZSTD_createDStream(), ZSTD_freeDStream),
+    streamNext(false), streaming(false), output(outputBlockSize) {
+  }
+
+  const char* next(size_t& size) {
+    while(true) {
+      if(!streaming) {
+        queueFrames();
+      }
+      if(!frames.empty()) {
+        frame = frames.front().get();
+        frames.pop_front();
+        if(!frame.empty()) {
+          size = frame.size();
+          return &frame[0];
+        }
+        continue;
+      }
+      if(streamNext) {
+        checkZstd(ZSTD_initDStream(stream.get()));
+        streamNext = false;
+        streaming = true;
+      }
+      if(streaming) {
+        decompressStreamed(size);
+        if(size > 0) {
+          return &output[0];
+        }
+        continue;
+      }
+      size = 0;
+      return NULL;
+    }
+  }
+};
+
+#endif
+
+}
+
+DecodingReader::DecodingReader(const int threadCount) : compression(COMPRESSION_NONE),
+  threadCount(threadCount > 0 ? threadCount : max(int(thread::hardware_concurrency()), 1)) {
+}
+
+DecodingReader::~DecodingReader() {
+  close();
+}
+
+bool DecodingReader::open(const string& filename) {
+  close();
+  if(!reader.open(filename)) {
+    return false;
+  }
+  DecoderInput input;
+  input.reader = &reader;
+  input.first = reader.next(input.firstSize);
+  compression = ::getCompression(input.first, input.firstSize);
+  switch(compression) {
+  case COMPRESSION_NONE:
+    decoder.reset(new PlainDecoder(input));
+    break;
+  case COMPRESSION_GZIP:
+#ifdef OBJ_HAVE_ZLIB
+    decoder.reset(new GzipDecoder(input));
+    break;
+#else
+    throw runtime_error("'" + filename + "' is gzip-compressed, which this build cannot "
+      "read (build with OBJ_HAVE_ZLIB)");
+#endif
+  case COMPRESSION_ZSTD:
+#ifdef OBJ_HAVE_ZSTD
+    decoder.reset(new ZstdDecoder(input, threadCount));
+    break;
+#else
+    throw runtime_error("'" + filename + "' is zstd-compressed, which this build cannot "
+      "read (build with OBJ_HAVE_ZSTD)");
+#endif
+  }
+  return true;
+}
+
+void DecodingReader::close() {
+  // Frames still being decompressed are waited for before the reader stops
+  decoder.reset();
+  reader.close();
+  compression = COMPRESSION_NONE;
+}
+
+const char* DecodingReader::next(size_t& size) {
+  size = 0;
+  return decoder ? decoder->next(size) : NULL;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include "block_reader.h"
+
+// Build with -DOBJ_HAVE_ZLIB (and -lz) and -DOBJ_HAVE_ZSTD (and -lzstd) to
+// read compressed files. Without them, compressed files are still found by
+// their magic bytes, loading one throws.
+
+enum Compression {
+  COMPRESSION_NONE,
+  COMPRESSION_GZIP,
+  COMPRESSION_ZSTD
+};
+
+// By the magic bytes at the start of a file
+Compression getCompression(const char* data, size_t size);
+
+class Decoder;
+
+// Reads a file a block at a time like BlockReader does (whose thread still
+// does the reading), decompressing gzip and zstd files on the way. Files
+// that are neither are passed through as they are. Concatenated gzip
+// members are read as one file. Up to threadCount zstd frames are
+// decompressed at once, ahead of the block being handed out, so files
+// compressed in many frames (e.g. "zstd -B4M") decompress in parallel.
+class DecodingReader {
+
+private:
+
+  BlockReader reader;
+  Compression compression;
+  std::unique_ptr<Decoder> decoder;
+  const int threadCount;
+
+  // Not copyable, the decoder points at the reader
+  DecodingReader(const DecodingReader&);
+  DecodingReader& operator=(const DecodingReader&);
+
+public:
+
+  // threadCount 0 uses every core
+  explicit DecodingReader(int threadCount = 0);
+  ~DecodingReader();
+
+  // Starts reading, false if the file cannot be opened
+  bool open(const std::string& filename);
+  void close();
+
+  // The next block of the decompressed file, valid until the next call,
+  // NULL at its end. Throws runtime_error if the file cannot be read or
+  // decompressed.
+  const char* next(size_t& size);
+
+  Compression getCompression() const {
+    return compression;
+  }
+
+  bool isRegularFile() const {
+    return reader.isRegularFile();
+  }
+
+  // Of the file itself, compressed
+  uint64_t getBytesRead() const {
+    return reader.getBytesRead();
+  }
+};
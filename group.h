@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+namespace Geometry {
+
+	// What the g and o lines of a file named one run of its tris. Entry i
+	// of a mesh's group table goes with value i of its Group channel, the
+	// first tri of the run; the run ends where the next one starts.
+	struct Group {
+		// The rest of the g line, e.g. "wheel left" for a tri in both
+		// groups. Empty before the first g line.
+		std::string name;
+		// Of the o line, empty before the first one
+		std::string object;
+
+		explicit Group(const std::string& name = "", const std::string& object = "") :
+			name(name), object(object) {
+		}
+
+		bool operator==(const Group& group) const {
+			return name == group.name && object == group.object;
+		}
+	};
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+	// A read-only view of a whole file mapped into memory.
+	// open() fails for anything that is not a regular file (pipes, devices,
+	// sockets), so callers can fall back to reading through a stream.
+	class MappedFile {
+
+	private:
+
+		const char* data;
+		size_t size;
+
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#endif
+
+		// Not copyable, the mapping has a single owner
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+	public:
+
+		MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+			file = INVALID_HANDLE_VALUE;
+			mapping = NULL;
+#endif
+		}
+
+		~MappedFile() {
+			close();
+		}
+
+		bool open(const std::string& filename) {
+			close();
+#ifdef _WIN32
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if(file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if(GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize)) {
+				close();
+				return false;
+			}
+			size = size_t(fileSize.QuadPart);
+			if(size == 0) {
+				// Empty files cannot be mapped, but they are valid (and empty) input
+				return true;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(mapping == NULL) {
+				close();
+				return false;
+			}
+			data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if(data == NULL) {
+				close();
+				return false;
+			}
+#else
+			const int fd = ::open(filename.c_str(), O_RDONLY);
+			if(fd < 0) {
+				return false;
+			}
+			struct stat info;
+			if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+				::close(fd);
+				return false;
+			}
+			size = size_t(info.st_size);
+			if(size == 0) {
+				::close(fd);
+				return true;
+			}
+			void* const address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping keeps its own reference to the file
+			::close(fd);
+			if(address == MAP_FAILED) {
+				size = 0;
+				return false;
+			}
+			data = static_cast<const char*>(address);
+			madvise(address, size, MADV_SEQUENTIAL);
+#endif
+			return true;
+		}
+
+		void close() {
+#ifdef _WIN32
+			if(data) {
+				UnmapViewOfFile(data);
+			}
+			if(mapping) {
+				CloseHandle(mapping);
+			}
+			if(file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+			mapping = NULL;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if(data) {
+				munmap(const_cast<char*>(data), size);
+			}
+#endif
+			data = NULL;
+			size = 0;
+		}
+
+		// Lets the system drop the pages of [offset, offset + length) that
+		// are in memory, they are read again from the file if touched.
+		// Keeps reading a file bigger than memory from filling it up.
+		void release(const size_t offset, const size_t length) {
+#ifndef _WIN32
+			const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+			const size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+			const size_t end = std::min(offset + length, size) / pageSize * pageSize;
+			if(data && begin < end) {
+				madvise(const_cast<char*>(data) + begin, end - begin, MADV_DONTNEED);
+			}
+#else
+			// Read-only views are trimmed from the working set by the system
+			(void)offset;
+			(void)length;
+#endif
+		}
+
+		const char* getData() const {
+			return data;
+		}
+
+		size_t getSize() const {
+			return size;
+		}
+	};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vec3.h>
+
+#include <string>
+
+namespace Geometry {
+
+	// One entry of a mesh's material table, as a .mtl file defines it. The
+	// MaterialId channel indexes the table. Values the file leaves out keep
+	// the defaults below.
+	struct Material {
+		std::string name;
+		// Ka, Kd and Ks
+		Vec3f ambient;
+		Vec3f diffuse;
+		Vec3f specular;
+		// Ns
+		float shininess;
+		// d, or 1 - Tr
+		float opacity;
+		// The texture files of map_Ka, map_Kd, map_Ks, map_Ns, map_d and
+		// bump (or map_bump), as written in the file
+		std::string ambientMap;
+		std::string diffuseMap;
+		std::string specularMap;
+		std::string shininessMap;
+		std::string opacityMap;
+		std::string bumpMap;
+
+		explicit Material(const std::string& name = "") : name(name),
+			ambient(0, 0, 0), diffuse(0, 0, 0), specular(0, 0, 0),
+			shininess(1), opacity(1) {
+		}
+	};
+};
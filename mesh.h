@@ -1,10 +1,19 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdio>
+#include <functional>
 #include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "channel.h"
+#include "group.h"
+#include "material.h"
 
 namespace Geometry {
 	
@@ -19,13 +28,107 @@ namespace Geometry {
 		
 		// One complex channels maps to multiple value channels
 		Realization realization;
+
+		// Where the first channel of every name is in channels. Rebuilt on
+		// the next lookup when channels changed other than at the end.
+		std::unordered_map<std::string, int> channelIndices;
+		bool channelIndicesValid;
+
+		typedef std::pair<std::string, std::string> NamePair;
+
+		struct NamePairHash {
+			size_t operator()(const NamePair& names) const {
+				const std::hash<std::string> hash;
+				return hash(names.first) * 31 + hash(names.second);
+			}
+		};
+
+		// The entries of realization by the names of both channels, for
+		// setRealization()
+		std::unordered_multimap<NamePair, Realization::iterator, NamePairHash> realizationsByName;
+
+		// The values of every channel made with this mesh as its owner, given
+		// back in one go by clear(). Each channel holds on to it too, so that
+		// it lives on for channels that outlive clear(): removed ones and
+		// those of instances of this mesh.
+		std::shared_ptr<Arena> arena;
+
+		// What the values of a MaterialId channel stand for
+		std::vector<Material> materials;
+
+		// The names of the runs the Group channel starts
+		std::vector<Group> groups;
+
+		friend std::shared_ptr<Arena> getMeshArena(const Mesh* const mesh);
+
+		void indexChannels() {
+			channelIndices.clear();
+			const int channelCount = int(channels.size());
+			for(int i = 0; i < channelCount; i++) {
+				channelIndices.insert(std::make_pair(channels[i]->getName(), i));
+			}
+			channelIndicesValid = true;
+		}
+
+		// -1 if there is none. Scans if the index is out of date, which only
+		// the non-const getChannels() can leave it in for a const mesh.
+		int findChannel(const std::string& name) const {
+			if(!channelIndicesValid) {
+				const int channelCount = int(channels.size());
+				for(int i = 0; i < channelCount; i++) {
+					if(channels[i]->getName() == name) {
+						return i;
+					}
+				}
+				return -1;
+			}
+			const std::unordered_map<std::string, int>::const_iterator search =
+				channelIndices.find(name);
+			return search == channelIndices.end() ? -1 : search->second;
+		}
+
+		int findChannel(const std::string& name) {
+			if(!channelIndicesValid) {
+				indexChannels();
+			}
+			return static_cast<const Mesh*>(this)->findChannel(name);
+		}
+
+		// Channels without a name to go by (NULL) are not indexed
+		void insertRealization(const Realization::iterator hint, Channel* const key,
+			Channel* const value) {
+			const Realization::iterator entry = realization.insert(hint, std::make_pair(key, value));
+			if(key && value) {
+				realizationsByName.insert(std::make_pair(NamePair(key->getName(), value->getName()), entry));
+			}
+		}
+
+		void eraseRealization(const Realization::iterator entry) {
+			if(entry->first && entry->second) {
+				typedef std::unordered_multimap<NamePair, Realization::iterator, NamePairHash>::iterator Iterator;
+				const std::pair<Iterator, Iterator> range = realizationsByName.equal_range(
+					NamePair(entry->first->getName(), entry->second->getName()));
+				for(Iterator it = range.first; it != range.second; ++it) {
+					if(it->second == entry) {
+						realizationsByName.erase(it);
+						break;
+					}
+				}
+			}
+			realization.erase(entry);
+		}
 		
 	public:
 
+		Mesh() : channelIndicesValid(true), arena(std::make_shared<Arena>()) {
+		}
+
 		~Mesh() {
 			clear();
 		}
 
+		// Deletes the channels this mesh owns. The arena is given back in one
+		// go unless channels still hold on to it, which then start a new one.
 		void clear() {
 			const int channelCount = int(channels.size());
 			for(int i = 0; i < channelCount; i++) {
@@ -34,34 +137,84 @@ namespace Geometry {
 				}
 			}
 			channels.clear();
+			materials.clear();
+			groups.clear();
 			realization.clear();
+			channelIndices.clear();
+			channelIndicesValid = true;
+			realizationsByName.clear();
+			if(arena.use_count() == 1) {
+				arena->release();
+			} else {
+				arena = std::make_shared<Arena>();
+			}
+		}
+
+		// Bytes the channel values of this mesh hold from the heap
+		size_t getArenaBytes() const {
+			return arena->getReservedBytes();
 		}
 
+		// Makes every channel of mesh an instance in this one (see
+		// Channel::makeInstance()), realized the same way. Takes no channel
+		// memory and leaves mesh as it is: the values stay where they are,
+		// shared until either side writes to a channel, which copies only
+		// that one.
 		void makeInstanceOf(const Mesh* const mesh) {
+			if(mesh == this) {
+				return;
+			}
 			clear();
 
-			channels = mesh->channels;
-			realization = mesh->realization;
+			std::unordered_map<const Channel*, Channel*> instances;
+			const int channelCount = int(mesh->channels.size());
+			for(int i = 0; i < channelCount; i++) {
+				const Channel* const channel = mesh->channels[i];
+				const std::pair<std::unordered_map<const Channel*, Channel*>::iterator, bool> entry =
+					instances.insert(std::make_pair(channel, static_cast<Channel*>(NULL)));
+				if(entry.second) {
+					entry.first->second = channel->makeInstance(this);
+				}
+				channels.push_back(entry.first->second);
+			}
+			// Channels that mesh realizes without holding them stay shared
+			for(	Realization::const_iterator it = mesh->realization.begin();
+					it != mesh->realization.end();
+					++it)
+			{
+				const std::unordered_map<const Channel*, Channel*>::const_iterator key = instances.find(it->first);
+				const std::unordered_map<const Channel*, Channel*>::const_iterator value = instances.find(it->second);
+				insertRealization(realization.end(),
+					key == instances.end() ? it->first : key->second,
+					value == instances.end() ? it->second : value->second);
+			}
+			materials = mesh->materials;
+			groups = mesh->groups;
+			indexChannels();
 		}
 
 		void addChannel(Channel* const channel) {
+			if(channelIndicesValid) {
+				// Keeps the index of an earlier channel of the same name
+				channelIndices.insert(std::make_pair(channel->getName(), int(channels.size())));
+			}
 			channels.push_back(channel);
 		}
 
+		// A channel of ours is the caller's to delete afterwards. It keeps
+		// its values, their arena lives on for it.
 		void removeChannel(Channel* const channel) {
-			// Poor mans delete!
-			const std::vector<Channel*> oldChannels = channels;			
-			const int channelCount = int(channels.size());
-			channels.clear();
-			for(int i = 0; i < channelCount; i++) {
-				Channel* const oldChannel = oldChannels[i];
-				if(oldChannel != channel) {
-					channels.push_back(oldChannel);
-				}
+			const std::vector<Channel*>::iterator end = std::remove(channels.begin(), channels.end(), channel);
+			if(end != channels.end()) {
+				channels.erase(end, channels.end());
+				channelIndicesValid = false;
 			}
 		}
 
+		// Lookups by name see changes made through this once they are done:
+		// the name index is rebuilt on the next non-const lookup
 		std::vector<Channel*>& getChannels() {
+			channelIndicesValid = false;
 			return channels;
 		}
 		
@@ -69,66 +222,129 @@ namespace Geometry {
 			return channels;
 		}
 
+		std::vector<Material>& getMaterials() {
+			return materials;
+		}
+
+		const std::vector<Material>& getMaterials() const {
+			return materials;
+		}
+
+		std::vector<Group>& getGroups() {
+			return groups;
+		}
+
+		const std::vector<Group>& getGroups() const {
+			return groups;
+		}
+
 		Channel* getChannelByName(const std::string& name) {
-			const int channelCount = int(channels.size());
-			for(int i = 0; i < channelCount ; i++) {
-				if(channels[i]->getName() == name) {
-					return channels[i];
-				}
-			}			
-			return NULL;
+			const int index = findChannel(name);
+			return index < 0 ? NULL : channels[index];
 		}
 
 		const Channel* getChannelByName(const std::string& name) const {
-			const int channelCount = int(channels.size());
-			for(int i = 0; i < channelCount ; i++) {
-				if(channels[i]->getName() == name) {
-					return channels[i];
-				}
-			}			
-			return NULL;
+			const int index = findChannel(name);
+			return index < 0 ? NULL : channels[index];
 		}
 
 		void setChannelByName(const std::string& name, Channel* const channel) {
-			
-			const int channelCount = int(channels.size());
-			for(int i = 0; i < channelCount ; i++) {
-				if(channels[i]->getName() == name) {
-					if(channels[i]->getOwner() == this) {
-            printf("Replacing an owned channel. Maybe it should be deleted?");
-					}
-					channels[i] = channel;
-					return;
-				}
+			const int index = findChannel(name);
+			if(index < 0) {
+				addChannel(channel);
+				return;
+			}
+			if(channels[index]->getOwner() == this) {
+				printf("Replacing an owned channel. Maybe it should be deleted?");
+			}
+			channels[index] = channel;
+			if(channel->getName() != name) {
+				channelIndicesValid = false;
 			}
-			channels.push_back(channel);
 		}
 
+		// Replaces the realizations between channels of these names, in
+		// either direction
 		void setRealization(Channel* const attributeChannel, Channel* const complexChannel) {
+			typedef std::unordered_multimap<NamePair, Realization::iterator, NamePairHash>::iterator Iterator;
 			std::vector<Realization::iterator> pending;
-			for(	Realization::iterator it = realization.begin();
-					it != realization.end();
-					++it)
-			{
-				if(it->first->getName() == attributeChannel->getName() && it->second->getName() == complexChannel->getName()) {
-					pending.push_back(it);
-				}
-				if(it->first->getName() == complexChannel->getName() && it->second->getName() == attributeChannel->getName()) {
-					pending.push_back(it);
+			const NamePair names(attributeChannel->getName(), complexChannel->getName());
+			std::pair<Iterator, Iterator> range = realizationsByName.equal_range(names);
+			for(Iterator it = range.first; it != range.second; ++it) {
+				pending.push_back(it->second);
+			}
+			if(names.first != names.second) {
+				range = realizationsByName.equal_range(NamePair(names.second, names.first));
+				for(Iterator it = range.first; it != range.second; ++it) {
+					pending.push_back(it->second);
 				}
 			}
-			
+
 			const int count = int(pending.size());
 			for( int i = 0; i < count; i++) {
-				realization.erase(pending[i]);
+				eraseRealization(pending[i]);
 			}
 
 			addRealization(attributeChannel, complexChannel);
 		}
 
+		// Puts newChannel where oldChannel was, realizations included, and
+		// deletes oldChannel if it is ours
+		void replaceChannel(Channel* const oldChannel, Channel* const newChannel) {
+			const int channelCount = int(channels.size());
+			for(int i = 0; i < channelCount; i++) {
+				if(channels[i] == oldChannel) {
+					channels[i] = newChannel;
+				}
+			}
+			if(newChannel->getName() != oldChannel->getName()) {
+				channelIndicesValid = false;
+			}
+
+			// Realizations come in pairs, the other halves are with the
+			// channels oldChannel realizes. New entries go where the old ones
+			// were among those of the same channel, so getRealization() still
+			// picks the same one.
+			std::vector<Realization::iterator> pending;
+			std::vector<Channel*> partners;
+			const std::pair<Realization::iterator, Realization::iterator> range = realization.equal_range(oldChannel);
+			for(Realization::iterator it = range.first; it != range.second; ++it) {
+				pending.push_back(it);
+				if(it->second != oldChannel) {
+					partners.push_back(it->second);
+				}
+			}
+			std::sort(partners.begin(), partners.end());
+			partners.erase(std::unique(partners.begin(), partners.end()), partners.end());
+			for(size_t i = 0; i < partners.size(); i++) {
+				const std::pair<Realization::iterator, Realization::iterator> partnerRange =
+					realization.equal_range(partners[i]);
+				for(Realization::iterator it = partnerRange.first; it != partnerRange.second; ++it) {
+					if(it->second == oldChannel) {
+						pending.push_back(it);
+					}
+				}
+			}
+			for(size_t i = 0; i < pending.size(); i++) {
+				const Realization::iterator it = pending[i];
+				insertRealization(it,
+					it->first == oldChannel ? newChannel : it->first,
+					it->second == oldChannel ? newChannel : it->second);
+				eraseRealization(it);
+			}
+			if(oldChannel->getOwner() == this) {
+				delete oldChannel;
+			}
+		}
+
 		void addRealization(Channel* const attributeChannel, Channel* const complexChannel) {
-			realization.insert(std::pair<Channel*, Channel*>(complexChannel, attributeChannel));
-			realization.insert(std::pair<Channel*, Channel*>(attributeChannel, complexChannel));
+			insertRealization(realization.end(), complexChannel, attributeChannel);
+			insertRealization(realization.end(), attributeChannel, complexChannel);
+		}
+
+		// Both directions of every addRealization(), in no particular order
+		const Realization& getRealizations() const {
+			return realization;
 		}
 
 		Channel* getRealization(const Channel* const attributeChannel) {
@@ -141,17 +357,13 @@ namespace Geometry {
 			return search == realization.end() ? NULL : search->second;
 		}
 
+		// Simplices, flat channels and anything named like a Tri channel
 		bool isComplexChannel(const Channel* const channel) const {
-#ifdef __CUDACC__
-			// Comparison between typeid is not available in the current CUDA compiler
-			assert(false);
-			return false;
-#else
+			const ElementType& elementType = channel->getElementType();
 			return 
-				typeid(*channel) == typeid(const TriChannel) ||
-				typeid(*channel) == typeid(const FlatTriChannel) ||
+				elementType.isSimplex ||
+				elementType.scalarType == NO_SCALAR ||
 				channel->getName().find("Tri") != std::string::npos;
-#endif
 		}
 
 		bool isAttributeChannel(const Channel* const channel) const {
@@ -255,6 +467,46 @@ namespace Geometry {
     */
 	};
 
+	inline std::shared_ptr<Arena> getMeshArena(const Mesh* const mesh) {
+		return mesh ? mesh->arena : std::shared_ptr<Arena>();
+	}
+
+	// Switches every Vec2f, Vec3f and Vec4f channel of the mesh to SoA
+	// layout (SoAChannel), or back to BaseChannel. Names, order and
+	// realizations stay as they are.
+	template<typename T> void convertChannelLayout(Mesh* const mesh, Channel* const channel,
+		const bool toSoA) {
+		if(toSoA) {
+			mesh->replaceChannel(channel,
+				makeSoAChannel(*static_cast<const BaseChannel<T>*>(channel), mesh));
+		} else {
+			mesh->replaceChannel(channel,
+				makeAoSChannel(*static_cast<const SoAChannel<T>*>(channel), mesh));
+		}
+	}
+
+	inline void convertVectorChannels(Mesh* const mesh, const bool toSoA) {
+		const std::vector<Channel*> channels = mesh->getChannels();
+		const int channelCount = int(channels.size());
+		for(int i = 0; i < channelCount; i++) {
+			const ElementType& elementType = channels[i]->getElementType();
+			if(elementType.scalarType != FLOAT_SCALAR || elementType.isPlanar == toSoA) {
+				continue;
+			}
+			switch(elementType.componentCount) {
+			case 2:
+				convertChannelLayout<Vec2f>(mesh, channels[i], toSoA);
+				break;
+			case 3:
+				convertChannelLayout<Vec3f>(mesh, channels[i], toSoA);
+				break;
+			case 4:
+				convertChannelLayout<Vec4f>(mesh, channels[i], toSoA);
+				break;
+			}
+		}
+	}
+
 // 	class MeshTypeTrait {
 // 
 // 	public:
@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "sidecar_file.h"
+
+using namespace Geometry;
+using namespace std;
+
+// Bump whenever the layout below, the memory layout of a value type or what
+// the loader puts in the channels changes
+static const uint32_t cacheVersion = 4;
+static const char cacheMagic[8] = { 'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E' };
+
+// Payloads start at multiples of this, so that a mapped file can be read
+// as arrays of any value type
+static const size_t cacheAlignment = 16;
+
+// The file is a header, a table of channels, the realizations as pairs of
+// channel indices, the dependencies, the materials, the groups, the names
+// of the channels and dependencies and the strings of the materials and
+// groups, then the aligned values of every channel. The checksum covers
+// everything after the header.
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t channelCount;
+  uint32_t realizationCount;
+  uint32_t materialCount;
+  uint64_t sourceSize;
+  int64_t sourceModified;
+  uint64_t fileSize;
+  uint64_t checksum;
+  uint32_t dependencyCount;
+  uint32_t groupCount;
+};
+
+struct CacheChannel {
+  uint32_t kind;
+  uint32_t valueSize;
+  uint32_t nameLength;
+  uint32_t reserved;
+  uint64_t valueCount;
+  uint64_t valueOffset;
+};
+
+struct CacheRealization {
+  uint32_t channel;
+  uint32_t realization;
+};
+
+// A file the snapshot was made from besides the source. modified is -1 if
+// there was no such file.
+struct CacheDependency {
+  uint64_t size;
+  int64_t modified;
+  uint32_t nameLength;
+  uint32_t reserved;
+};
+
+// The strings are stored with the names, in getMaterialStrings() order
+struct CacheMaterial {
+  float ambient[3];
+  float diffuse[3];
+  float specular[3];
+  float shininess;
+  float opacity;
+  uint32_t stringLengths[7];
+};
+
+struct CacheGroup {
+  uint32_t nameLength;
+  uint32_t objectLength;
+};
+
+template<typename M, typename S> static void getMaterialStrings(M& material, S* strings[7]) {
+  strings[0] = &material.name;
+  strings[1] = &material.ambientMap;
+  strings[2] = &material.diffuseMap;
+  strings[3] = &material.specularMap;
+  strings[4] = &material.shininessMap;
+  strings[5] = &material.opacityMap;
+  strings[6] = &material.bumpMap;
+}
+
+enum CacheChannelKind {
+  CACHE_FLAT,
+  CACHE_INT,
+  CACHE_FLOAT,
+  CACHE_VEC2F,
+  CACHE_VEC3F,
+  CACHE_VEC4F,
+  CACHE_EDGE,
+  CACHE_TRI,
+  CACHE_TETRA,
+  CACHE_UNKNOWN
+};
+
+static size_t alignUp(const size_t offset) {
+  return (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+}
+
+static CacheDependency getDependency(const string& filename) {
+  CacheDependency dependency;
+  memset(&dependency, 0, sizeof(dependency));
+  if(!getFileStamp(filename, dependency.size, dependency.modified)) {
+    dependency.size = 0;
+    dependency.modified = -1;
+  }
+  dependency.nameLength = uint32_t(filename.size());
+  return dependency;
+}
+
+// The kind is read off the channel's element type, with no casts. Value
+// types the format has no kind for are CACHE_UNKNOWN. Planar channels are
+// stored like their BaseChannel, so either layout loads from the same file.
+static CacheChannelKind getChannelKind(const Channel* const channel, uint32_t& valueSize) {
+  const ElementType& elementType = channel->getElementType();
+  valueSize = uint32_t(elementType.stride);
+  switch(elementType.scalarType) {
+  case NO_SCALAR:
+    return CACHE_FLAT;
+  case FLOAT_SCALAR:
+    switch(elementType.componentCount) {
+    case 1:
+      return CACHE_FLOAT;
+    case 2:
+      valueSize = uint32_t(ElementTraits<Vec2f>::getElementType().stride);
+      return CACHE_VEC2F;
+    case 3:
+      valueSize = uint32_t(ElementTraits<Vec3f>::getElementType().stride);
+      return CACHE_VEC3F;
+    case 4:
+      valueSize = uint32_t(ElementTraits<Vec4f>::getElementType().stride);
+      return CACHE_VEC4F;
+    }
+    break;
+  case INT_SCALAR:
+    if(!elementType.isSimplex) {
+      return elementType.componentCount == 1 ? CACHE_INT : CACHE_UNKNOWN;
+    }
+    switch(elementType.componentCount) {
+    case 2:
+      return CACHE_EDGE;
+    case 3:
+      return CACHE_TRI;
+    case 4:
+      return CACHE_TETRA;
+    }
+    break;
+  }
+  return CACHE_UNKNOWN;
+}
+
+// Puts the values of an SoAChannel back together, padding zeroed, a block
+// at a time
+template<typename Write> static void writePlanarValues(const Channel& channel,
+  const size_t valueSize, const Write& write) {
+  const ElementType& elementType = channel.getElementType();
+  const size_t count = size_t(channel.getSize());
+  const size_t blockCount = 4096;
+  vector<char> block(blockCount * valueSize);
+  for(size_t begin = 0; begin < count; begin += blockCount) {
+    const size_t end = min(begin + blockCount, count);
+    for(int c = 0; c < elementType.componentCount; c++) {
+      const char* const component = static_cast<const char*>(channel.getComponentData(c));
+      for(size_t i = begin; i < end; i++) {
+        memcpy(&block[(i - begin) * valueSize + c * elementType.stride],
+          component + i * elementType.stride, size_t(elementType.stride));
+      }
+    }
+    write(block.data(), (end - begin) * valueSize);
+  }
+}
+
+// The mapping is aligned for every value type, so the values can be copied
+// straight into the channel
+template<typename T> static Channel* makeChannel(const string& name, Mesh* const mesh,
+  const char* const data, const uint64_t count) {
+  BaseChannel<T>* const channel = new BaseChannel<T>(name, mesh);
+  const T* const values = reinterpret_cast<const T*>(data);
+  channel->getValues().assign(values, values + count);
+  return channel;
+}
+
+static Channel* makeChannel(const CacheChannelKind kind, const string& name, Mesh* const mesh,
+  const char* const data, const uint64_t count) {
+  switch(kind) {
+  case CACHE_INT:
+    return makeChannel<int>(name, mesh, data, count);
+  case CACHE_FLOAT:
+    return makeChannel<float>(name, mesh, data, count);
+  case CACHE_VEC2F:
+    return makeChannel<Vec2f>(name, mesh, data, count);
+  case CACHE_VEC3F:
+    return makeChannel<Vec3f>(name, mesh, data, count);
+  case CACHE_VEC4F:
+    return makeChannel<Vec4f>(name, mesh, data, count);
+  case CACHE_EDGE:
+    return makeChannel<Edge>(name, mesh, data, count);
+  case CACHE_TRI:
+    return makeChannel<Tri>(name, mesh, data, count);
+  case CACHE_TETRA:
+    return makeChannel<Tetra>(name, mesh, data, count);
+  default:
+    return new FlatChannel(name, mesh);
+  }
+}
+
+string getMeshCacheFilename(const string& sourceFilename) {
+  return sourceFilename + ".meshcache";
+}
+
+bool saveMeshCache(const string& cacheFilename, const Mesh& mesh,
+  const string& sourceFilename, const vector<string>& dependencies) {
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  if(!sourceFilename.empty() &&
+    !getFileStamp(sourceFilename, header.sourceSize, header.sourceModified)) {
+    return false;
+  }
+
+  const vector<Channel*>& channels = mesh.getChannels();
+  const int channelCount = int(channels.size());
+  map<const Channel*, uint32_t> channelIndices;
+  vector<CacheChannel> table(channelCount);
+  string names;
+  for(int i = 0; i < channelCount; i++) {
+    const Channel* const channel = channels[i];
+    CacheChannel& entry = table[i];
+    memset(&entry, 0, sizeof(entry));
+    const CacheChannelKind kind = getChannelKind(channel, entry.valueSize);
+    if(kind == CACHE_UNKNOWN) {
+      return false;
+    }
+    entry.kind = kind;
+    entry.nameLength = uint32_t(channel->getName().size());
+    entry.valueCount = kind == CACHE_FLAT ? 0 : uint64_t(channel->getSize());
+    names += channel->getName();
+    channelIndices[channel] = uint32_t(i);
+  }
+
+  vector<CacheRealization> realizations;
+  const multimap<Channel*, Channel*>& meshRealizations = mesh.getRealizations();
+  for(multimap<Channel*, Channel*>::const_iterator it = meshRealizations.begin();
+    it != meshRealizations.end();
+    ++it)
+  {
+    // Realizations of channels the mesh no longer has are dropped
+    const map<const Channel*, uint32_t>::const_iterator first = channelIndices.find(it->first);
+    const map<const Channel*, uint32_t>::const_iterator second = channelIndices.find(it->second);
+    if(first != channelIndices.end() && second != channelIndices.end()) {
+      CacheRealization realization;
+      realization.channel = first->second;
+      realization.realization = second->second;
+      realizations.push_back(realization);
+    }
+  }
+  header.channelCount = uint32_t(channelCount);
+  header.realizationCount = uint32_t(realizations.size());
+
+  vector<CacheDependency> dependencyTable(dependencies.size());
+  for(size_t i = 0; i < dependencies.size(); i++) {
+    dependencyTable[i] = getDependency(dependencies[i]);
+    names += dependencies[i];
+  }
+  header.dependencyCount = uint32_t(dependencyTable.size());
+
+  const vector<Material>& materials = mesh.getMaterials();
+  vector<CacheMaterial> materialTable(materials.size());
+  for(size_t i = 0; i < materials.size(); i++) {
+    const Material& material = materials[i];
+    CacheMaterial& entry = materialTable[i];
+    memset(&entry, 0, sizeof(entry));
+    for(int c = 0; c < 3; c++) {
+      entry.ambient[c] = material.ambient[c];
+      entry.diffuse[c] = material.diffuse[c];
+      entry.specular[c] = material.specular[c];
+    }
+    entry.shininess = material.shininess;
+    entry.opacity = material.opacity;
+    const string* strings[7];
+    getMaterialStrings(material, strings);
+    for(int j = 0; j < 7; j++) {
+      entry.stringLengths[j] = uint32_t(strings[j]->size());
+      names += *strings[j];
+    }
+  }
+  header.materialCount = uint32_t(materialTable.size());
+
+  const vector<Group>& groups = mesh.getGroups();
+  vector<CacheGroup> groupTable(groups.size());
+  for(size_t i = 0; i < groups.size(); i++) {
+    groupTable[i].nameLength = uint32_t(groups[i].name.size());
+    groupTable[i].objectLength = uint32_t(groups[i].object.size());
+    names += groups[i].name;
+    names += groups[i].object;
+  }
+  header.groupCount = uint32_t(groupTable.size());
+
+  const size_t prefixSize = sizeof(CacheHeader) + sizeof(CacheChannel) * table.size() +
+    sizeof(CacheRealization) * realizations.size() +
+    sizeof(CacheDependency) * dependencyTable.size() +
+    sizeof(CacheMaterial) * materialTable.size() +
+    sizeof(CacheGroup) * groupTable.size() + names.size();
+  size_t offset = prefixSize;
+  for(int i = 0; i < channelCount; i++) {
+    offset = alignUp(offset);
+    table[i].valueOffset = offset;
+    offset += size_t(table[i].valueSize * table[i].valueCount);
+  }
+  header.fileSize = offset;
+
+  string temporaryFilename;
+  FILE* const file = createTemporaryFile(cacheFilename, temporaryFilename);
+  if(!file) {
+    return false;
+  }
+
+  // The header goes in last, once the checksum of the rest is known
+  Checksum checksum;
+  bool written = fseek(file, long(sizeof(CacheHeader)), SEEK_SET) == 0;
+  const auto write = [&](const char* const data, const size_t size) {
+    checksum.add(data, size);
+    written = written && fwrite(data, 1, size, file) == size;
+  };
+  write(reinterpret_cast<const char*>(table.data()), sizeof(CacheChannel) * table.size());
+  write(reinterpret_cast<const char*>(realizations.data()),
+    sizeof(CacheRealization) * realizations.size());
+  write(reinterpret_cast<const char*>(dependencyTable.data()),
+    sizeof(CacheDependency) * dependencyTable.size());
+  write(reinterpret_cast<const char*>(materialTable.data()),
+    sizeof(CacheMaterial) * materialTable.size());
+  write(reinterpret_cast<const char*>(groupTable.data()),
+    sizeof(CacheGroup) * groupTable.size());
+  write(names.data(), names.size());
+  size_t position = prefixSize;
+  const char zeros[cacheAlignment] = {};
+  for(int i = 0; i < channelCount; i++) {
+    write(zeros, size_t(table[i].valueOffset) - position);
+    const size_t valueBytes = size_t(table[i].valueSize * table[i].valueCount);
+    if(valueBytes && channels[i]->getElementType().isPlanar) {
+      writePlanarValues(*channels[i], size_t(table[i].valueSize), write);
+    } else if(valueBytes) {
+      write(static_cast<const char*>(channels[i]->getRawData()), valueBytes);
+    }
+    position = size_t(table[i].valueOffset) + valueBytes;
+  }
+  header.checksum = checksum.get();
+  written = written && fseek(file, 0, SEEK_SET) == 0 &&
+    fwrite(&header, sizeof(header), 1, file) == 1;
+  if(fclose(file) != 0 || !written) {
+    remove(temporaryFilename.c_str());
+    return false;
+  }
+  return replaceFile(temporaryFilename, cacheFilename);
+}
+
+bool loadMeshCache(const string& cacheFilename, Mesh* const mesh,
+  const string& sourceFilename) {
+
+  MappedFile file;
+  if(!file.open(cacheFilename) || file.getSize() < sizeof(CacheHeader)) {
+    return false;
+  }
+  const char* const data = file.getData();
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if(memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+    header.version != cacheVersion ||
+    header.fileSize != file.getSize()) {
+    return false;
+  }
+  if(!sourceFilename.empty()) {
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if(!getFileStamp(sourceFilename, sourceSize, sourceModified) ||
+      sourceSize != header.sourceSize || sourceModified != header.sourceModified) {
+      return false;
+    }
+  }
+  Checksum checksum;
+  checksum.add(data + sizeof(CacheHeader), file.getSize() - sizeof(CacheHeader));
+  if(checksum.get() != header.checksum) {
+    return false;
+  }
+
+  // Check the whole table before the mesh is touched
+  const size_t tableSize = sizeof(CacheChannel) * header.channelCount +
+    sizeof(CacheRealization) * header.realizationCount +
+    sizeof(CacheDependency) * header.dependencyCount +
+    sizeof(CacheMaterial) * header.materialCount +
+    sizeof(CacheGroup) * header.groupCount;
+  if(tableSize > file.getSize() - sizeof(CacheHeader)) {
+    return false;
+  }
+  vector<CacheChannel> table(header.channelCount);
+  vector<CacheRealization> realizations(header.realizationCount);
+  vector<CacheDependency> dependencyTable(header.dependencyCount);
+  vector<CacheMaterial> materialTable(header.materialCount);
+  vector<CacheGroup> groupTable(header.groupCount);
+  const char* tableData = data + sizeof(CacheHeader);
+  const auto readTable = [&tableData](void* const target, const size_t size) {
+    memcpy(target, tableData, size);
+    tableData += size;
+  };
+  readTable(table.data(), sizeof(CacheChannel) * table.size());
+  readTable(realizations.data(), sizeof(CacheRealization) * realizations.size());
+  readTable(dependencyTable.data(), sizeof(CacheDependency) * dependencyTable.size());
+  readTable(materialTable.data(), sizeof(CacheMaterial) * materialTable.size());
+  readTable(groupTable.data(), sizeof(CacheGroup) * groupTable.size());
+  size_t nameOffset = sizeof(CacheHeader) + tableSize;
+  vector<string> names(table.size());
+  for(size_t i = 0; i < table.size(); i++) {
+    const CacheChannel& entry = table[i];
+    uint32_t valueSize = 0;
+    switch(entry.kind) {
+    case CACHE_INT: valueSize = sizeof(int); break;
+    case CACHE_FLOAT: valueSize = sizeof(float); break;
+    case CACHE_VEC2F: valueSize = sizeof(Vec2f); break;
+    case CACHE_VEC3F: valueSize = sizeof(Vec3f); break;
+    case CACHE_VEC4F: valueSize = sizeof(Vec4f); break;
+    case CACHE_EDGE: valueSize = sizeof(Edge); break;
+    case CACHE_TRI: valueSize = sizeof(Tri); break;
+    case CACHE_TETRA: valueSize = sizeof(Tetra); break;
+    case CACHE_FLAT: break;
+    default: return false;
+    }
+    if(entry.valueSize != valueSize || entry.nameLength > file.getSize() - nameOffset ||
+      entry.valueOffset % cacheAlignment != 0 || entry.valueOffset > file.getSize() ||
+      (valueSize && entry.valueCount > (file.getSize() - entry.valueOffset) / valueSize)) {
+      return false;
+    }
+    names[i].assign(data + nameOffset, entry.nameLength);
+    nameOffset += entry.nameLength;
+  }
+  for(size_t i = 0; i < realizations.size(); i++) {
+    if(realizations[i].channel >= table.size() || realizations[i].realization >= table.size()) {
+      return false;
+    }
+  }
+  for(size_t i = 0; i < dependencyTable.size(); i++) {
+    const CacheDependency& entry = dependencyTable[i];
+    if(entry.nameLength > file.getSize() - nameOffset) {
+      return false;
+    }
+    const CacheDependency current = getDependency(string(data + nameOffset, entry.nameLength));
+    if(current.size != entry.size || current.modified != entry.modified) {
+      return false;
+    }
+    nameOffset += entry.nameLength;
+  }
+  vector<Material> materials(materialTable.size());
+  for(size_t i = 0; i < materialTable.size(); i++) {
+    const CacheMaterial& entry = materialTable[i];
+    Material& material = materials[i];
+    material.ambient = Vec3f(entry.ambient[0], entry.ambient[1], entry.ambient[2]);
+    material.diffuse = Vec3f(entry.diffuse[0], entry.diffuse[1], entry.diffuse[2]);
+    material.specular = Vec3f(entry.specular[0], entry.specular[1], entry.specular[2]);
+    material.shininess = entry.shininess;
+    material.opacity = entry.opacity;
+    string* strings[7];
+    getMaterialStrings(material, strings);
+    for(int j = 0; j < 7; j++) {
+      if(entry.stringLengths[j] > file.getSize() - nameOffset) {
+        return false;
+      }
+      strings[j]->assign(data + nameOffset, entry.stringLengths[j]);
+      nameOffset += entry.stringLengths[j];
+    }
+  }
+  vector<Group> groups(groupTable.size());
+  for(size_t i = 0; i < groupTable.size(); i++) {
+    const CacheGroup& entry = groupTable[i];
+    if(entry.nameLength > file.getSize() - nameOffset ||
+      entry.objectLength > file.getSize() - nameOffset - entry.nameLength) {
+      return false;
+    }
+    groups[i].name.assign(data + nameOffset, entry.nameLength);
+    nameOffset += entry.nameLength;
+    groups[i].object.assign(data + nameOffset, entry.objectLength);
+    nameOffset += entry.objectLength;
+  }
+
+  mesh->clear();
+  vector<Channel*> channels(table.size());
+  for(size_t i = 0; i < table.size(); i++) {
+    channels[i] = makeChannel(CacheChannelKind(table[i].kind), names[i], mesh,
+      data + table[i].valueOffset, table[i].valueCount);
+    mesh->addChannel(channels[i]);
+  }
+
+  // Every addRealization() stored both directions, replay each pair once
+  map<pair<uint32_t, uint32_t>, int> pendingReverse;
+  for(size_t i = 0; i < realizations.size(); i++) {
+    const pair<uint32_t, uint32_t> entry(realizations[i].channel, realizations[i].realization);
+    const map<pair<uint32_t, uint32_t>, int>::iterator search = pendingReverse.find(entry);
+    if(search != pendingReverse.end() && search->second > 0) {
+      search->second--;
+      continue;
+    }
+    mesh->addRealization(channels[entry.second], channels[entry.first]);
+    pendingReverse[make_pair(entry.second, entry.first)]++;
+  }
+  mesh->getMaterials().swap(materials);
+  mesh->getGroups().swap(groups);
+  return true;
+}
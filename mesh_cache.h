@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+// A binary snapshot of a Mesh: every channel's values as they are in memory
+// plus the realizations, behind a versioned header and a checksum. Loading
+// one maps the file and copies the values out, nothing is parsed.
+//
+// The snapshot is tied to a source file by its size and modification time,
+// pass an empty source filename for a snapshot that stands on its own. It
+// can be tied to more files the mesh was made from (the material libraries
+// of an OBJ file), which must then not change, appear or disappear either.
+// The material and group tables are stored with the channels.
+// Snapshots are native endian and only meant for the machine that wrote
+// them.
+
+// The sidecar loadFromOBJFile uses for an OBJ file
+std::string getMeshCacheFilename(const std::string& sourceFilename);
+
+// Writes the snapshot through a temporary file, so that readers never see
+// half of it. False if the mesh has a channel type the format does not know
+// or the file cannot be written.
+bool saveMeshCache(const std::string& cacheFilename, const Geometry::Mesh& mesh,
+  const std::string& sourceFilename,
+  const std::vector<std::string>& dependencies = std::vector<std::string>());
+
+// Replaces the mesh's channels with the snapshot's. False, with the mesh
+// untouched, if there is no snapshot or if it is stale, from another
+// version or corrupt.
+bool loadMeshCache(const std::string& cacheFilename, Geometry::Mesh* const mesh,
+  const std::string& sourceFilename);
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include "mesh_weld.h"
+#include "thread_pool.h"
+
+using namespace Geometry;
+using namespace std;
+
+// The channel if it is there and holds T's, no RTTI needed
+template<typename T> static const BaseChannel<T>* getChannel(const Mesh& mesh,
+  const string& name) {
+  const Channel* const channel = mesh.getChannelByName(name);
+  if(!channel) {
+    return NULL;
+  }
+  const ElementType& actual = channel->getElementType();
+  const ElementType expected = ElementTraits<T>::getElementType();
+  if(actual.scalarType != expected.scalarType ||
+    actual.componentCount != expected.componentCount ||
+    actual.stride != expected.stride || actual.isSimplex != expected.isSimplex) {
+    return NULL;
+  }
+  return static_cast<const BaseChannel<T>*>(channel);
+}
+
+// Index -1 (and anything else out of range) reads as zeros
+template<typename T> static T getValue(const ChannelReader<T>& channel, const int index,
+  const T& zero) {
+  return index >= 0 && index < channel.getSize() ? channel.getAt(index) : zero;
+}
+
+// The corners of the mesh: corner c is vertex c % 3 of tri c / 3, and it is
+// keyed by its position, texcoord and normal index
+class Corners {
+
+private:
+
+  const Tri* const positionTris;
+  const Tri* const texCoordTris;
+  const Tri* const normalTris;
+
+public:
+
+  Corners(const Tri* const positionTris, const Tri* const texCoordTris,
+    const Tri* const normalTris) :
+    positionTris(positionTris), texCoordTris(texCoordTris), normalTris(normalTris) {
+  }
+
+  int getPosition(const int corner) const {
+    return positionTris[corner / 3].indices[corner % 3];
+  }
+
+  int getTexCoord(const int corner) const {
+    return texCoordTris ? texCoordTris[corner / 3].indices[corner % 3] : -1;
+  }
+
+  int getNormal(const int corner) const {
+    return normalTris ? normalTris[corner / 3].indices[corner % 3] : -1;
+  }
+
+  bool haveSameKey(const int a, const int b) const {
+    return getPosition(a) == getPosition(b) && getTexCoord(a) == getTexCoord(b) &&
+      getNormal(a) == getNormal(b);
+  }
+
+  uint64_t hash(const int corner) const {
+    uint64_t h = uint32_t(getPosition(corner));
+    h = h * 0x9E3779B97F4A7C15ull + uint32_t(getTexCoord(corner));
+    h = h * 0x9E3779B97F4A7C15ull + uint32_t(getNormal(corner));
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 32);
+  }
+};
+
+// Open addressing over corners, filled from many threads at once. A slot
+// holds the lowest corner with its key seen so far, so once every corner
+// is in, each key maps to its first corner whatever the insertion order.
+//
+// Every position gets a run of slots of its own that its keys hash into,
+// so neighbouring positions stay neighbours in the table and meshes whose
+// tris are stored in some spatial order keep their locality.
+class ConcurrentCornerTable {
+
+private:
+
+  const Corners& corners;
+  size_t slotsPerPosition;
+  size_t size;
+  unique_ptr<atomic<int>[]> slots;
+
+  size_t getFirstSlot(const int corner) const {
+    const size_t position = size_t(uint32_t(corners.getPosition(corner)));
+    return (position * slotsPerPosition + corners.hash(corner) % slotsPerPosition) % size;
+  }
+
+public:
+
+  ConcurrentCornerTable(const Corners& corners, const size_t cornerCount,
+    const size_t positionCount) : corners(corners) {
+    // At most two thirds full, even if no two corners are the same
+    const size_t minimumSize = max(cornerCount + cornerCount / 2, size_t(1));
+    slotsPerPosition = max((minimumSize + positionCount - 1) / max(positionCount, size_t(1)),
+      size_t(2));
+    size = max(positionCount, size_t(1)) * slotsPerPosition;
+    slots.reset(new atomic<int>[size]);
+  }
+
+  void clear(const size_t begin, const size_t end) {
+    for(size_t i = begin; i < end; i++) {
+      slots[i].store(-1, memory_order_relaxed);
+    }
+  }
+
+  size_t getSize() const {
+    return size;
+  }
+
+  // Where the corner's key went, whether or not the corner is the first
+  // with that key
+  size_t insert(const int corner) {
+    size_t slot = getFirstSlot(corner);
+    while(true) {
+      int current = slots[slot].load(memory_order_relaxed);
+      if(current < 0) {
+        if(slots[slot].compare_exchange_weak(current, corner, memory_order_relaxed)) {
+          return slot;
+        }
+        // Taken meanwhile, look at it again
+        continue;
+      }
+      if(corners.haveSameKey(current, corner)) {
+        while(corner < current &&
+          !slots[slot].compare_exchange_weak(current, corner, memory_order_relaxed)) {
+        }
+        return slot;
+      }
+      slot = slot + 1 < size ? slot + 1 : 0;
+    }
+  }
+
+  // Only once every insert() is done
+  int getFirst(const size_t slot) const {
+    return slots[slot].load(memory_order_relaxed);
+  }
+};
+
+void weldVertices(const Mesh& mesh, Mesh* const welded, const int threadCount) {
+  // Values in either layout, BaseChannel or SoAChannel
+  const TriChannel* const positionTris = getChannel<Tri>(mesh, "Tri");
+  const ChannelReader<Vec3f> positions(mesh.getChannelByName("Position"));
+  if(!positionTris || !positions.isValid()) {
+    throw runtime_error("Welding needs a Tri and a Position channel");
+  }
+  const int triCount = positionTris->getSize();
+  if(triCount > INT_MAX / 3) {
+    throw runtime_error("Too many tris to weld");
+  }
+
+  // Normals and texcoords only count if they come with a tri for every tri
+  const ChannelReader<Vec3f> normals(mesh.getChannelByName("Normal"));
+  const ChannelReader<Vec2f> texCoords(mesh.getChannelByName("TexCoord"));
+  const TriChannel* normalTris = getChannel<Tri>(mesh, "Normal Tri");
+  if(!normals.isValid() || (normalTris && normalTris->getSize() != triCount)) {
+    normalTris = NULL;
+  }
+  const TriChannel* texCoordTris = getChannel<Tri>(mesh, "TexCoord Tri");
+  if(!texCoords.isValid() || (texCoordTris && texCoordTris->getSize() != triCount)) {
+    texCoordTris = NULL;
+  }
+
+  const int cornerCount = triCount * 3;
+  const Corners corners(positionTris->getData(), texCoordTris ? texCoordTris->getData() : NULL,
+    normalTris ? normalTris->getData() : NULL);
+  ConcurrentCornerTable table(corners, size_t(cornerCount), size_t(positions.getSize()));
+  if(table.getSize() > size_t(INT_MAX)) {
+    throw runtime_error("Too many tris to weld");
+  }
+
+  const int threads = max(threadCount > 0 ? threadCount : int(thread::hardware_concurrency()), 1);
+  const int chunkCount = threads * 4;
+  const auto getChunkBegin = [cornerCount, chunkCount](const int chunk) {
+    return int(int64_t(cornerCount) * chunk / chunkCount);
+  };
+  ThreadPool pool(threads - 1);
+
+  pool.parallelFor(chunkCount, [&table, chunkCount](const int chunk) {
+    const size_t size = table.getSize();
+    table.clear(size * chunk / chunkCount, size * (chunk + 1) / chunkCount);
+  });
+  // Where each corner's key went, then the first corner with that key.
+  // First corners start out as vertices and are counted per chunk to
+  // number them in order.
+  vector<int> firsts(cornerCount);
+  pool.parallelFor(chunkCount, [&table, &firsts, &getChunkBegin](const int chunk) {
+    for(int corner = getChunkBegin(chunk); corner < getChunkBegin(chunk + 1); corner++) {
+      firsts[corner] = int(table.insert(corner));
+    }
+  });
+  vector<int> chunkVertexCounts(chunkCount + 1, 0);
+  pool.parallelFor(chunkCount, [&](const int chunk) {
+    int vertexCount = 0;
+    for(int corner = getChunkBegin(chunk); corner < getChunkBegin(chunk + 1); corner++) {
+      firsts[corner] = table.getFirst(size_t(firsts[corner]));
+      vertexCount += firsts[corner] == corner ? 1 : 0;
+    }
+    chunkVertexCounts[chunk + 1] = vertexCount;
+  });
+  for(int chunk = 0; chunk < chunkCount; chunk++) {
+    chunkVertexCounts[chunk + 1] += chunkVertexCounts[chunk];
+  }
+  const int vertexCount = chunkVertexCounts[chunkCount];
+
+  welded->clear();
+  Vec3fChannel* const weldedPositions = new Vec3fChannel("Position", welded);
+  TriChannel* const weldedTris = new TriChannel("Tri", welded);
+  Vec3fChannel* const weldedNormals = normalTris ? new Vec3fChannel("Normal", welded) : NULL;
+  Vec2fChannel* const weldedTexCoords = texCoordTris ?
+    new Vec2fChannel("TexCoord", welded) : NULL;
+  welded->addChannel(weldedPositions);
+  welded->addChannel(weldedTris);
+  welded->addRealization(weldedPositions, weldedTris);
+  weldedPositions->resize(vertexCount);
+  weldedTris->resize(triCount);
+  if(weldedNormals) {
+    welded->addChannel(weldedNormals);
+    welded->addRealization(weldedNormals, weldedTris);
+    weldedNormals->resize(vertexCount);
+  }
+  if(weldedTexCoords) {
+    welded->addChannel(weldedTexCoords);
+    welded->addRealization(weldedTexCoords, weldedTris);
+    weldedTexCoords->resize(vertexCount);
+  }
+
+  // First corners write their vertex and swap their entry for -1 - vertex
+  pool.parallelFor(chunkCount, [&](const int chunk) {
+    const Vec3f zero3(0.0f, 0.0f, 0.0f);
+    const Vec2f zero2(0.0f, 0.0f);
+    int vertex = chunkVertexCounts[chunk];
+    for(int corner = getChunkBegin(chunk); corner < getChunkBegin(chunk + 1); corner++) {
+      if(firsts[corner] != corner) {
+        continue;
+      }
+      weldedPositions->setAt(vertex, getValue(positions, corners.getPosition(corner), zero3));
+      if(weldedNormals) {
+        weldedNormals->setAt(vertex, getValue(normals, corners.getNormal(corner), zero3));
+      }
+      if(weldedTexCoords) {
+        weldedTexCoords->setAt(vertex, getValue(texCoords, corners.getTexCoord(corner), zero2));
+      }
+      firsts[corner] = -1 - vertex;
+      vertex++;
+    }
+  });
+  pool.parallelFor(chunkCount, [&](const int chunk) {
+    for(int corner = getChunkBegin(chunk); corner < getChunkBegin(chunk + 1); corner++) {
+      const int first = firsts[corner];
+      const int vertex = first < 0 ? -1 - first : -1 - firsts[first];
+      weldedTris->getAt(corner / 3).indices[corner % 3] = vertex;
+    }
+  });
+
+  const IntChannel* const materialIds = getChannel<int>(mesh, "MaterialId");
+  if(materialIds) {
+    IntChannel* const weldedMaterialIds = new IntChannel("MaterialId", welded);
+    weldedMaterialIds->getValues() = materialIds->getValues();
+    FlatChannel* const materialIdTris = new FlatChannel("MaterialId Tri", welded);
+    welded->addChannel(weldedMaterialIds);
+    welded->addChannel(materialIdTris);
+    welded->addRealization(weldedMaterialIds, materialIdTris);
+  }
+  welded->getMaterials() = mesh.getMaterials();
+
+  // The tris keep their order, so do the runs
+  const IntChannel* const groups = getChannel<int>(mesh, "Group");
+  if(groups) {
+    IntChannel* const weldedGroups = new IntChannel("Group", welded);
+    weldedGroups->getValues() = groups->getValues();
+    welded->addChannel(weldedGroups);
+    welded->addRealization(weldedGroups, weldedTris);
+    welded->getGroups() = mesh.getGroups();
+  }
+}
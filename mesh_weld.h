@@ -0,0 +1,15 @@
+#pragma once
+
+#include "mesh.h"
+
+// Gives every distinct (position, texcoord, normal) corner of the tris its
+// own vertex, the single indexed vertex buffer a GPU wants. The welded mesh
+// has one "Tri" channel that realizes "Position" and, if the mesh has them,
+// "Normal" and "TexCoord", all with one value per vertex. "MaterialId" and
+// "Group" are copied as they are, with the material and group tables.
+// Corners without a normal or texcoord get zeros.
+//
+// Vertices are numbered in the order of their first corner, so the result
+// does not depend on the thread count. threadCount 0 uses every core.
+void weldVertices(const Geometry::Mesh& mesh, Geometry::Mesh* const welded,
+  const int threadCount = 0);
@@ -0,0 +1,265 @@
+#pragma once
+
+// A stand-in for MATLAB's mex.h with just what the gateways use, so that
+// they build and run without MATLAB, e.g. from obj_bench:
+//
+//   g++ -I. -Imex_stub ... obj_read.cpp
+//
+// Unlike MATLAB, mexErrMsgIdAndTxt throws a std::runtime_error and nothing
+// is freed behind the caller's back: every array has to go through
+// mxDestroyArray.
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef size_t mwSize;
+typedef size_t mwIndex;
+
+typedef enum {
+	mxUNKNOWN_CLASS,
+	mxCELL_CLASS,
+	mxSTRUCT_CLASS,
+	mxLOGICAL_CLASS,
+	mxCHAR_CLASS,
+	mxVOID_CLASS,
+	mxDOUBLE_CLASS,
+	mxSINGLE_CLASS,
+	mxINT8_CLASS,
+	mxUINT8_CLASS,
+	mxINT16_CLASS,
+	mxUINT16_CLASS,
+	mxINT32_CLASS,
+	mxUINT32_CLASS,
+	mxINT64_CLASS,
+	mxUINT64_CLASS,
+	mxFUNCTION_CLASS
+} mxClassID;
+
+typedef enum {
+	mxREAL,
+	mxCOMPLEX
+} mxComplexity;
+
+struct mxArray {
+	mxClassID classID;
+	mwSize m;
+	mwSize n;
+	void* data;
+	std::string text;
+	// Structs: fields[element * fieldNames.size() + field], cells: fields[element]
+	std::vector<std::string> fieldNames;
+	std::vector<mxArray*> fields;
+};
+
+inline size_t mxGetElementSize(const mxArray* const array) {
+	switch(array->classID) {
+	case mxDOUBLE_CLASS: case mxINT64_CLASS: case mxUINT64_CLASS: return 8;
+	case mxSINGLE_CLASS: case mxINT32_CLASS: case mxUINT32_CLASS: return 4;
+	case mxINT16_CLASS: case mxUINT16_CLASS: case mxCHAR_CLASS: return 2;
+	case mxINT8_CLASS: case mxUINT8_CLASS: case mxLOGICAL_CLASS: return 1;
+	default: return 0;
+	}
+}
+
+inline void mexErrMsgIdAndTxt(const char* const id, const char* const format, ...) {
+	char message[1024];
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+	throw std::runtime_error(std::string(id) + ": " + message);
+}
+
+inline void* mxCalloc(const size_t count, const size_t size) {
+	return calloc(count, size);
+}
+
+inline void* mxMalloc(const size_t size) {
+	return malloc(size);
+}
+
+inline void mxFree(void* const pointer) {
+	free(pointer);
+}
+
+inline mxArray* mxCreateNumericMatrix(const mwSize m, const mwSize n,
+	const mxClassID classID, const mxComplexity) {
+	mxArray* const array = new mxArray();
+	array->classID = classID;
+	array->m = m;
+	array->n = n;
+	array->data = m * n != 0 ? calloc(m * n, mxGetElementSize(array)) : NULL;
+	return array;
+}
+
+inline mxArray* mxCreateDoubleMatrix(const mwSize m, const mwSize n, const mxComplexity complexity) {
+	return mxCreateNumericMatrix(m, n, mxDOUBLE_CLASS, complexity);
+}
+
+inline mxArray* mxCreateDoubleScalar(const double value) {
+	mxArray* const array = mxCreateNumericMatrix(1, 1, mxDOUBLE_CLASS, mxREAL);
+	*static_cast<double*>(array->data) = value;
+	return array;
+}
+
+inline mxArray* mxCreateLogicalScalar(const bool value) {
+	mxArray* const array = mxCreateNumericMatrix(1, 1, mxLOGICAL_CLASS, mxREAL);
+	*static_cast<bool*>(array->data) = value;
+	return array;
+}
+
+inline mxArray* mxCreateString(const char* const text) {
+	mxArray* const array = new mxArray();
+	array->classID = mxCHAR_CLASS;
+	array->m = 1;
+	array->n = strlen(text);
+	array->data = NULL;
+	array->text = text;
+	return array;
+}
+
+inline mxArray* mxCreateStructMatrix(const mwSize m, const mwSize n, const int fieldCount,
+	const char** const fieldNames) {
+	mxArray* const array = new mxArray();
+	array->classID = mxSTRUCT_CLASS;
+	array->m = m;
+	array->n = n;
+	array->data = NULL;
+	array->fieldNames.assign(fieldNames, fieldNames + fieldCount);
+	array->fields.assign(m * n * fieldCount, NULL);
+	return array;
+}
+
+inline mxArray* mxCreateCellMatrix(const mwSize m, const mwSize n) {
+	mxArray* const array = new mxArray();
+	array->classID = mxCELL_CLASS;
+	array->m = m;
+	array->n = n;
+	array->data = NULL;
+	array->fields.assign(m * n, NULL);
+	return array;
+}
+
+inline void mxDestroyArray(mxArray* const array) {
+	if(!array) {
+		return;
+	}
+	for(size_t i = 0; i < array->fields.size(); i++) {
+		mxDestroyArray(array->fields[i]);
+	}
+	free(array->data);
+	delete array;
+}
+
+inline mxClassID mxGetClassID(const mxArray* const array) {
+	return array->classID;
+}
+
+inline bool mxIsChar(const mxArray* const array) {
+	return array->classID == mxCHAR_CLASS;
+}
+
+inline bool mxIsCell(const mxArray* const array) {
+	return array->classID == mxCELL_CLASS;
+}
+
+inline bool mxIsStruct(const mxArray* const array) {
+	return array->classID == mxSTRUCT_CLASS;
+}
+
+inline bool mxIsLogical(const mxArray* const array) {
+	return array->classID == mxLOGICAL_CLASS;
+}
+
+inline bool mxIsNumeric(const mxArray* const array) {
+	return array->classID >= mxDOUBLE_CLASS && array->classID <= mxUINT64_CLASS;
+}
+
+inline mwSize mxGetM(const mxArray* const array) {
+	return array->m;
+}
+
+inline mwSize mxGetN(const mxArray* const array) {
+	return array->n;
+}
+
+inline mwSize mxGetNumberOfElements(const mxArray* const array) {
+	return array->m * array->n;
+}
+
+inline void* mxGetData(const mxArray* const array) {
+	return array->data;
+}
+
+inline double* mxGetPr(const mxArray* const array) {
+	return static_cast<double*>(array->data);
+}
+
+inline double mxGetScalar(const mxArray* const array) {
+	if(!array->data) {
+		return 0;
+	}
+	switch(array->classID) {
+	case mxDOUBLE_CLASS: return *static_cast<const double*>(array->data);
+	case mxSINGLE_CLASS: return *static_cast<const float*>(array->data);
+	case mxINT32_CLASS: return *static_cast<const int*>(array->data);
+	case mxUINT32_CLASS: return *static_cast<const unsigned int*>(array->data);
+	case mxLOGICAL_CLASS: return *static_cast<const bool*>(array->data);
+	default: return 0;
+	}
+}
+
+inline char* mxArrayToString(const mxArray* const array) {
+	if(array->classID != mxCHAR_CLASS) {
+		return NULL;
+	}
+	char* const text = static_cast<char*>(malloc(array->text.size() + 1));
+	memcpy(text, array->text.c_str(), array->text.size() + 1);
+	return text;
+}
+
+inline int mxGetNumberOfFields(const mxArray* const array) {
+	return int(array->fieldNames.size());
+}
+
+inline const char* mxGetFieldNameByNumber(const mxArray* const array, const int field) {
+	return array->fieldNames[field].c_str();
+}
+
+inline int mxGetFieldNumber(const mxArray* const array, const char* const name) {
+	for(size_t i = 0; i < array->fieldNames.size(); i++) {
+		if(array->fieldNames[i] == name) {
+			return int(i);
+		}
+	}
+	return -1;
+}
+
+inline mxArray* mxGetFieldByNumber(const mxArray* const array, const mwIndex index, const int field) {
+	return array->fields[index * array->fieldNames.size() + field];
+}
+
+inline mxArray* mxGetField(const mxArray* const array, const mwIndex index, const char* const name) {
+	const int field = mxGetFieldNumber(array, name);
+	return field < 0 ? NULL : mxGetFieldByNumber(array, index, field);
+}
+
+inline void mxSetFieldByNumber(mxArray* const array, const mwIndex index, const int field,
+	mxArray* const value) {
+	array->fields[index * array->fieldNames.size() + field] = value;
+}
+
+inline mxArray* mxGetCell(const mxArray* const array, const mwIndex index) {
+	return array->fields[index];
+}
+
+inline void mxSetCell(mxArray* const array, const mwIndex index, mxArray* const value) {
+	array->fields[index] = value;
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]);
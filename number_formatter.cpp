@@ -0,0 +1,208 @@
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include "number_formatter.h"
+#include "number_scanner.h"
+
+// Every power of ten formatFloat scales by: 9 digits of the smallest float
+// (1e-45) up to 1 digit of the largest (3e38) and what it takes to find the
+// exponent
+static const int minPowerOfTen = -45;
+static const double powersOfTen[] = {
+  1e-45, 1e-44, 1e-43, 1e-42, 1e-41, 1e-40, 1e-39, 1e-38, 1e-37, 1e-36,
+  1e-35, 1e-34, 1e-33, 1e-32, 1e-31, 1e-30, 1e-29, 1e-28, 1e-27, 1e-26,
+  1e-25, 1e-24, 1e-23, 1e-22, 1e-21, 1e-20, 1e-19, 1e-18, 1e-17, 1e-16,
+  1e-15, 1e-14, 1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6,
+  1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4,
+  1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+  1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22, 1e23, 1e24,
+  1e25, 1e26, 1e27, 1e28, 1e29, 1e30, 1e31, 1e32, 1e33, 1e34,
+  1e35, 1e36, 1e37, 1e38, 1e39, 1e40, 1e41, 1e42, 1e43, 1e44,
+  1e45, 1e46, 1e47, 1e48, 1e49, 1e50, 1e51, 1e52, 1e53
+};
+
+static double getPowerOfTen(const int power) {
+  return powersOfTen[power - minPowerOfTen];
+}
+
+// Nine significant digits tell every float apart
+static const int maxFloatDigits = 9;
+
+// The digits of value, most significant first. Returns their count.
+static int writeDigits(uint32_t value, char* const buffer) {
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = char('0' + value % 10);
+    value /= 10;
+  } while(value);
+  for(int i = 0; i < count; i++) {
+    buffer[i] = digits[count - 1 - i];
+  }
+  return count;
+}
+
+// digits * 10^exponent, the digits without trailing zeros
+static char* writeDecimal(const bool negative, const uint32_t digits, const int exponent,
+  char* cursor) {
+  if(negative) {
+    *cursor++ = '-';
+  }
+  char text[10];
+  const int count = writeDigits(digits, text);
+  // Of the first digit
+  const int leading = count - 1 + exponent;
+  if(leading >= -4 && leading < maxFloatDigits) {
+    if(leading < 0) {
+      *cursor++ = '0';
+      *cursor++ = '.';
+      for(int i = -1; i > leading; i--) {
+        *cursor++ = '0';
+      }
+      memcpy(cursor, text, size_t(count));
+      return cursor + count;
+    }
+    const int integerDigits = leading + 1;
+    if(count <= integerDigits) {
+      memcpy(cursor, text, size_t(count));
+      cursor += count;
+      for(int i = count; i < integerDigits; i++) {
+        *cursor++ = '0';
+      }
+      return cursor;
+    }
+    memcpy(cursor, text, size_t(integerDigits));
+    cursor += integerDigits;
+    *cursor++ = '.';
+    memcpy(cursor, text + integerDigits, size_t(count - integerDigits));
+    return cursor + (count - integerDigits);
+  }
+  *cursor++ = text[0];
+  if(count > 1) {
+    *cursor++ = '.';
+    memcpy(cursor, text + 1, size_t(count - 1));
+    cursor += count - 1;
+  }
+  *cursor++ = 'e';
+  if(leading < 0) {
+    *cursor++ = '-';
+  }
+  return cursor + writeDigits(uint32_t(leading < 0 ? -leading : leading), cursor);
+}
+
+// Whether digits * 10^exponent reads back as magnitude, for the integers
+// the scaled bounds of its rounding interval are too close to to call
+static bool roundsTo(const uint32_t digits, const int exponent, const float magnitude) {
+  char text[formattedNumberSize];
+  const char* const end = writeDecimal(false, digits, exponent, text);
+  float value = 0.0f;
+  scanFloat(text, end, value);
+  return value == magnitude;
+}
+
+static double getPowerOfTwo(const int power) {
+  const uint64_t bits = uint64_t(power + 1023) << 52;
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Scales the value and the bounds of the interval that rounds to it to nine
+// digits before the point, where every decimal of up to nine digits is an
+// integer. The shortest one inside is a multiple of the largest power of
+// ten that has a multiple inside, the one nearest the value if there are
+// several.
+char* formatFloat(const float value, char* const buffer) {
+  char* cursor = buffer;
+  if(value != value) {
+    memcpy(cursor, "nan", 3);
+    return cursor + 3;
+  }
+  const bool negative = std::signbit(value);
+  if(negative) {
+    *cursor++ = '-';
+  }
+  if(std::isinf(value)) {
+    memcpy(cursor, "inf", 3);
+    return cursor + 3;
+  }
+  if(value == 0) {
+    *cursor++ = '0';
+    return cursor;
+  }
+
+  // Every float is exactly a double, and so are the bounds of the interval:
+  // half an ulp either way, a quarter below powers of two, whose float
+  // below is closer
+  const float magnitude = negative ? -value : value;
+  uint32_t bits;
+  memcpy(&bits, &magnitude, sizeof(bits));
+  const int biasedExponent = int(bits >> 23);
+  const bool subnormal = biasedExponent == 0;
+  const double ulp = getPowerOfTwo((subnormal ? 1 : biasedExponent) - 150);
+  const double lower = double(magnitude) -
+    ((bits & 0x7fffff) == 0 && biasedExponent > 1 ? ulp / 4 : ulp / 2);
+  const double upper = double(magnitude) + ulp / 2;
+
+  // Of the first digit: log10(2) is about 78913 / 2^18, close enough for
+  // every float exponent
+  int binaryExponent = biasedExponent - 127;
+  if(subnormal) {
+    frexp(double(magnitude), &binaryExponent);
+    binaryExponent--;
+  }
+  int leading = (binaryExponent * 78913) >> 18;
+  if(double(magnitude) >= getPowerOfTen(leading + 1)) {
+    leading++;
+  }
+
+  const int power = maxFloatDigits - 1 - leading;
+  const double scale = getPowerOfTen(power);
+  const double scaled = double(magnitude) * scale;
+  const double low = lower * scale;
+  const double high = upper * scale;
+  // The scaled bounds are off by far less than this. Integers closer to
+  // them than that are written out and scanned to make sure.
+  const double margin = high * 1e-14;
+  // Below 2^32, even with a tenth digit where the next power of ten is
+  // the nearest decimal
+  uint32_t first = uint32_t(low - margin);
+  first += double(first) < low - margin ? 1 : 0;
+  uint32_t last = uint32_t(high + margin);
+  if(double(first) - low < margin && !roundsTo(first, -power, magnitude)) {
+    first++;
+  }
+  if(high - double(last) < margin && !roundsTo(last, -power, magnitude)) {
+    last--;
+  }
+
+  uint32_t step = 1;
+  while(step < 1000000000 && (last / (step * 10)) * (step * 10) >= first) {
+    step *= 10;
+  }
+  // Nine digits always leave an integer inside
+  const uint32_t below = uint32_t(scaled / double(step)) * step;
+  const uint32_t above = below + step;
+  uint32_t digits = below;
+  if(below < first || (above <= last && double(above) - scaled < scaled - double(below))) {
+    digits = above;
+  }
+  int exponent = -power;
+  while(digits % 10 == 0) {
+    digits /= 10;
+    exponent++;
+  }
+  return writeDecimal(false, digits, exponent, cursor);
+}
+
+char* formatInt(const int value, char* const buffer) {
+  char* cursor = buffer;
+  // INT_MIN has no positive counterpart as an int
+  uint32_t magnitude = uint32_t(value);
+  if(value < 0) {
+    *cursor++ = '-';
+    magnitude = 0u - magnitude;
+  }
+  return cursor + writeDigits(magnitude, cursor);
+}
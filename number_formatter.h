@@ -0,0 +1,18 @@
+#pragma once
+
+// Locale independent number formatting for the OBJ writer, the other way
+// round from number_scanner.h. Both functions write to buffer, which needs
+// room for formattedNumberSize characters, and return one past the last
+// character written. Nothing is terminated.
+
+const int formattedNumberSize = 16;
+
+// The shortest decimal that scanFloat (and strtof) reads back as exactly
+// value, the nearest one to it if there are several: "0.1" for 0.1f, not
+// "0.100000001". Written like %g: plainly ("-12.5", "0.000123") for
+// exponents from -4 to 8, else as "1.5e-07" is, but as "1.5e-7". "-0",
+// "inf", "-inf" and "nan" for those, which scanFloat reads back, all but
+// the payload of a nan.
+char* formatFloat(const float value, char* const buffer);
+
+char* formatInt(const int value, char* const buffer);
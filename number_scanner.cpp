@@ -0,0 +1,380 @@
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include "number_scanner.h"
+
+static const double powersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Only this many significant digits are kept when rounding the hard cases,
+// the rest is folded into a sticky digit. A float halfway point never has
+// more than 112 significant digits, so that is exact.
+static const int maxSignificantDigits = 200;
+
+// Just enough of an unsigned big integer to compare a decimal number
+// against a float halfway point, on the stack.
+class BigInt {
+
+private:
+
+  static const int maxLimbs = 48;
+
+  uint32_t limbs[maxLimbs];
+  int count;
+
+public:
+
+  explicit BigInt(uint64_t value = 0) : count(0) {
+    while(value) {
+      limbs[count++] = uint32_t(value);
+      value >>= 32;
+    }
+  }
+
+  void multiplyAdd(const uint32_t factor, const uint32_t addend) {
+    uint64_t carry = addend;
+    for(int i = 0; i < count; i++) {
+      const uint64_t product = uint64_t(limbs[i]) * factor + carry;
+      limbs[i] = uint32_t(product);
+      carry = product >> 32;
+    }
+    if(carry) {
+      assert(count < maxLimbs);
+      limbs[count++] = uint32_t(carry);
+    }
+  }
+
+  void multiplyByPowerOfFive(int power) {
+    // 5^13 is the largest power of five that fits 32 bits
+    while(power >= 13) {
+      multiplyAdd(1220703125u, 0);
+      power -= 13;
+    }
+    uint32_t factor = 1;
+    while(power-- > 0) {
+      factor *= 5;
+    }
+    multiplyAdd(factor, 0);
+  }
+
+  void shiftLeft(const int bits) {
+    if(count == 0) {
+      return;
+    }
+    const int limbShift = bits / 32;
+    const int bitShift = bits % 32;
+    if(bitShift) {
+      uint32_t carry = 0;
+      for(int i = 0; i < count; i++) {
+        const uint32_t limb = limbs[i];
+        limbs[i] = (limb << bitShift) | carry;
+        carry = limb >> (32 - bitShift);
+      }
+      if(carry) {
+        assert(count < maxLimbs);
+        limbs[count++] = carry;
+      }
+    }
+    if(limbShift) {
+      assert(count + limbShift <= maxLimbs);
+      memmove(limbs + limbShift, limbs, sizeof(uint32_t) * count);
+      memset(limbs, 0, sizeof(uint32_t) * limbShift);
+      count += limbShift;
+    }
+  }
+
+  static int compare(const BigInt& a, const BigInt& b) {
+    if(a.count != b.count) {
+      return a.count < b.count ? -1 : 1;
+    }
+    for(int i = a.count - 1; i >= 0; i--) {
+      if(a.limbs[i] != b.limbs[i]) {
+        return a.limbs[i] < b.limbs[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+};
+
+static bool isDigit(const char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool hasOddMantissa(const float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return (bits & 1) != 0;
+}
+
+// The exact value halfway between two neighbouring non-negative floats,
+// where the neighbour of FLT_MAX is 2^128
+static double halfway(const float lower, const float upper) {
+  const double upperValue = std::isinf(upper) ? std::ldexp(1.0, 128) : double(upper);
+  return 0.5 * (double(lower) + upperValue);
+}
+
+// Compares digits * 10^exponent against a double, exactly
+static int compareDecimal(const BigInt& digits, const int exponent, const double value) {
+  int binaryExponent;
+  const double fraction = std::frexp(value, &binaryExponent);
+  BigInt left = digits;
+  BigInt right(uint64_t(std::ldexp(fraction, 53)));
+  binaryExponent -= 53;
+
+  // 10^exponent = 5^exponent * 2^exponent, the fives go to whichever side
+  // keeps them integral, the twos become a shift
+  if(exponent >= 0) {
+    left.multiplyByPowerOfFive(exponent);
+  } else {
+    right.multiplyByPowerOfFive(-exponent);
+  }
+  const int shift = exponent - binaryExponent;
+  if(shift >= 0) {
+    left.shiftLeft(shift);
+  } else {
+    right.shiftLeft(-shift);
+  }
+  return BigInt::compare(left, right);
+}
+
+// Rounds the decimal [digitsBegin, digitsEnd) * 10^explicitExponent (the
+// mantissa text may contain a '.') correctly, starting from a guess that is
+// off by a few ulps at most.
+static float roundSlow(const char* const digitsBegin, const char* const digitsEnd,
+  const int explicitExponent, const float guess) {
+
+  BigInt digits;
+  int exponent = explicitExponent;
+  int significantDigits = 0;
+  bool sticky = false;
+  bool inFraction = false;
+  for(const char* c = digitsBegin; c < digitsEnd; c++) {
+    if(*c == '.') {
+      inFraction = true;
+      continue;
+    }
+    const uint32_t digit = uint32_t(*c - '0');
+    if(inFraction) {
+      exponent--;
+    }
+    if(significantDigits == 0 && digit == 0) {
+      continue;
+    }
+    if(significantDigits < maxSignificantDigits) {
+      digits.multiplyAdd(10, digit);
+      significantDigits++;
+    } else {
+      exponent++;
+      sticky = sticky || digit != 0;
+    }
+  }
+  if(sticky) {
+    digits.multiplyAdd(10, 1);
+    significantDigits++;
+    exponent--;
+  }
+
+  // Far out of range, no need for exact arithmetic
+  if(significantDigits == 0 || significantDigits + exponent <= -46) {
+    return 0.0f;
+  }
+  if(significantDigits - 1 + exponent >= 39) {
+    return HUGE_VALF;
+  }
+
+  float value = guess;
+  while(true) {
+    if(!std::isinf(value)) {
+      const float upper = std::nextafter(value, HUGE_VALF);
+      const int order = compareDecimal(digits, exponent, halfway(value, upper));
+      if(order > 0 || (order == 0 && hasOddMantissa(value))) {
+        value = upper;
+        continue;
+      }
+    }
+    if(value > 0.0f) {
+      const float lower = std::nextafter(value, 0.0f);
+      const int order = compareDecimal(digits, exponent, halfway(lower, value));
+      if(order < 0 || (order == 0 && hasOddMantissa(value))) {
+        value = lower;
+        continue;
+      }
+    }
+    return value;
+  }
+}
+
+// True if the double lies exactly halfway between two floats, which is the
+// only case where rounding it to float can differ from rounding the decimal
+// it came from.
+static bool isFloatHalfway(const double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const int biasedExponent = int(bits >> 52) & 0x7ff;
+  if(biasedExponent >= 1023 - 126 && biasedExponent <= 1023 + 127) {
+    // Normal float range: halfway means the 29 bits a float drops are 100..0
+    return (bits & 0x1fffffff) == 0x10000000;
+  }
+  const float rounded = float(value);
+  if(double(rounded) == value || std::isinf(rounded)) {
+    return false;
+  }
+  const float other = std::nextafter(rounded, value > rounded ? HUGE_VALF : -HUGE_VALF);
+  return !std::isinf(other) && value == 0.5 * (double(rounded) + double(other));
+}
+
+// Case insensitive match of a lower case word
+static bool matchesWord(const char* const begin, const char* const end,
+  const char* const word) {
+  const size_t length = strlen(word);
+  if(size_t(end - begin) < length) {
+    return false;
+  }
+  for(size_t i = 0; i < length; i++) {
+    if((begin[i] | 0x20) != word[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char* scanFloat(const char* const begin, const char* const end, float& value) {
+
+  const char* cursor = begin;
+  bool negative = false;
+  if(cursor < end && (*cursor == '+' || *cursor == '-')) {
+    negative = *cursor == '-';
+    cursor++;
+  }
+
+  if(cursor < end && !isDigit(*cursor) && *cursor != '.') {
+    if(matchesWord(cursor, end, "infinity")) {
+      value = negative ? -HUGE_VALF : HUGE_VALF;
+      return cursor + 8;
+    }
+    if(matchesWord(cursor, end, "inf")) {
+      value = negative ? -HUGE_VALF : HUGE_VALF;
+      return cursor + 3;
+    }
+    if(matchesWord(cursor, end, "nan")) {
+      value = negative ? -NAN : NAN;
+      return cursor + 3;
+    }
+    return begin;
+  }
+
+  // The first 19 significant digits always fit 64 bits
+  const char* const digitsBegin = cursor;
+  uint64_t mantissa = 0;
+  int significantDigits = 0;
+  int droppedDigits = 0;
+  int fractionDigits = 0;
+  bool truncated = false;
+  bool anyDigit = false;
+  bool inFraction = false;
+  while(cursor < end) {
+    if(*cursor == '.' && !inFraction) {
+      inFraction = true;
+      cursor++;
+      continue;
+    }
+    if(!isDigit(*cursor)) {
+      break;
+    }
+    const int digit = *cursor - '0';
+    anyDigit = true;
+    if(inFraction) {
+      fractionDigits++;
+    }
+    if(mantissa == 0 && digit == 0) {
+      // Leading zero
+    } else if(significantDigits < 19) {
+      mantissa = mantissa * 10 + uint64_t(digit);
+      significantDigits++;
+    } else {
+      droppedDigits++;
+      truncated = truncated || digit != 0;
+    }
+    cursor++;
+  }
+  if(!anyDigit) {
+    return begin;
+  }
+  const char* const digitsEnd = cursor;
+
+  // The exponent only counts if it has digits, "1e" is just "1"
+  int explicitExponent = 0;
+  if(cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+    const char* exponentCursor = cursor + 1;
+    bool negativeExponent = false;
+    if(exponentCursor < end && (*exponentCursor == '+' || *exponentCursor == '-')) {
+      negativeExponent = *exponentCursor == '-';
+      exponentCursor++;
+    }
+    if(exponentCursor < end && isDigit(*exponentCursor)) {
+      int exponent = 0;
+      while(exponentCursor < end && isDigit(*exponentCursor)) {
+        if(exponent < 100000) {
+          exponent = exponent * 10 + (*exponentCursor - '0');
+        }
+        exponentCursor++;
+      }
+      explicitExponent = negativeExponent ? -exponent : exponent;
+      cursor = exponentCursor;
+    }
+  }
+
+  if(mantissa == 0) {
+    value = negative ? -0.0f : 0.0f;
+    return cursor;
+  }
+
+  // Exact mantissa and power of ten give a correctly rounded double, which
+  // rounds to the correct float unless it sits exactly between two floats
+  const int exponent = explicitExponent - fractionDigits + droppedDigits;
+  if(!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+    const double scaled = exponent < 0 ?
+      double(mantissa) / powersOfTen[-exponent] :
+      double(mantissa) * powersOfTen[exponent];
+    if(!isFloatHalfway(scaled)) {
+      value = float(negative ? -scaled : scaled);
+      return cursor;
+    }
+  }
+
+  const double approximation = double(mantissa) * std::pow(10.0, double(exponent));
+  const float magnitude = roundSlow(digitsBegin, digitsEnd, explicitExponent,
+    float(approximation));
+  value = negative ? -magnitude : magnitude;
+  return cursor;
+}
+
+const char* scanInt(const char* const begin, const char* const end, int& value) {
+
+  const char* cursor = begin;
+  bool negative = false;
+  if(cursor < end && (*cursor == '+' || *cursor == '-')) {
+    negative = *cursor == '-';
+    cursor++;
+  }
+
+  const char* const digitsBegin = cursor;
+  long long magnitude = 0;
+  while(cursor < end && isDigit(*cursor)) {
+    if(magnitude <= INT_MAX) {
+      magnitude = magnitude * 10 + (*cursor - '0');
+    }
+    cursor++;
+  }
+  if(cursor == digitsBegin) {
+    return begin;
+  }
+
+  const long long signedValue = negative ? -magnitude : magnitude;
+  value = signedValue < INT_MIN ? INT_MIN : signedValue > INT_MAX ? INT_MAX : int(signedValue);
+  return cursor;
+}
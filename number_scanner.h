@@ -0,0 +1,14 @@
+#pragma once
+
+// Locale independent number scanning for the OBJ parser. Nothing here
+// allocates or needs a terminated string: both functions read from
+// [begin, end) and return one past the last character of the number, or
+// begin if there is no number there.
+
+// Correctly rounded, so it gives the same float as strtof in the "C" locale
+// for every decimal input (e.g. "1.3031957e-001"). "inf" and "nan" are
+// accepted as well, hexadecimal floats are not.
+const char* scanFloat(const char* const begin, const char* const end, float& value);
+
+// Saturates at INT_MIN / INT_MAX instead of overflowing.
+const char* scanInt(const char* const begin, const char* const end, int& value);
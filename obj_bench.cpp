@@ -0,0 +1,2060 @@
+// Standalone benchmarks for the OBJ loader, no MATLAB needed:
+//
+//   g++ -O2 -std=c++11 -pthread -I. -Imex_stub obj_bench.cpp obj_common.cpp obj_index.cpp number_scanner.cpp mesh_cache.cpp channel_convert.cpp mesh_weld.cpp decoding_reader.cpp number_formatter.cpp obj_read.cpp -o obj_bench
+//
+// plus "-DOBJ_HAVE_ZLIB -lz" and "-DOBJ_HAVE_ZSTD -lzstd" for compressed files.
+//
+//   ./obj_bench numbers [file.obj]
+//   ./obj_bench load [--no-presize] file.obj [threads...]
+//   ./obj_bench cache file.obj
+//   ./obj_bench bbox file.obj
+//   ./obj_bench mex [--via-mesh | --native] file.obj
+//   ./obj_bench convert
+//   ./obj_bench weld file.obj [threads...]
+//   ./obj_bench many file.obj [count]
+//   ./obj_bench soa file.obj
+//   ./obj_bench batch file.obj [count [threads...]]
+//   ./obj_bench channels [max count]
+//   ./obj_bench instance file.obj [count]
+//   ./obj_bench groups file.obj [name...]
+//   ./obj_bench index file.obj [first end]
+//   ./obj_bench readahead file.obj
+//   ./obj_bench compressed file.obj
+//   ./obj_bench write file.obj [threads...]
+//   ./obj_bench generate file.obj faces [spec]
+//   ./obj_bench stages file.obj
+//   ./obj_bench suite [directory [max faces]]
+//
+// Peak RSS only grows, so compare it between separate runs.
+//
+// Results go to stdout, one "key value" pair per line.
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "mex.h"
+#include "block_reader.h"
+#include "channel_convert.h"
+#include "mesh_cache.h"
+#include "mesh_weld.h"
+#include "mapped_file.h"
+#include "obj_common.h"
+#include "obj_index.h"
+#include "number_scanner.h"
+#ifdef OBJ_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJ_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+static double secondsSince(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static vector<char> readFile(const string& filename) {
+  ifstream stream(filename.c_str(), ios_base::in | ios_base::binary);
+  if(!stream.is_open()) {
+    throw runtime_error("Cannot open '" + filename + "'");
+  }
+  return vector<char>(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+}
+
+static vector<string> readLines(const string& filename) {
+  ifstream stream(filename.c_str(), ios_base::in | ios_base::binary);
+  if(!stream.is_open()) {
+    throw runtime_error("Cannot open '" + filename + "'");
+  }
+  vector<string> lines;
+  string line;
+  while(getline(stream, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// Lines shaped like bunny.obj's, with a face line for every format
+static vector<string> makeLines(const char* const element, const int count) {
+  vector<string> lines;
+  srand(1);
+  char line[256];
+  for(int i = 0; i < count; i++) {
+    const float a = float(rand()) / RAND_MAX - 0.5f;
+    const float b = float(rand()) / RAND_MAX - 0.5f;
+    const float c = float(rand()) / RAND_MAX - 0.5f;
+    const int i0 = rand() % 1000000 + 1;
+    const int i1 = rand() % 1000000 + 1;
+    const int i2 = rand() % 1000000 + 1;
+    if(!strcmp(element, "vt")) {
+      snprintf(line, sizeof(line), "vt %.7e %.7e", a, b);
+    } else if(!strcmp(element, "f")) {
+      snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d",
+        i0, i1, i2, i1, i2, i0, i2, i0, i1);
+    } else {
+      snprintf(line, sizeof(line), "%s %.7e %.7e %.7e", element, a, b, c);
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// What the loader used to do per line: sscanf the element ID, then the values
+static double sumWithSscanf(const vector<string>& lines) {
+  double sum = 0;
+  for(size_t i = 0; i < lines.size(); i++) {
+    const char* const line = lines[i].c_str();
+    char elementID[256];
+    sscanf(line, "%s", elementID);
+    if(!strcmp(elementID, "f")) {
+      // Tokens as std::string, then atoi
+      const string face(line + 2);
+      string::size_type begin = 0;
+      while(begin < face.size()) {
+        string::size_type end = face.find_first_of(" /", begin);
+        if(end == string::npos) {
+          end = face.size();
+        }
+        sum += atoi(face.substr(begin, end - begin).c_str());
+        begin = end + 1;
+      }
+    } else {
+      float x = 0, y = 0, z = 0;
+      if(!strcmp(elementID, "vt")) {
+        sscanf(line, "vt %f %f", &x, &y);
+      } else {
+        sscanf(line + strlen(elementID), " %f %f %f", &x, &y, &z);
+      }
+      sum += x;
+      sum += y;
+      sum += z;
+    }
+  }
+  return sum;
+}
+
+static double sumWithScanner(const vector<string>& lines) {
+  double sum = 0;
+  for(size_t i = 0; i < lines.size(); i++) {
+    const char* cursor = lines[i].data();
+    const char* const end = cursor + lines[i].size();
+    const bool face = cursor[0] == 'f';
+    while(cursor < end && *cursor != ' ') {
+      cursor++;
+    }
+    while(cursor < end) {
+      cursor++;
+      if(face) {
+        int index = 0;
+        cursor = scanInt(cursor, end, index);
+        sum += index;
+      } else {
+        float value = 0;
+        cursor = scanFloat(cursor, end, value);
+        sum += value;
+      }
+    }
+  }
+  return sum;
+}
+
+// Every float in the file has to come out of scanFloat exactly as strtof
+// reads it
+static int countMismatches(const vector<string>& lines) {
+  int mismatches = 0;
+  for(size_t i = 0; i < lines.size(); i++) {
+    const string& line = lines[i];
+    if(line.size() < 2 || line[0] != 'v') {
+      continue;
+    }
+    const char* cursor = line.c_str() + line.find(' ');
+    const char* const end = line.c_str() + line.size();
+    while(cursor < end) {
+      while(cursor < end && (*cursor == ' ' || *cursor == '\r')) {
+        cursor++;
+      }
+      if(cursor == end) {
+        break;
+      }
+      char* expectedEnd;
+      const float expected = strtof(cursor, &expectedEnd);
+      float value;
+      const char* const next = scanFloat(cursor, end, value);
+      if(next != expectedEnd || memcmp(&value, &expected, sizeof(float)) != 0) {
+        mismatches++;
+      }
+      cursor = expectedEnd > cursor ? expectedEnd : end;
+    }
+  }
+  return mismatches;
+}
+
+static void benchmarkNumbers(const string& filename) {
+  if(!filename.empty()) {
+    printf("exactness_file %s\n", filename.c_str());
+    printf("exactness_mismatches %d\n", countMismatches(readLines(filename)));
+  }
+
+  const char* const elements[] = { "v", "vn", "vt", "f" };
+  const int lineCount = 1000000;
+  for(int i = 0; i < 4; i++) {
+    const vector<string> lines = makeLines(elements[i], lineCount);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const double sscanfSum = sumWithSscanf(lines);
+    const double sscanfSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    const double scannerSum = sumWithScanner(lines);
+    const double scannerSeconds = secondsSince(start);
+
+    printf("%s_sscanf_ns_per_line %.1f\n", elements[i], 1e9 * sscanfSeconds / lineCount);
+    printf("%s_scanner_ns_per_line %.1f\n", elements[i], 1e9 * scannerSeconds / lineCount);
+    printf("%s_speedup %.2f\n", elements[i], sscanfSeconds / scannerSeconds);
+    if(sscanfSum != scannerSum) {
+      printf("%s_checksum_mismatch %.17g %.17g\n", elements[i], sscanfSum, scannerSum);
+    }
+  }
+}
+
+static size_t getFileSize(const string& filename) {
+  ifstream stream(filename.c_str(), ios_base::in | ios_base::binary | ios_base::ate);
+  if(!stream.is_open()) {
+    throw runtime_error("Cannot open '" + filename + "'");
+  }
+  return size_t(stream.tellg());
+}
+
+// Peak resident set size of the process so far, 0 where unknown
+static double getPeakRSSMegabytes() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return double(usage.ru_maxrss) / (1 << 20);
+#else
+  return double(usage.ru_maxrss) / (1 << 10);
+#endif
+#endif
+}
+
+// Same channels, and the same tris in every tri channel
+static bool haveSameTris(const Geometry::Mesh& mesh, const Geometry::Mesh& reference) {
+  bool identical = mesh.getChannels().size() == reference.getChannels().size();
+  for(size_t j = 0; identical && j < mesh.getChannels().size(); j++) {
+    const Geometry::Channel* const channel = mesh.getChannels()[j];
+    const Geometry::Channel* const expected = reference.getChannels()[j];
+    identical = channel->getName() == expected->getName() &&
+      channel->getSize() == expected->getSize();
+    const Geometry::TriChannel* const tris = dynamic_cast<const Geometry::TriChannel*>(channel);
+    if(identical && tris) {
+      const Geometry::TriChannel* const expectedTris =
+        dynamic_cast<const Geometry::TriChannel*>(expected);
+      identical = memcmp(tris->getData(), expectedTris->getData(),
+        tris->getMemoryUsage()) == 0;
+    }
+  }
+  return identical;
+}
+
+// Loads the file with each thread count and checks that every load gives
+// the same channels as the first one
+static void benchmarkLoad(const string& filename, const vector<int>& threadCounts,
+  const bool presize) {
+  const double megabytes = double(getFileSize(filename)) / (1 << 20);
+  Geometry::Mesh reference;
+  for(size_t i = 0; i < threadCounts.size(); i++) {
+    OBJLoadOptions options;
+    options.threadCount = threadCounts[i];
+    options.presize = presize;
+    options.useCache = false;
+    Geometry::Mesh mesh;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    loadFromOBJFile(filename, &mesh, options);
+    const double seconds = secondsSince(start);
+    printf("load_threads_%d_seconds %.3f\n", threadCounts[i], seconds);
+    printf("load_threads_%d_mb_per_second %.1f\n", threadCounts[i], megabytes / seconds);
+
+    if(i == 0) {
+      loadFromOBJFile(filename, &reference, options);
+      continue;
+    }
+    printf("load_threads_%d_identical %d\n", threadCounts[i],
+      haveSameTris(mesh, reference) ? 1 : 0);
+  }
+  printf("load_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+}
+
+// Parses the file, writes its binary cache to a scratch file and reads it
+// back
+static void benchmarkCache(const string& filename) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh parsed;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &parsed, options);
+  printf("cache_parse_seconds %.3f\n", secondsSince(start));
+
+  const string cacheFilename = filename + ".bench";
+  start = chrono::steady_clock::now();
+  const bool saved = saveMeshCache(cacheFilename, parsed, filename);
+  printf("cache_save_seconds %.3f\n", secondsSince(start));
+  if(!saved) {
+    throw runtime_error("Cannot write '" + cacheFilename + "'");
+  }
+  printf("cache_megabytes %.1f\n", double(getFileSize(cacheFilename)) / (1 << 20));
+
+  Geometry::Mesh loaded;
+  start = chrono::steady_clock::now();
+  const bool hit = loadMeshCache(cacheFilename, &loaded, filename);
+  printf("cache_load_seconds %.3f\n", secondsSince(start));
+  remove(cacheFilename.c_str());
+  printf("cache_hit %d\n", hit ? 1 : 0);
+  printf("cache_identical %d\n", hit && haveSameTris(loaded, parsed) ? 1 : 0);
+}
+
+// Bounding box and tri count, without keeping anything
+class BoundsVisitor : public OBJVisitor {
+  
+public:
+  
+  Vec3f lower;
+  Vec3f upper;
+  long long triCount;
+  
+  BoundsVisitor() : lower(FLT_MAX, FLT_MAX, FLT_MAX), upper(-FLT_MAX, -FLT_MAX, -FLT_MAX),
+    triCount(0) {
+  }
+  
+  virtual void onVertex(const Vec3f& position) override {
+    lower = Vec3f(min(lower.x, position.x), min(lower.y, position.y), min(lower.z, position.z));
+    upper = Vec3f(max(upper.x, position.x), max(upper.y, position.y), max(upper.z, position.z));
+  }
+  
+  virtual void onFace(const OBJFaceVertex* const /* vertices */, const int vertexCount) override {
+    triCount += max(vertexCount - 2, 0);
+  }
+};
+
+// The bounding box through the visitor first, since peak RSS only grows,
+// then by loading the whole mesh
+static void benchmarkBounds(const string& filename) {
+  BoundsVisitor visitor;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  visitOBJFile(filename, visitor);
+  printf("bbox_visit_seconds %.3f\n", secondsSince(start));
+  printf("bbox_visit_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh mesh;
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &mesh, options);
+  Vec3f lower(FLT_MAX, FLT_MAX, FLT_MAX);
+  Vec3f upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  const Geometry::Vec3fChannel* const positions =
+    dynamic_cast<const Geometry::Vec3fChannel*>(mesh.getChannelByName("Position"));
+  const int positionCount = positions ? positions->getSize() : 0;
+  for(int i = 0; i < positionCount; i++) {
+    const Vec3f& position = positions->getAt(i);
+    lower = Vec3f(min(lower.x, position.x), min(lower.y, position.y), min(lower.z, position.z));
+    upper = Vec3f(max(upper.x, position.x), max(upper.y, position.y), max(upper.z, position.z));
+  }
+  printf("bbox_load_seconds %.3f\n", secondsSince(start));
+  printf("bbox_load_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+
+  const Geometry::Channel* const tris = mesh.getChannelByName("Tri");
+  const bool identical = lower.x == visitor.lower.x && lower.y == visitor.lower.y &&
+    lower.z == visitor.lower.z && upper.x == visitor.upper.x &&
+    upper.y == visitor.upper.y && upper.z == visitor.upper.z &&
+    (tris ? tris->getSize() : 0) == visitor.triCount;
+  printf("bbox_identical %d\n", identical ? 1 : 0);
+}
+
+// What obj_read used to do: load a mesh, then copy every channel into a
+// double matrix
+static mxArray* createDoubleMatrix(const Geometry::Channel* const channel) {
+  const Geometry::IntChannel* const ints = dynamic_cast<const Geometry::IntChannel*>(channel);
+  const Geometry::Vec2fChannel* const vec2fs = dynamic_cast<const Geometry::Vec2fChannel*>(channel);
+  const Geometry::Vec3fChannel* const vec3fs = dynamic_cast<const Geometry::Vec3fChannel*>(channel);
+  const Geometry::TriChannel* const tris = dynamic_cast<const Geometry::TriChannel*>(channel);
+  const int size = channel->getSize();
+  const int dims = ints ? 1 : vec2fs ? 2 : vec3fs || tris ? 3 : 0;
+  mxArray* const matrix = mxCreateDoubleMatrix(dims, size, mxREAL);
+  double* const data = mxGetPr(matrix);
+  for(int i = 0; i < size; i++) {
+    if(ints) {
+      data[i] = ints->getAt(i);
+    } else if(vec2fs) {
+      data[i * 2 + 0] = vec2fs->getAt(i).x;
+      data[i * 2 + 1] = vec2fs->getAt(i).y;
+    } else if(vec3fs) {
+      data[i * 3 + 0] = vec3fs->getAt(i).x;
+      data[i * 3 + 1] = vec3fs->getAt(i).y;
+      data[i * 3 + 2] = vec3fs->getAt(i).z;
+    } else if(tris) {
+      for(int j = 0; j < 3; j++) {
+        data[i * 3 + j] = tris->getAt(i).indices[j];
+      }
+    }
+  }
+  return matrix;
+}
+
+// As a double, whatever the class of the matrix
+static double getElement(const mxArray* const matrix, const size_t index) {
+  switch(mxGetClassID(matrix)) {
+    case mxSINGLE_CLASS:
+      return static_cast<const float*>(mxGetData(matrix))[index];
+    case mxINT32_CLASS:
+      return static_cast<const int*>(mxGetData(matrix))[index];
+    case mxUINT32_CLASS:
+      return static_cast<const unsigned int*>(mxGetData(matrix))[index];
+    default:
+      return mxGetPr(matrix)[index];
+  }
+}
+
+static void printFieldBytes(const string& name, const mxArray* const field) {
+  string key = name;
+  for(size_t i = 0; i < key.size(); i++) {
+    if(key[i] == ' ') {
+      key[i] = '_';
+    }
+  }
+  const size_t elementSize = mxGetClassID(field) == mxDOUBLE_CLASS ? 8 : 4;
+  printf("mex_field_%s_bytes %llu\n", key.c_str(),
+    (unsigned long long)(mxGetNumberOfElements(field) * elementSize));
+}
+
+// Runs the obj_read gateway against the stand-in mex.h, or the old way
+// through a mesh. Run both in separate processes to compare peak RSS.
+// native asks the gateway for single coordinates and 1-based int32 indices.
+static void benchmarkMex(const string& filename, const bool viaMesh, const bool native) {
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<mxArray*> fields;
+  mxArray* result = NULL;
+  if(viaMesh) {
+    OBJLoadOptions options;
+    options.useCache = false;
+    Geometry::Mesh mesh;
+    loadFromOBJFile(filename, &mesh, options);
+    for(size_t i = 0; i < mesh.getChannels().size(); i++) {
+      fields.push_back(createDoubleMatrix(mesh.getChannels()[i]));
+    }
+    printf("mex_seconds %.3f\n", secondsSince(start));
+    printf("mex_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+    for(size_t i = 0; i < fields.size(); i++) {
+      printFieldBytes(mesh.getChannels()[i]->getName(), fields[i]);
+      mxDestroyArray(fields[i]);
+    }
+    return;
+  }
+
+  mxArray* const argument = mxCreateString(filename.c_str());
+  const char* optionNames[] = { "Class", "IndexClass", "OneBased" };
+  mxArray* const options = mxCreateStructMatrix(1, 1, 3, optionNames);
+  mxSetFieldByNumber(options, 0, 0, mxCreateString("single"));
+  mxSetFieldByNumber(options, 0, 1, mxCreateString("int32"));
+  mxSetFieldByNumber(options, 0, 2, mxCreateLogicalScalar(true));
+  const mxArray* arguments[] = { argument, options };
+  mexFunction(1, &result, native ? 2 : 1, arguments);
+  mxDestroyArray(argument);
+  mxDestroyArray(options);
+  printf("mex_seconds %.3f\n", secondsSince(start));
+  printf("mex_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+  for(int i = 0; i < mxGetNumberOfFields(result); i++) {
+    printFieldBytes(mxGetFieldNameByNumber(result, i), mxGetFieldByNumber(result, 0, i));
+  }
+
+  // Every field has to hold what the old gateway would have copied, as
+  // doubles and 0-based
+  OBJLoadOptions loadOptions;
+  loadOptions.useCache = false;
+  Geometry::Mesh mesh;
+  loadFromOBJFile(filename, &mesh, loadOptions);
+  bool identical = mxGetNumberOfFields(result) == int(mesh.getChannels().size());
+  for(int i = 0; identical && i < mxGetNumberOfFields(result); i++) {
+    const mxArray* const field = mxGetFieldByNumber(result, 0, i);
+    const Geometry::Channel* const channel = mesh.getChannels()[i];
+    mxArray* const expected = createDoubleMatrix(channel);
+    const bool indices = channel->getName().find("Tri") != string::npos ||
+      channel->getName() == "MaterialId" || channel->getName() == "Group";
+    const double offset = native && indices ? 1 : 0;
+    identical = channel->getName() == mxGetFieldNameByNumber(result, i) &&
+      mxGetClassID(field) == (!native ? mxDOUBLE_CLASS : indices ? mxINT32_CLASS : mxSINGLE_CLASS) &&
+      mxGetM(field) == mxGetM(expected) && mxGetN(field) == mxGetN(expected);
+    for(size_t j = 0; identical && j < mxGetNumberOfElements(field); j++) {
+      identical = getElement(field, j) - offset == mxGetPr(expected)[j];
+    }
+    mxDestroyArray(expected);
+  }
+  printf("mex_identical %d\n", identical ? 1 : 0);
+  mxDestroyArray(result);
+}
+
+static void convertToDoubles(const float* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target) {
+  convertFloatsToDoubles(source, sourceStride, componentCount, count, target);
+}
+
+static void convertToDoubles(const int* const source, const int sourceStride,
+  const int componentCount, const size_t count, double* const target) {
+  convertIntsToDoubles(source, sourceStride, componentCount, count, 1, target);
+}
+
+// GB/s of every conversion kernel on a channel of a million values, read
+// plus written bytes, repeated for at least half a second like Google
+// Benchmark does. Every kernel has to give the scalar kernel's bits.
+template<typename T, typename Scalar> static void benchmarkConvert(const char* const name,
+  const int componentCount) {
+  const int sourceStride = sizeof(T) / sizeof(Scalar);
+  const size_t count = 1 << 20;
+  vector<T> values(count);
+  Scalar* const source = reinterpret_cast<Scalar*>(&values[0]);
+  srand(1);
+  for(size_t i = 0; i < count * sourceStride; i++) {
+    source[i] = Scalar(rand() % 2000000 - 1000000) / Scalar(7);
+  }
+
+  vector<double> expected(count * componentCount);
+  setConversionKernel(SCALAR_CONVERSION);
+  convertToDoubles(source, sourceStride, componentCount, count, &expected[0]);
+
+  const double bytes = double(count) * (sizeof(T) + componentCount * sizeof(double));
+  const ConversionKernel kernels[] = { SCALAR_CONVERSION, SSE2_CONVERSION, AVX_CONVERSION };
+  for(int i = 0; i < 3; i++) {
+    if(!setConversionKernel(kernels[i])) {
+      continue;
+    }
+    const char* const kernel = getConversionKernelName(kernels[i]);
+    vector<double> target(count * componentCount);
+    int iterations = 0;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double seconds = 0;
+    while(seconds < 0.5) {
+      convertToDoubles(source, sourceStride, componentCount, count, &target[0]);
+      iterations++;
+      seconds = secondsSince(start);
+    }
+    printf("convert_%s_%s_gb_per_second %.2f\n", name, kernel, bytes * iterations / seconds / 1e9);
+    printf("convert_%s_%s_identical %d\n", name, kernel,
+      memcmp(&target[0], &expected[0], target.size() * sizeof(double)) == 0 ? 1 : 0);
+  }
+}
+
+static void benchmarkConvert() {
+  const ConversionKernel fastest = getConversionKernel();
+  printf("convert_kernel %s\n", getConversionKernelName(fastest));
+  benchmarkConvert<Vec2f, float>("vec2f", 2);
+  benchmarkConvert<Vec3f, float>("vec3f", 3);
+  benchmarkConvert<Vec4f, float>("vec4f", 4);
+  benchmarkConvert<int, int>("int", 1);
+  benchmarkConvert<Geometry::Edge, int>("edge", 2);
+  benchmarkConvert<Geometry::Tri, int>("tri", 3);
+  benchmarkConvert<Geometry::Tetra, int>("tetra", 4);
+  setConversionKernel(fastest);
+}
+
+template<typename T> static bool haveSameValues(const T& a, const T& b, const int count) {
+  for(int i = 0; i < count; i++) {
+    if(a[i] != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every corner of every welded tri has to have the attributes it had before
+static bool isWeldedCorrectly(const Geometry::Mesh& mesh, const Geometry::Mesh& welded) {
+  const Geometry::TriChannel* const tris =
+    static_cast<const Geometry::TriChannel*>(mesh.getChannelByName("Tri"));
+  const Geometry::TriChannel* const weldedTris =
+    static_cast<const Geometry::TriChannel*>(welded.getChannelByName("Tri"));
+  const char* const names[] = { "Position", "Normal", "TexCoord" };
+  const char* const triNames[] = { "Tri", "Normal Tri", "TexCoord Tri" };
+  for(int k = 0; k < 3; k++) {
+    const Geometry::Channel* const values = mesh.getChannelByName(names[k]);
+    const Geometry::Channel* const weldedValues = welded.getChannelByName(names[k]);
+    if(!values) {
+      continue;
+    }
+    const Geometry::TriChannel* const valueTris =
+      static_cast<const Geometry::TriChannel*>(mesh.getChannelByName(triNames[k]));
+    const int stride = values->getElementType().stride;
+    const int componentCount = values->getElementType().componentCount;
+    const char* const data = static_cast<const char*>(values->getRawData());
+    const char* const weldedData = static_cast<const char*>(weldedValues->getRawData());
+    for(int i = 0; i < tris->getSize(); i++) {
+      for(int j = 0; j < 3; j++) {
+        const int index = valueTris->getAt(i).indices[j];
+        const float* const expected = reinterpret_cast<const float*>(data + size_t(index) * stride);
+        const float* const actual = reinterpret_cast<const float*>(weldedData +
+          size_t(weldedTris->getAt(i).indices[j]) * stride);
+        if(index >= 0 && index < values->getSize() && !haveSameValues(expected, actual, componentCount)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Welds the mesh with each thread count, checks the first result corner by
+// corner and the others against it
+static void benchmarkWeld(const string& filename, const vector<int>& threadCounts) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh mesh;
+  loadFromOBJFile(filename, &mesh, options);
+  const Geometry::Channel* const tris = mesh.getChannelByName("Tri");
+  const int triCount = tris ? tris->getSize() : 0;
+  printf("weld_tris %d\n", triCount);
+
+  Geometry::Mesh reference;
+  for(size_t i = 0; i < threadCounts.size(); i++) {
+    Geometry::Mesh welded;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    weldVertices(mesh, &welded, threadCounts[i]);
+    const double seconds = secondsSince(start);
+    printf("weld_threads_%d_seconds %.3f\n", threadCounts[i], seconds);
+    printf("weld_threads_%d_tris_per_second %.0f\n", threadCounts[i], triCount / seconds);
+    if(i == 0) {
+      printf("weld_vertices %d\n", welded.getChannelByName("Position")->getSize());
+      printf("weld_correct %d\n", isWeldedCorrectly(mesh, welded) ? 1 : 0);
+      weldVertices(mesh, &reference, threadCounts[i]);
+      continue;
+    }
+    printf("weld_threads_%d_identical %d\n", threadCounts[i],
+      haveSameTris(welded, reference) ? 1 : 0);
+  }
+  printf("weld_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+}
+
+// Loads a small file count times, keeping every mesh as a batch would, then
+// frees them all
+static void benchmarkMany(const string& filename, const int count) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  options.threadCount = 1;
+  vector<unique_ptr<Geometry::Mesh> > meshes(count);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for(int i = 0; i < count; i++) {
+    meshes[i].reset(new Geometry::Mesh());
+    loadFromOBJFile(filename, meshes[i].get(), options);
+  }
+  const double seconds = secondsSince(start);
+  printf("many_meshes %d\n", count);
+  printf("many_load_seconds %.3f\n", seconds);
+  printf("many_loads_per_second %.0f\n", count / seconds);
+  printf("many_mesh_arena_bytes %zu\n", meshes[0]->getArenaBytes());
+  printf("many_peak_rss_mb %.1f\n", getPeakRSSMegabytes());
+  start = chrono::steady_clock::now();
+  meshes.clear();
+  printf("many_free_seconds %.3f\n", secondsSince(start));
+}
+
+static bool haveSameFields(const mxArray* const a, const mwIndex aIndex,
+  const mxArray* const b, const mwIndex bIndex) {
+  for(int i = 0; i < mxGetNumberOfFields(b); i++) {
+    const int field = mxGetFieldNumber(a, mxGetFieldNameByNumber(b, i));
+    const mxArray* const aField = field >= 0 ? mxGetFieldByNumber(a, aIndex, field) : NULL;
+    const mxArray* const bField = mxGetFieldByNumber(b, bIndex, i);
+    if(!aField || mxGetClassID(aField) != mxGetClassID(bField) ||
+      mxGetM(aField) != mxGetM(bField) || mxGetN(aField) != mxGetN(bField) ||
+      memcmp(mxGetData(aField), mxGetData(bField),
+        mxGetNumberOfElements(bField) * mxGetElementSize(bField))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// count copies of one file through loadFromOBJFiles with each thread
+// count, against a loop of loadFromOBJFile. Then obj_read with a cell
+// array of the copies and a missing file, which has to give the fields of
+// obj_read on the single file and an error for the missing one only.
+static void benchmarkBatch(const string& filename, const int count,
+  const vector<int>& threadCounts) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  options.threadCount = 1;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for(int i = 0; i < count; i++) {
+    Geometry::Mesh mesh;
+    loadFromOBJFile(filename, &mesh, options);
+  }
+  const double serialSeconds = secondsSince(start);
+  printf("batch_files %d\n", count);
+  printf("batch_serial_seconds %.3f\n", serialSeconds);
+  printf("batch_serial_files_per_second %.0f\n", count / serialSeconds);
+
+  const vector<string> filenames(count, filename);
+  for(size_t t = 0; t < threadCounts.size(); t++) {
+    vector<unique_ptr<Geometry::Mesh> > meshes(count);
+    vector<Geometry::Mesh*> meshPointers(count);
+    for(int i = 0; i < count; i++) {
+      meshes[i].reset(new Geometry::Mesh());
+      meshPointers[i] = meshes[i].get();
+    }
+    options.threadCount = threadCounts[t];
+    start = chrono::steady_clock::now();
+    const vector<string> errors = loadFromOBJFiles(filenames, meshPointers, options);
+    const double seconds = secondsSince(start);
+    printf("batch_threads_%d_seconds %.3f\n", threadCounts[t], seconds);
+    printf("batch_threads_%d_files_per_second %.0f\n", threadCounts[t], count / seconds);
+    printf("batch_threads_%d_failed %d\n", threadCounts[t],
+      int(count - std::count(errors.begin(), errors.end(), "")));
+  }
+
+  mxArray* const single = mxCreateString(filename.c_str());
+  mxArray* expected = NULL;
+  const mxArray* singleArguments[] = { single };
+  mexFunction(1, &expected, 1, singleArguments);
+  mxArray* const cell = mxCreateCellMatrix(1, count + 1);
+  for(int i = 0; i < count; i++) {
+    mxSetCell(cell, i, mxCreateString(filename.c_str()));
+  }
+  mxSetCell(cell, count, mxCreateString((filename + ".missing").c_str()));
+  mxArray* result = NULL;
+  const mxArray* arguments[] = { cell };
+  start = chrono::steady_clock::now();
+  mexFunction(1, &result, 1, arguments);
+  printf("batch_mex_seconds %.3f\n", secondsSince(start));
+  const int error = mxGetFieldNumber(result, "Error");
+  bool identical = mxGetN(result) == mwSize(count + 1) &&
+    mxGetNumberOfFields(result) == mxGetNumberOfFields(expected) + 1 && error >= 0;
+  for(int i = 0; identical && i < count; i++) {
+    identical = haveSameFields(result, i, expected, 0) &&
+      mxGetNumberOfElements(mxGetFieldByNumber(result, i, error)) == 0;
+  }
+  identical = identical && mxGetNumberOfElements(mxGetFieldByNumber(result, count, error)) > 0 &&
+    !mxGetFieldByNumber(result, count, 0);
+  printf("batch_mex_identical %d\n", identical ? 1 : 0);
+  mxDestroyArray(result);
+  mxDestroyArray(cell);
+  mxDestroyArray(expected);
+  mxDestroyArray(single);
+}
+
+// Microseconds per call of the channel bookkeeping of a mesh with count
+// float channels, each realized on one Tri channel: adding them by name,
+// setRealization, lookups by name and of the realization, and removing
+// every other one. Lookups have to find the right channels throughout.
+static void benchmarkChannels(const int maxCount) {
+  for(int count = 10; count <= maxCount; count *= 10) {
+    vector<string> names(count);
+    for(int i = 0; i < count; i++) {
+      names[i] = "Attribute " + to_string(i);
+    }
+    Geometry::Mesh mesh;
+    Geometry::TriChannel* const tris = new Geometry::TriChannel("Tri", &mesh);
+    mesh.addChannel(tris);
+    vector<Geometry::Channel*> channels(count);
+    for(int i = 0; i < count; i++) {
+      channels[i] = new Geometry::FloatChannel(names[i], &mesh);
+    }
+
+    const double perCall = 1e6 / count;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < count; i++) {
+      mesh.setChannelByName(names[i], channels[i]);
+    }
+    printf("channels_%d_set_us %.3f\n", count, secondsSince(start) * perCall);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < count; i++) {
+      mesh.setRealization(channels[i], tris);
+    }
+    printf("channels_%d_realize_us %.3f\n", count, secondsSince(start) * perCall);
+    bool found = true;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < count; i++) {
+      found = mesh.getChannelByName(names[i]) == channels[i] && found;
+    }
+    printf("channels_%d_lookup_us %.3f\n", count, secondsSince(start) * perCall);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < count; i++) {
+      found = mesh.getRealization(channels[i]) == tris && found;
+    }
+    printf("channels_%d_realization_us %.3f\n", count, secondsSince(start) * perCall);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < count; i += 2) {
+      mesh.removeChannel(channels[i]);
+    }
+    printf("channels_%d_remove_us %.3f\n", count, secondsSince(start) * perCall * 2);
+    for(int i = 0; i < count; i++) {
+      found = (mesh.getChannelByName(names[i]) == (i % 2 ? channels[i] : NULL)) && found;
+    }
+    printf("channels_%d_found %d\n", count, found ? 1 : 0);
+    for(int i = 0; i < count; i += 2) {
+      delete channels[i];
+    }
+  }
+}
+
+// count instances of one mesh, then the mesh and every instance move one
+// vertex each. Only the written Position values may be copied, all but the
+// last instance's, which no other channel shares by then: every instance
+// has to see its own edit and the mesh's old values, and share the rest.
+// Peak RSS is against the RSS after loading, compare it with count times
+// the mesh's channel bytes.
+static void benchmarkInstances(const string& filename, const int count) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh mesh;
+  loadFromOBJFile(filename, &mesh, options);
+  const Geometry::Vec3fChannel* const positions =
+    dynamic_cast<const Geometry::Vec3fChannel*>(mesh.getChannelByName("Position"));
+  if(!positions || positions->getSize() == 0) {
+    throw runtime_error("No positions in " + filename);
+  }
+  const vector<Vec3f> original(positions->getData(), positions->getData() + positions->getSize());
+  size_t channelBytes = 0;
+  for(size_t i = 0; i < mesh.getChannels().size(); i++) {
+    channelBytes += mesh.getChannels()[i]->getMemoryUsage();
+  }
+  printf("instance_mesh_channel_bytes %zu\n", channelBytes);
+  printf("instance_loaded_rss_mb %.1f\n", getPeakRSSMegabytes());
+
+  vector<unique_ptr<Geometry::Mesh> > instances(count);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for(int i = 0; i < count; i++) {
+    instances[i].reset(new Geometry::Mesh());
+    instances[i]->makeInstanceOf(&mesh);
+  }
+  printf("instance_make_us %.3f\n", secondsSince(start) * 1e6 / count);
+  printf("instance_made_rss_mb %.1f\n", getPeakRSSMegabytes());
+
+  Geometry::Vec3fChannel* const meshPositions =
+    static_cast<Geometry::Vec3fChannel*>(mesh.getChannelByName("Position"));
+  meshPositions->setAt(0, Vec3f(-2, -2, -2));
+
+  const int size = positions->getSize();
+  start = chrono::steady_clock::now();
+  for(int i = 0; i < count; i++) {
+    Geometry::Vec3fChannel* const writable = static_cast<Geometry::Vec3fChannel*>(
+      instances[i]->getChannelByName("Position"));
+    writable->setAt(i % size, Vec3f(float(i), -1, -1));
+  }
+  printf("instance_write_us %.3f\n", secondsSince(start) * 1e6 / count);
+  printf("instance_written_rss_mb %.1f\n", getPeakRSSMegabytes());
+  const Geometry::Channel* const meshTris = mesh.getRealization(meshPositions);
+  bool isolated = true;
+  for(int i = 0; isolated && i < count; i++) {
+    const Geometry::Mesh& instance = *instances[i];
+    const Geometry::Vec3fChannel* const values =
+      static_cast<const Geometry::Vec3fChannel*>(instance.getChannelByName("Position"));
+    const Geometry::Channel* const tris = instance.getRealization(values);
+    isolated = values->getOwner() == &instance && values->getData() != meshPositions->getData() &&
+      (i == 0 || values->getRawData() != instances[i - 1]->getChannelByName("Position")->getRawData()) &&
+      tris && meshTris && tris->getName() == meshTris->getName();
+    for(int j = 0; isolated && j < size; j++) {
+      const Vec3f expected = j == i % size ? Vec3f(float(i), -1, -1) : original[j];
+      isolated = !memcmp(&values->getAt(j), &expected, 3 * sizeof(float));
+    }
+    for(size_t j = 0; isolated && j < mesh.getChannels().size(); j++) {
+      const Geometry::Channel* const channel = mesh.getChannels()[j];
+      isolated = channel == meshPositions ||
+        instance.getChannels()[j]->getComponentData(0) == channel->getComponentData(0);
+    }
+  }
+  const Vec3f moved(-2, -2, -2);
+  isolated = isolated && !memcmp(&meshPositions->getAt(0), &moved, 3 * sizeof(float));
+  for(int j = 1; isolated && j < size; j++) {
+    isolated = !memcmp(&meshPositions->getAt(j), &original[j], 3 * sizeof(float));
+  }
+  printf("instance_isolated %d\n", isolated ? 1 : 0);
+  instances.clear();
+}
+
+// Value index of a tri channel's corner, as the value itself, or the
+// fallback if there is no such channel or value
+template<typename T> static T getCornerValue(const Geometry::Mesh& mesh, const string& name,
+  const string& triName, const int tri, const int corner, const T& fallback) {
+  const Geometry::BaseChannel<T>* const values =
+    dynamic_cast<const Geometry::BaseChannel<T>*>(mesh.getChannelByName(name));
+  const Geometry::TriChannel* const tris =
+    dynamic_cast<const Geometry::TriChannel*>(mesh.getChannelByName(triName));
+  if(!values || !tris) {
+    return fallback;
+  }
+  const int index = tris->getAt(tri).indices[corner];
+  return index >= 0 && index < values->getSize() ? values->getAt(index) : fallback;
+}
+
+// The names of the run of every tri
+static vector<Geometry::Group> getTriGroups(const Geometry::Mesh& mesh) {
+  const Geometry::Channel* const tris = mesh.getChannelByName("Tri");
+  const Geometry::IntChannel* const firsts =
+    dynamic_cast<const Geometry::IntChannel*>(mesh.getChannelByName("Group"));
+  vector<Geometry::Group> groups(tris ? tris->getSize() : 0);
+  for(int i = 0; firsts && i < firsts->getSize(); i++) {
+    const int end = i + 1 < firsts->getSize() ? firsts->getAt(i + 1) : int(groups.size());
+    for(int tri = firsts->getAt(i); tri < end; tri++) {
+      groups[tri] = mesh.getGroups()[i];
+    }
+  }
+  return groups;
+}
+
+static string getMaterialName(const Geometry::Mesh& mesh, const int tri) {
+  const Geometry::IntChannel* const ids =
+    dynamic_cast<const Geometry::IntChannel*>(mesh.getChannelByName("MaterialId"));
+  const int id = ids ? ids->getAt(tri) : mesh.getMaterials().empty() ? -1 : 0;
+  return id >= 0 && id < int(mesh.getMaterials().size()) ? mesh.getMaterials()[id].name : "";
+}
+
+// The wanted tris of the full load have to come out of the partial one in
+// the same order, with the same values, names and materials
+static bool haveWantedTris(const Geometry::Mesh& mesh, const Geometry::Mesh& selected,
+  const vector<bool>& wanted, int& selectedCount) {
+  const Vec3f none3(-1e30f, -1e30f, -1e30f);
+  const Vec2f none2(-1e30f, -1e30f);
+  const vector<Geometry::Group> triGroups = getTriGroups(mesh);
+  const vector<Geometry::Group> selectedGroups = getTriGroups(selected);
+  int next = 0;
+  bool identical = true;
+  for(int tri = 0; identical && tri < int(triGroups.size()); tri++) {
+    if(!wanted[tri]) {
+      continue;
+    }
+    identical = next < int(selectedGroups.size()) && selectedGroups[next] == triGroups[tri] &&
+      getMaterialName(selected, next) == getMaterialName(mesh, tri);
+    for(int c = 0; identical && c < 3; c++) {
+      identical =
+        getCornerValue(selected, "Position", "Tri", next, c, none3) ==
+          getCornerValue(mesh, "Position", "Tri", tri, c, none3) &&
+        getCornerValue(selected, "Normal", "Normal Tri", next, c, none3) ==
+          getCornerValue(mesh, "Normal", "Normal Tri", tri, c, none3) &&
+        getCornerValue(selected, "TexCoord", "TexCoord Tri", next, c, none2) ==
+          getCornerValue(mesh, "TexCoord", "TexCoord Tri", tri, c, none2);
+    }
+    next++;
+  }
+  selectedCount = next;
+  return identical && next == int(selectedGroups.size());
+}
+
+// Loads the file, then only the named groups (by default the one in the
+// middle of the file). The selected tris have to come out in the same
+// order with the same values, names and materials as in the full load.
+static void benchmarkGroups(const string& filename, vector<string> names) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  options.threadCount = 1;
+  Geometry::Mesh mesh;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &mesh, options);
+  const double fullSeconds = secondsSince(start);
+  const vector<Geometry::Group> triGroups = getTriGroups(mesh);
+  printf("groups_runs %zu\n", mesh.getGroups().size());
+  printf("groups_full_seconds %.4f\n", fullSeconds);
+  if(names.empty()) {
+    if(triGroups.empty()) {
+      throw runtime_error("No tris in " + filename);
+    }
+    const Geometry::Group& middle = triGroups[triGroups.size() / 2];
+    names.push_back(middle.name.empty() ? middle.object : middle.name);
+  }
+
+  Geometry::Mesh selected;
+  options.groups = names;
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &selected, options);
+  const double selectedSeconds = secondsSince(start);
+  printf("groups_selected_seconds %.4f\n", selectedSeconds);
+  printf("groups_speedup %.1f\n", fullSeconds / selectedSeconds);
+
+  vector<bool> wanted(triGroups.size());
+  for(size_t tri = 0; tri < triGroups.size(); tri++) {
+    const Geometry::Group& group = triGroups[tri];
+    const string padded = " " + group.name + " ";
+    for(size_t i = 0; i < names.size(); i++) {
+      wanted[tri] = wanted[tri] || names[i] == group.name || names[i] == group.object ||
+        padded.find(" " + names[i] + " ") != string::npos;
+    }
+  }
+  int selectedCount;
+  const bool identical = haveWantedTris(mesh, selected, wanted, selectedCount);
+  printf("groups_selected_tris %d\n", selectedCount);
+  printf("groups_identical %d\n", identical ? 1 : 0);
+}
+
+// Asks the OS to drop the file from its page cache, for the next read of it
+// to come from the disk. Only pages nobody has dirtied go.
+static void evictFromPageCache(const string& filename) {
+#if defined(POSIX_FADV_DONTNEED)
+  const int descriptor = open(filename.c_str(), O_RDONLY);
+  if(descriptor >= 0) {
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+    close(descriptor);
+  }
+#endif
+}
+
+// Loads the file cold, then tris [first, end) of it (by default the
+// hundredth in the middle) cold: once building the index, once with it.
+// The partial loads have to match the tris of the full load.
+static void benchmarkIndex(const string& filename, int first, int end) {
+  const string indexFilename = getOBJIndexFilename(filename);
+  remove(indexFilename.c_str());
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh mesh;
+  evictFromPageCache(filename);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &mesh, options);
+  const double fullSeconds = secondsSince(start);
+  const Geometry::Channel* const tris = mesh.getChannelByName("Tri");
+  const int triCount = tris ? tris->getSize() : 0;
+  if(first < 0) {
+    first = triCount / 2 - triCount / 200;
+    end = triCount / 2 + triCount / 200 + 1;
+  } else if(end < 0) {
+    end = triCount;
+  }
+  printf("index_file_megabytes %.1f\n", double(getFileSize(filename)) / (1 << 20));
+  printf("index_cold_full_seconds %.4f\n", fullSeconds);
+
+  Geometry::Mesh selected;
+  options.useCache = true;
+  options.triBegin = first;
+  options.triEnd = end;
+  evictFromPageCache(filename);
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &selected, options);
+  printf("index_cold_build_and_load_seconds %.4f\n", secondsSince(start));
+  printf("index_sidecar_kilobytes %.1f\n", double(getFileSize(indexFilename)) / (1 << 10));
+
+  evictFromPageCache(filename);
+  evictFromPageCache(indexFilename);
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &selected, options);
+  const double partialSeconds = secondsSince(start);
+  printf("index_cold_partial_seconds %.4f\n", partialSeconds);
+  printf("index_cold_speedup %.1f\n", fullSeconds / partialSeconds);
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &selected, options);
+  printf("index_warm_partial_seconds %.4f\n", secondsSince(start));
+
+  vector<bool> wanted(triCount > 0 ? size_t(triCount) : 0);
+  for(int tri = max(first, 0); tri < min(end, triCount); tri++) {
+    wanted[tri] = true;
+  }
+  int selectedCount;
+  const bool identical = haveWantedTris(mesh, selected, wanted, selectedCount);
+  printf("index_selected_tris %d\n", selectedCount);
+  printf("index_identical %d\n", identical ? 1 : 0);
+}
+
+// Loads the file from a cold page cache mapped and through the read-ahead
+// thread (OBJLoadOptions::mapFile = false), next to reading it in large
+// blocks without parsing, about what the device can give, and to a warm
+// load, what parsing alone takes. The read-ahead load cannot beat the
+// slower of the two; the hidden fraction is how much of the shorter one it
+// overlapped with the longer.
+static void benchmarkReadAhead(const string& filename) {
+  const double megabytes = double(getFileSize(filename)) / (1 << 20);
+  printf("readahead_file_mb %.2f\n", megabytes);
+
+  evictFromPageCache(filename);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  {
+    BlockReader reader;
+    if(!reader.open(filename)) {
+      throw runtime_error("Cannot open '" + filename + "'");
+    }
+    size_t size;
+    while(reader.next(size)) {
+    }
+  }
+  const double ioSeconds = secondsSince(start);
+  printf("readahead_io_cold_seconds %.4f\n", ioSeconds);
+  printf("readahead_io_cold_mb_per_second %.1f\n", megabytes / ioSeconds);
+
+  OBJLoadOptions options;
+  options.useCache = false;
+  options.threadCount = 1;
+  Geometry::Mesh mapped;
+  Geometry::Mesh blocks;
+  const char* const names[] = { "mapped", "blocks" };
+  double warmSeconds = 0;
+  double coldSeconds = 0;
+  for(int i = 0; i < 2; i++) {
+    options.mapFile = i == 0;
+    Geometry::Mesh& mesh = i == 0 ? mapped : blocks;
+    evictFromPageCache(filename);
+    start = chrono::steady_clock::now();
+    loadFromOBJFile(filename, &mesh, options);
+    coldSeconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    loadFromOBJFile(filename, &mesh, options);
+    warmSeconds = secondsSince(start);
+    printf("readahead_%s_cold_seconds %.4f\n", names[i], coldSeconds);
+    printf("readahead_%s_cold_mb_per_second %.1f\n", names[i], megabytes / coldSeconds);
+    printf("readahead_%s_warm_seconds %.4f\n", names[i], warmSeconds);
+  }
+  const double hidden = ioSeconds + warmSeconds - coldSeconds;
+  printf("readahead_blocks_hidden_fraction %.2f\n",
+    max(hidden, 0.0) / max(min(ioSeconds, warmSeconds), 1e-9));
+  printf("readahead_identical %d\n", haveSameTris(blocks, mapped) ? 1 : 0);
+}
+
+#ifdef OBJ_HAVE_ZLIB
+static void writeGzip(const string& source, const string& target) {
+  const vector<char> contents = readFile(source);
+  gzFile file = gzopen(target.c_str(), "wb6");
+  if(!file || (!contents.empty() &&
+    gzwrite(file, &contents[0], unsigned(contents.size())) != int(contents.size()))) {
+    throw runtime_error("Cannot write '" + target + "'");
+  }
+  gzclose(file);
+}
+#endif
+
+#ifdef OBJ_HAVE_ZSTD
+// A frame for every frameSize bytes of the source, so that the frames can
+// be decompressed in parallel
+static void writeZstdFrames(const string& source, const string& target, const size_t frameSize) {
+  const vector<char> contents = readFile(source);
+  ofstream stream(target.c_str(), ios_base::out | ios_base::binary);
+  vector<char> frame(ZSTD_compressBound(frameSize));
+  for(size_t begin = 0; begin < contents.size(); begin += frameSize) {
+    const size_t size = ZSTD_compress(&frame[0], frame.size(), &contents[begin],
+      min(frameSize, contents.size() - begin), 3);
+    if(ZSTD_isError(size)) {
+      throw runtime_error(ZSTD_getErrorName(size));
+    }
+    stream.write(&frame[0], streamsize(size));
+  }
+  if(!stream) {
+    throw runtime_error("Cannot write '" + target + "'");
+  }
+}
+#endif
+
+// Compresses the file with every compressor this build has (gzip, and zstd
+// in 4 MB frames), then loads each warm on one thread and on every core.
+// The loads have to give the same tris as loading the file itself.
+static void benchmarkCompressed(const string& filename) {
+  const double megabytes = double(getFileSize(filename)) / (1 << 20);
+  printf("compressed_file_mb %.2f\n", megabytes);
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh reference;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &reference, options);
+  const double plainSeconds = secondsSince(start);
+  printf("compressed_plain_seconds %.4f\n", plainSeconds);
+
+  vector<string> names;
+  vector<string> filenames;
+#ifdef OBJ_HAVE_ZLIB
+  names.push_back("gzip");
+  filenames.push_back(filename + ".bench.gz");
+  writeGzip(filename, filenames.back());
+#endif
+#ifdef OBJ_HAVE_ZSTD
+  names.push_back("zstd");
+  filenames.push_back(filename + ".bench.zst");
+  writeZstdFrames(filename, filenames.back(), size_t(4) << 20);
+#endif
+  if(names.empty()) {
+    printf("compressed_supported 0\n");
+    return;
+  }
+  for(size_t i = 0; i < names.size(); i++) {
+    const char* const name = names[i].c_str();
+    printf("%s_ratio %.2f\n", name, megabytes / (double(getFileSize(filenames[i])) / (1 << 20)));
+    const int threadCounts[] = { 1, 0 };
+    for(int j = 0; j < 2; j++) {
+      options.threadCount = threadCounts[j];
+      Geometry::Mesh mesh;
+      start = chrono::steady_clock::now();
+      loadFromOBJFile(filenames[i], &mesh, options);
+      const double seconds = secondsSince(start);
+      printf("%s_threads_%d_seconds %.4f\n", name, threadCounts[j], seconds);
+      printf("%s_threads_%d_mb_per_second %.1f\n", name, threadCounts[j], megabytes / seconds);
+      printf("%s_threads_%d_identical %d\n", name, threadCounts[j],
+        haveSameTris(mesh, reference) ? 1 : 0);
+    }
+    remove(filenames[i].c_str());
+  }
+}
+
+// Same name, size and bits of every value, padding aside
+static bool haveSameBits(const Geometry::Channel& channel, const Geometry::Channel& reference) {
+  const Geometry::ElementType& type = channel.getElementType();
+  const Geometry::ElementType& referenceType = reference.getElementType();
+  if(channel.getName() != reference.getName() || channel.getSize() != reference.getSize() ||
+    type.scalarType != referenceType.scalarType ||
+    type.componentCount != referenceType.componentCount) {
+    return false;
+  }
+  for(int j = 0; j < type.componentCount && channel.getSize(); j++) {
+    const char* const values = static_cast<const char*>(channel.getComponentData(j));
+    const char* const referenceValues = static_cast<const char*>(reference.getComponentData(j));
+    for(int i = 0; i < channel.getSize(); i++) {
+      if(memcmp(values + size_t(i) * type.stride,
+        referenceValues + size_t(i) * referenceType.stride, 4)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool haveSameMaterial(const Geometry::Material& material,
+  const Geometry::Material& reference) {
+  return material.name == reference.name &&
+    !memcmp(&material.ambient, &reference.ambient, 3 * sizeof(float)) &&
+    !memcmp(&material.diffuse, &reference.diffuse, 3 * sizeof(float)) &&
+    !memcmp(&material.specular, &reference.specular, 3 * sizeof(float)) &&
+    !memcmp(&material.shininess, &reference.shininess, sizeof(float)) &&
+    !memcmp(&material.opacity, &reference.opacity, sizeof(float)) &&
+    material.ambientMap == reference.ambientMap && material.diffuseMap == reference.diffuseMap &&
+    material.specularMap == reference.specularMap &&
+    material.shininessMap == reference.shininessMap &&
+    material.opacityMap == reference.opacityMap && material.bumpMap == reference.bumpMap;
+}
+
+// Every channel and the material and group tables, bit for bit
+static bool haveSameMesh(const Geometry::Mesh& mesh, const Geometry::Mesh& reference) {
+  bool identical = mesh.getChannels().size() == reference.getChannels().size() &&
+    mesh.getMaterials().size() == reference.getMaterials().size() &&
+    mesh.getGroups() == reference.getGroups();
+  for(size_t i = 0; identical && i < mesh.getChannels().size(); i++) {
+    identical = haveSameBits(*mesh.getChannels()[i], *reference.getChannels()[i]);
+  }
+  for(size_t i = 0; identical && i < mesh.getMaterials().size(); i++) {
+    identical = haveSameMaterial(mesh.getMaterials()[i], reference.getMaterials()[i]);
+  }
+  return identical;
+}
+
+// What a writer without saveToOBJFile does: fprintf a line at a time, with
+// the nine digits every float needs at most
+static void writeWithFprintf(const Geometry::Mesh& mesh, const string& filename) {
+  FILE* const file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    throw runtime_error("Cannot write '" + filename + "'");
+  }
+  const Geometry::ChannelReader<Vec3f> positions(mesh.getChannelByName("Position"));
+  const Geometry::ChannelReader<Vec2f> texCoords(mesh.getChannelByName("TexCoord"));
+  const Geometry::ChannelReader<Vec3f> normals(mesh.getChannelByName("Normal"));
+  const Geometry::ChannelReader<Geometry::Tri> tris(mesh.getChannelByName("Tri"));
+  const Geometry::ChannelReader<Geometry::Tri> texCoordTris(
+    mesh.getChannelByName("TexCoord Tri"));
+  const Geometry::ChannelReader<Geometry::Tri> normalTris(mesh.getChannelByName("Normal Tri"));
+  for(int i = 0; i < positions.getSize(); i++) {
+    const Vec3f position = positions.getAt(i);
+    fprintf(file, "v %.9g %.9g %.9g\n", position.x, position.y, position.z);
+  }
+  for(int i = 0; i < texCoords.getSize(); i++) {
+    const Vec2f texCoord = texCoords.getAt(i);
+    fprintf(file, "vt %.9g %.9g\n", texCoord.x, texCoord.y);
+  }
+  for(int i = 0; i < normals.getSize(); i++) {
+    const Vec3f normal = normals.getAt(i);
+    fprintf(file, "vn %.9g %.9g %.9g\n", normal.x, normal.y, normal.z);
+  }
+  const bool hasTexCoords = texCoords.getSize() && texCoordTris.getSize() == tris.getSize();
+  const bool hasNormals = normals.getSize() && normalTris.getSize() == tris.getSize();
+  for(int i = 0; i < tris.getSize(); i++) {
+    const Geometry::Tri tri = tris.getAt(i);
+    const Geometry::Tri texCoordTri = hasTexCoords ? texCoordTris.getAt(i) : Geometry::Tri();
+    const Geometry::Tri normalTri = hasNormals ? normalTris.getAt(i) : Geometry::Tri();
+    fputc('f', file);
+    for(int j = 0; j < 3; j++) {
+      if(hasTexCoords && hasNormals) {
+        fprintf(file, " %d/%d/%d", tri[j] + 1, texCoordTri[j] + 1, normalTri[j] + 1);
+      } else if(hasTexCoords) {
+        fprintf(file, " %d/%d", tri[j] + 1, texCoordTri[j] + 1);
+      } else if(hasNormals) {
+        fprintf(file, " %d//%d", tri[j] + 1, normalTri[j] + 1);
+      } else {
+        fprintf(file, " %d", tri[j] + 1);
+      }
+    }
+    fputc('\n', file);
+  }
+  fclose(file);
+}
+
+// Writes the loaded mesh with fprintf, then with saveToOBJFile on each
+// thread count, and loads every file saveToOBJFile wrote back. Its text
+// must not depend on the thread count.
+static void benchmarkWrite(const string& filename, const vector<int>& threadCounts) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh mesh;
+  loadFromOBJFile(filename, &mesh, options);
+  const string target = filename + ".bench.obj";
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  writeWithFprintf(mesh, target);
+  const double fprintfSeconds = secondsSince(start);
+  printf("write_fprintf_seconds %.4f\n", fprintfSeconds);
+  printf("write_fprintf_mb_per_second %.1f\n",
+    double(getFileSize(target)) / (1 << 20) / fprintfSeconds);
+
+  vector<char> firstText;
+  for(size_t i = 0; i < threadCounts.size(); i++) {
+    OBJSaveOptions saveOptions;
+    saveOptions.threadCount = threadCounts[i];
+    start = chrono::steady_clock::now();
+    saveToOBJFile(target, mesh, saveOptions);
+    const double seconds = secondsSince(start);
+    const double megabytes = double(getFileSize(target)) / (1 << 20);
+    printf("write_threads_%d_seconds %.4f\n", threadCounts[i], seconds);
+    printf("write_threads_%d_mb_per_second %.1f\n", threadCounts[i], megabytes / seconds);
+    printf("write_threads_%d_speedup %.2f\n", threadCounts[i], fprintfSeconds / seconds);
+    const vector<char> text = readFile(target);
+    if(i == 0) {
+      firstText = text;
+      printf("write_mb %.2f\n", megabytes);
+    } else {
+      printf("write_threads_%d_same_text %d\n", threadCounts[i], text == firstText ? 1 : 0);
+    }
+    Geometry::Mesh written;
+    loadFromOBJFile(target, &written, options);
+    printf("write_threads_%d_identical %d\n", threadCounts[i],
+      haveSameMesh(written, mesh) ? 1 : 0);
+  }
+  remove(target.c_str());
+  remove((filename + ".bench.mtl").c_str());
+}
+
+// The three kernels of the soa benchmark, once per layout. The SoA ones
+// run over one array at a time where they can, which the compiler
+// vectorizes; the results must be the same bits.
+struct Bounds {
+  Vec3f lower;
+  Vec3f upper;
+};
+
+static Bounds getBounds(const Geometry::Vec3fChannel& positions) {
+  Bounds bounds = { Vec3f(FLT_MAX, FLT_MAX, FLT_MAX), Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+  const Vec3f* const values = positions.getData();
+  const int count = positions.getSize();
+  for(int i = 0; i < count; i++) {
+    bounds.lower.x = min(bounds.lower.x, values[i].x);
+    bounds.lower.y = min(bounds.lower.y, values[i].y);
+    bounds.lower.z = min(bounds.lower.z, values[i].z);
+    bounds.upper.x = max(bounds.upper.x, values[i].x);
+    bounds.upper.y = max(bounds.upper.y, values[i].y);
+    bounds.upper.z = max(bounds.upper.z, values[i].z);
+  }
+  return bounds;
+}
+
+// Eight lanes, which the compiler turns into vector min/max; one running
+// value would wait on itself every step
+static void getComponentBounds(const float* const values, const int count, float& lower,
+  float& upper) {
+  const int laneCount = 8;
+  float lowers[laneCount];
+  float uppers[laneCount];
+  fill(lowers, lowers + laneCount, FLT_MAX);
+  fill(uppers, uppers + laneCount, -FLT_MAX);
+  int i = 0;
+  for(; i + laneCount <= count; i += laneCount) {
+    for(int lane = 0; lane < laneCount; lane++) {
+      lowers[lane] = min(lowers[lane], values[i + lane]);
+      uppers[lane] = max(uppers[lane], values[i + lane]);
+    }
+  }
+  for(; i < count; i++) {
+    lowers[0] = min(lowers[0], values[i]);
+    uppers[0] = max(uppers[0], values[i]);
+  }
+  lower = *min_element(lowers, lowers + laneCount);
+  upper = *max_element(uppers, uppers + laneCount);
+}
+
+static Bounds getBounds(const Geometry::SoAVec3fChannel& positions) {
+  Bounds bounds;
+  const int count = positions.getSize();
+  getComponentBounds(positions.getComponent(0), count, bounds.lower.x, bounds.upper.x);
+  getComponentBounds(positions.getComponent(1), count, bounds.lower.y, bounds.upper.y);
+  getComponentBounds(positions.getComponent(2), count, bounds.lower.z, bounds.upper.z);
+  return bounds;
+}
+
+// Scales, rotates about z and moves every position
+static const float transformMatrix[3][4] = {
+  { 0.8f, -0.6f, 0.0f, 1.0f },
+  { 0.6f, 0.8f, 0.0f, -2.0f },
+  { 0.0f, 0.0f, 2.0f, 0.5f }
+};
+
+static void transformPositions(const Geometry::Vec3fChannel& positions,
+  Geometry::Vec3fChannel& transformed) {
+  const Vec3f* const values = positions.getData();
+  Vec3f* const results = transformed.getValues().data();
+  const int count = positions.getSize();
+  for(int i = 0; i < count; i++) {
+    const Vec3f value = values[i];
+    results[i].x = transformMatrix[0][0] * value.x + transformMatrix[0][1] * value.y +
+      transformMatrix[0][2] * value.z + transformMatrix[0][3];
+    results[i].y = transformMatrix[1][0] * value.x + transformMatrix[1][1] * value.y +
+      transformMatrix[1][2] * value.z + transformMatrix[1][3];
+    results[i].z = transformMatrix[2][0] * value.x + transformMatrix[2][1] * value.y +
+      transformMatrix[2][2] * value.z + transformMatrix[2][3];
+  }
+}
+
+static void transformPositions(const Geometry::SoAVec3fChannel& positions,
+  Geometry::SoAVec3fChannel& transformed) {
+  const float* const x = positions.getComponent(0);
+  const float* const y = positions.getComponent(1);
+  const float* const z = positions.getComponent(2);
+  const int count = positions.getSize();
+  for(int row = 0; row < 3; row++) {
+    float* const results = transformed.getComponent(row);
+    for(int i = 0; i < count; i++) {
+      results[i] = transformMatrix[row][0] * x[i] + transformMatrix[row][1] * y[i] +
+        transformMatrix[row][2] * z[i] + transformMatrix[row][3];
+    }
+  }
+}
+
+// Area-weighted vertex normals, left unnormalized
+static void computeNormals(const Geometry::Vec3fChannel& positions,
+  const Geometry::TriChannel& tris, Geometry::Vec3fChannel& normals) {
+  const Vec3f* const values = positions.getData();
+  Vec3f* const results = normals.getValues().data();
+  for(int i = 0; i < normals.getSize(); i++) {
+    results[i] = Vec3f(0.0f, 0.0f, 0.0f);
+  }
+  for(int t = 0; t < tris.getSize(); t++) {
+    const Geometry::Tri& tri = tris.getAt(t);
+    const Vec3f a = values[tri.indices[0]];
+    const Vec3f b = values[tri.indices[1]];
+    const Vec3f c = values[tri.indices[2]];
+    const float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    const float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    const float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+    for(int j = 0; j < 3; j++) {
+      results[tri.indices[j]].x += nx;
+      results[tri.indices[j]].y += ny;
+      results[tri.indices[j]].z += nz;
+    }
+  }
+}
+
+static void computeNormals(const Geometry::SoAVec3fChannel& positions,
+  const Geometry::TriChannel& tris, Geometry::SoAVec3fChannel& normals) {
+  const float* const x = positions.getComponent(0);
+  const float* const y = positions.getComponent(1);
+  const float* const z = positions.getComponent(2);
+  float* const resultX = normals.getComponent(0);
+  float* const resultY = normals.getComponent(1);
+  float* const resultZ = normals.getComponent(2);
+  fill(resultX, resultX + normals.getSize(), 0.0f);
+  fill(resultY, resultY + normals.getSize(), 0.0f);
+  fill(resultZ, resultZ + normals.getSize(), 0.0f);
+  for(int t = 0; t < tris.getSize(); t++) {
+    const Geometry::Tri& tri = tris.getAt(t);
+    const int a = tri.indices[0], b = tri.indices[1], c = tri.indices[2];
+    const float ux = x[b] - x[a], uy = y[b] - y[a], uz = z[b] - z[a];
+    const float vx = x[c] - x[a], vy = y[c] - y[a], vz = z[c] - z[a];
+    const float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+    for(int j = 0; j < 3; j++) {
+      resultX[tri.indices[j]] += nx;
+      resultY[tri.indices[j]] += ny;
+      resultZ[tri.indices[j]] += nz;
+    }
+  }
+}
+
+static bool haveSameValues(const Geometry::Channel* const channel,
+  const Geometry::Channel* const reference) {
+  const Geometry::ChannelReader<Vec3f> values(channel);
+  const Geometry::ChannelReader<Vec3f> referenceValues(reference);
+  if(!values.isValid() || !referenceValues.isValid() ||
+    values.getSize() != referenceValues.getSize()) {
+    return false;
+  }
+  for(int i = 0; i < values.getSize(); i++) {
+    const Vec3f value = values.getAt(i);
+    const Vec3f referenceValue = referenceValues.getAt(i);
+    if(memcmp(&value, &referenceValue, 3 * sizeof(float))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool haveSameBounds(const Bounds& bounds, const Bounds& reference) {
+  return !memcmp(&bounds.lower, &reference.lower, 3 * sizeof(float)) &&
+    !memcmp(&bounds.upper, &reference.upper, 3 * sizeof(float));
+}
+
+// The best of a few runs of kernel(), in seconds
+template<typename Kernel> static double timeBest(const Kernel& kernel) {
+  double best = DBL_MAX;
+  for(int run = 0; run < 5; run++) {
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    kernel();
+    best = min(best, secondsSince(start));
+  }
+  return best;
+}
+
+// Loads the file in both layouts and times the kernels above on each
+static void benchmarkLayouts(const string& filename) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  Geometry::Mesh aosMesh;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &aosMesh, options);
+  printf("soa_aos_load_seconds %.3f\n", secondsSince(start));
+  options.structureOfArrays = true;
+  Geometry::Mesh soaMesh;
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &soaMesh, options);
+  printf("soa_soa_load_seconds %.3f\n", secondsSince(start));
+
+  const Geometry::Vec3fChannel* const aosPositions =
+    dynamic_cast<const Geometry::Vec3fChannel*>(aosMesh.getChannelByName("Position"));
+  const Geometry::SoAVec3fChannel* const soaPositions =
+    dynamic_cast<const Geometry::SoAVec3fChannel*>(soaMesh.getChannelByName("Position"));
+  const Geometry::TriChannel* const tris =
+    dynamic_cast<const Geometry::TriChannel*>(aosMesh.getChannelByName("Tri"));
+  if(!aosPositions || !soaPositions || !tris) {
+    throw runtime_error("No positions or tris to benchmark");
+  }
+  const int positionCount = aosPositions->getSize();
+  printf("soa_positions %d\n", positionCount);
+  printf("soa_aos_position_bytes %d\n", aosPositions->getMemoryUsage());
+  printf("soa_soa_position_bytes %d\n", soaPositions->getMemoryUsage());
+  printf("soa_loaded_identical %d\n", haveSameValues(soaPositions, aosPositions) ? 1 : 0);
+
+  Bounds aosBounds;
+  Bounds soaBounds;
+  printf("soa_aos_bbox_seconds %.4f\n",
+    timeBest([&]() { aosBounds = getBounds(*aosPositions); }));
+  printf("soa_soa_bbox_seconds %.4f\n",
+    timeBest([&]() { soaBounds = getBounds(*soaPositions); }));
+  printf("soa_bbox_identical %d\n", haveSameBounds(soaBounds, aosBounds) ? 1 : 0);
+
+  Geometry::Vec3fChannel aosResults("Result", NULL);
+  Geometry::SoAVec3fChannel soaResults("Result", NULL);
+  aosResults.resize(positionCount);
+  soaResults.resize(positionCount);
+  printf("soa_aos_transform_seconds %.4f\n",
+    timeBest([&]() { transformPositions(*aosPositions, aosResults); }));
+  printf("soa_soa_transform_seconds %.4f\n",
+    timeBest([&]() { transformPositions(*soaPositions, soaResults); }));
+  printf("soa_transform_identical %d\n", haveSameValues(&soaResults, &aosResults) ? 1 : 0);
+
+  printf("soa_aos_normals_seconds %.4f\n",
+    timeBest([&]() { computeNormals(*aosPositions, *tris, aosResults); }));
+  printf("soa_soa_normals_seconds %.4f\n",
+    timeBest([&]() { computeNormals(*soaPositions, *tris, soaResults); }));
+  printf("soa_normals_identical %d\n", haveSameValues(&soaResults, &aosResults) ? 1 : 0);
+}
+
+// What a synthetic file looks like, from a comma separated list of
+//   v, vt, vn, vtn or mixed  the corners of the faces: p, p/t, p//n, p/t/n
+//                            or any of them face by face (default v)
+//   tris, quads or ngons     triangles only (default), quads, or a mix of
+//                            triangles, quads and 4- to 8-gons
+//   relative                 negative indices
+//   continued                some face lines split with a backslash
+//   materials                a usemtl line every row of faces
+struct SyntheticSpec {
+  string format;
+  string shapes;
+  bool relative;
+  bool continued;
+  bool materials;
+
+  explicit SyntheticSpec(const string& list) : format("v"), shapes("tris"), relative(false),
+    continued(false), materials(false) {
+    size_t begin = 0;
+    while(begin <= list.size()) {
+      size_t end = list.find(',', begin);
+      if(end == string::npos) {
+        end = list.size();
+      }
+      const string word = list.substr(begin, end - begin);
+      if(word == "v" || word == "vt" || word == "vn" || word == "vtn" || word == "mixed") {
+        format = word;
+      } else if(word == "tris" || word == "quads" || word == "ngons") {
+        shapes = word;
+      } else if(word == "relative") {
+        relative = true;
+      } else if(word == "continued") {
+        continued = true;
+      } else if(word == "materials") {
+        materials = true;
+      } else if(!word.empty()) {
+        throw runtime_error("Unknown synthetic file option '" + word + "'");
+      }
+      begin = end + 1;
+    }
+  }
+};
+
+// xorshift64*, the same sequence on every platform
+class SyntheticRandom {
+
+private:
+
+  uint64_t state;
+
+public:
+
+  explicit SyntheticRandom(const uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ull + 1) {
+  }
+
+  int next(const int count) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return int((state * 0x2545f4914f6cdd1dull) >> 33) % count;
+  }
+};
+
+// Writes a strip of rows of columns x columns vertices, each row followed
+// by the faces between it and the row before, until the file has
+// faceCount faces. Every vertex has a normal and a texcoord of the same
+// index if the format uses them. Returns the number of tris a loader makes
+// of the faces.
+static int64_t writeSyntheticOBJ(const string& filename, const int64_t faceCount,
+  const SyntheticSpec& spec) {
+  FILE* const file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    throw runtime_error("Cannot write '" + filename + "'");
+  }
+  const int columns = 256;
+  const bool anyTexCoords = spec.format == "vt" || spec.format == "vtn" || spec.format == "mixed";
+  const bool anyNormals = spec.format == "vn" || spec.format == "vtn" || spec.format == "mixed";
+  SyntheticRandom random(1);
+  string buffer;
+  char text[128];
+  int64_t faces = 0;
+  int64_t tris = 0;
+  int64_t vertexCount = 0;
+  vector<int64_t> corners;
+  const auto flush = [&](const bool force) {
+    if(force || buffer.size() > (1 << 20)) {
+      if(fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        fclose(file);
+        throw runtime_error("Cannot write '" + filename + "'");
+      }
+      buffer.clear();
+    }
+  };
+  const auto writeFace = [&]() {
+    static const char* const formats[] = { "v", "vt", "vn", "vtn" };
+    const string format = spec.format == "mixed" ? formats[random.next(4)] : spec.format;
+    const bool split = spec.continued && random.next(16) == 0;
+    buffer += "f";
+    for(size_t i = 0; i < corners.size(); i++) {
+      if(split && i == corners.size() - 1) {
+        buffer += " \\\n";
+      }
+      const int64_t index = spec.relative ? corners[i] - vertexCount - 1 : corners[i];
+      const long long value = (long long)index;
+      if(format == "v") {
+        snprintf(text, sizeof(text), " %lld", value);
+      } else if(format == "vt") {
+        snprintf(text, sizeof(text), " %lld/%lld", value, value);
+      } else if(format == "vn") {
+        snprintf(text, sizeof(text), " %lld//%lld", value, value);
+      } else {
+        snprintf(text, sizeof(text), " %lld/%lld/%lld", value, value, value);
+      }
+      buffer += text;
+    }
+    buffer += "\n";
+    faces++;
+    tris += int64_t(corners.size()) - 2;
+  };
+  for(int row = 0; faces < faceCount; row++) {
+    for(int column = 0; column < columns; column++) {
+      const float x = float(column) * 0.01f;
+      const float y = float(row) * 0.01f;
+      snprintf(text, sizeof(text), "v %.6f %.6f %.6f\n", x, y, 0.1f * sin(x * 7.0f + y * 3.0f));
+      buffer += text;
+      if(anyTexCoords) {
+        snprintf(text, sizeof(text), "vt %.6f %.6f\n", float(column) / columns, float(row % 1024) / 1024);
+        buffer += text;
+      }
+      if(anyNormals) {
+        snprintf(text, sizeof(text), "vn %.6f %.6f %.6f\n", 0.6f, 0.0f, 0.8f);
+        buffer += text;
+      }
+    }
+    vertexCount += columns;
+    if(row == 0) {
+      continue;
+    }
+    if(spec.materials) {
+      snprintf(text, sizeof(text), "usemtl material%d\n", row % 8);
+      buffer += text;
+    }
+    // 1-based indices of the corners of cell column of the row below and this one
+    const int64_t below = vertexCount - 2 * columns + 1;
+    const int64_t above = vertexCount - columns + 1;
+    for(int column = 0; column < columns - 1 && faces < faceCount; ) {
+      const int shape = spec.shapes == "tris" ? 0 : spec.shapes == "quads" ? 1 :
+        random.next(3);
+      const int width = shape == 2 ? min(1 + random.next(3), columns - 1 - column) : 1;
+      if(shape == 0) {
+        corners.assign(1, below + column);
+        corners.push_back(below + column + 1);
+        corners.push_back(above + column + 1);
+        writeFace();
+        corners.assign(1, below + column);
+        corners.push_back(above + column + 1);
+        corners.push_back(above + column);
+        writeFace();
+      } else {
+        corners.clear();
+        for(int i = 0; i <= width; i++) {
+          corners.push_back(below + column + i);
+        }
+        for(int i = width; i >= 0; i--) {
+          corners.push_back(above + column + i);
+        }
+        writeFace();
+      }
+      column += width;
+      flush(false);
+    }
+  }
+  flush(true);
+  if(fclose(file) != 0) {
+    throw runtime_error("Cannot write '" + filename + "'");
+  }
+  return tris;
+}
+
+// Splits every line of the buffer into tokens at blanks and slashes the
+// way the parser does, and converts them to numbers if asked. Returns a
+// sum of the numbers, or the token count, so that none of it can be
+// optimized away.
+template<bool convert> static double scanTokens(const char* cursor, const char* const end) {
+  double sum = 0;
+  while(cursor < end) {
+    const char* lineEnd = static_cast<const char*>(memchr(cursor, '\n', size_t(end - cursor)));
+    if(!lineEnd) {
+      lineEnd = end;
+    }
+    while(cursor < lineEnd && (*cursor == ' ' || *cursor == '\t')) {
+      cursor++;
+    }
+    const bool face = cursor < lineEnd && *cursor == 'f';
+    while(cursor < lineEnd && *cursor != ' ' && *cursor != '\t') {
+      cursor++;
+    }
+    while(cursor < lineEnd) {
+      const char c = *cursor;
+      if(c == ' ' || c == '\t' || c == '/' || c == '\r' || c == '\\') {
+        cursor++;
+        continue;
+      }
+      if(!convert) {
+        while(cursor < lineEnd && *cursor != ' ' && *cursor != '\t' && *cursor != '/' &&
+          *cursor != '\r') {
+          cursor++;
+        }
+        sum++;
+      } else if(face) {
+        int index = 0;
+        const char* const next = scanInt(cursor, lineEnd, index);
+        cursor = next > cursor ? next : cursor + 1;
+        sum += index;
+      } else {
+        float value = 0;
+        const char* const next = scanFloat(cursor, lineEnd, value);
+        cursor = next > cursor ? next : cursor + 1;
+        sum += value;
+      }
+    }
+    cursor = lineEnd + 1;
+  }
+  return sum;
+}
+
+// Times a load of the file stage by stage, all on one thread: reading it
+// from a cold page cache, splitting it into tokens, converting them, and
+// the whole single-threaded load, of which the rest is appending to the
+// channels. Then the load on every core, warm. Keys start with prefix.
+// The counters of one load, as the loader itself measured them. All zero
+// when built with OBJ_PROFILE=0.
+static void printLoadStats(const string& prefix, const OBJLoadStats& stats) {
+  const char* const p = prefix.c_str();
+  printf("%s_open_seconds %.4f\n", p, stats.openSeconds);
+  printf("%s_count_seconds %.4f\n", p, stats.countSeconds);
+  printf("%s_parse_seconds %.4f\n", p, stats.parseSeconds);
+  printf("%s_material_seconds %.4f\n", p, stats.materialSeconds);
+  printf("%s_build_seconds %.4f\n", p, stats.buildSeconds);
+  printf("%s_total_seconds %.4f\n", p, stats.totalSeconds);
+  printf("%s_bytes_read %llu\n", p, (unsigned long long)stats.bytesRead);
+  printf("%s_position_lines %llu\n", p, (unsigned long long)stats.positionLines);
+  printf("%s_normal_lines %llu\n", p, (unsigned long long)stats.normalLines);
+  printf("%s_texcoord_lines %llu\n", p, (unsigned long long)stats.texCoordLines);
+  printf("%s_face_lines %llu\n", p, (unsigned long long)stats.faceLines);
+  printf("%s_other_lines %llu\n", p, (unsigned long long)stats.otherLines);
+  printf("%s_tokens %llu\n", p, (unsigned long long)stats.tokens);
+  printf("%s_allocations %llu\n", p, (unsigned long long)stats.allocations);
+  printf("%s_output_mb %.2f\n", p, double(stats.outputBytes) / (1 << 20));
+}
+
+static void benchmarkStages(const string& filename, const string& prefix) {
+  const double megabytes = double(getFileSize(filename)) / (1 << 20);
+  printf("%s_file_mb %.2f\n", prefix.c_str(), megabytes);
+
+  evictFromPageCache(filename);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  {
+    FILE* const file = fopen(filename.c_str(), "rb");
+    if(!file) {
+      throw runtime_error("Cannot open '" + filename + "'");
+    }
+    vector<char> block(16 << 20);
+    while(fread(block.data(), 1, block.size(), file) == block.size()) {
+    }
+    fclose(file);
+  }
+  const double ioSeconds = secondsSince(start);
+
+  MappedFile mapping;
+  if(!mapping.open(filename)) {
+    throw runtime_error("Cannot map '" + filename + "'");
+  }
+  const char* const begin = mapping.getData();
+  const char* const end = begin + mapping.getSize();
+  start = chrono::steady_clock::now();
+  const double tokenCount = scanTokens<false>(begin, end);
+  const double tokenizeSeconds = secondsSince(start);
+  start = chrono::steady_clock::now();
+  const double sum = scanTokens<true>(begin, end);
+  const double numbersSeconds = secondsSince(start) - tokenizeSeconds;
+  mapping.close();
+
+  OBJLoadOptions options;
+  options.useCache = false;
+  options.threadCount = 1;
+  OBJLoadStats stats;
+  options.stats = &stats;
+  Geometry::Mesh mesh;
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &mesh, options);
+  const double loadSeconds = secondsSince(start);
+  const Geometry::Channel* const tris = mesh.getChannelByName("Tri");
+  const double triCount = tris ? tris->getSize() : 0;
+  mesh.clear();
+  options.stats = NULL;
+  options.threadCount = 0;
+  start = chrono::steady_clock::now();
+  loadFromOBJFile(filename, &mesh, options);
+  const double parallelSeconds = secondsSince(start);
+
+  printf("%s_tris %.0f\n", prefix.c_str(), triCount);
+  printf("%s_tokens %.0f\n", prefix.c_str(), tokenCount);
+  printf("%s_number_sum %.6g\n", prefix.c_str(), sum);
+  printf("%s_io_cold_seconds %.4f\n", prefix.c_str(), ioSeconds);
+  printf("%s_io_cold_mb_per_second %.1f\n", prefix.c_str(), megabytes / ioSeconds);
+  printf("%s_tokenize_seconds %.4f\n", prefix.c_str(), tokenizeSeconds);
+  printf("%s_number_parse_seconds %.4f\n", prefix.c_str(), max(numbersSeconds, 0.0));
+  printf("%s_append_seconds %.4f\n", prefix.c_str(),
+    max(loadSeconds - tokenizeSeconds - max(numbersSeconds, 0.0), 0.0));
+  printf("%s_load_seconds %.4f\n", prefix.c_str(), loadSeconds);
+  printf("%s_load_mb_per_second %.1f\n", prefix.c_str(), megabytes / loadSeconds);
+  printf("%s_load_tris_per_second %.0f\n", prefix.c_str(), triCount / loadSeconds);
+  printf("%s_parallel_load_seconds %.4f\n", prefix.c_str(), parallelSeconds);
+  printf("%s_parallel_load_mb_per_second %.1f\n", prefix.c_str(), megabytes / parallelSeconds);
+  printLoadStats(prefix + "_loader", stats);
+  printf("%s_peak_rss_mb %.1f\n", prefix.c_str(), getPeakRSSMegabytes());
+}
+
+// Generates a file for every size from 10K faces up to maxFaces, times 10,
+// and every spec, in directory, and runs benchmarkStages on each in a
+// process of its own so that peak RSS is the file's. The files are
+// deleted after.
+static void benchmarkSuite(const string& directory, const int64_t maxFaces) {
+  const char* const specs[] = { "v", "vt", "vn", "vtn",
+    "mixed,ngons,relative,continued,materials" };
+  const char* const names[] = { "v", "vt", "vn", "vtn", "mixed" };
+  for(int64_t faces = 10000; faces <= maxFaces; faces *= 10) {
+    for(int i = 0; i < 5; i++) {
+      char prefix[64];
+      snprintf(prefix, sizeof(prefix), "suite_%lldf_%s", (long long)faces, names[i]);
+      const string filename = directory + "/" + prefix + ".obj";
+      const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      const int64_t tris = writeSyntheticOBJ(filename, faces, SyntheticSpec(specs[i]));
+      printf("%s_generate_seconds %.3f\n", prefix, secondsSince(start));
+      printf("%s_expected_tris %lld\n", prefix, (long long)tris);
+      fflush(stdout);
+#ifdef _WIN32
+      benchmarkStages(filename, prefix);
+#else
+      const pid_t child = fork();
+      if(child == 0) {
+        int status = 0;
+        try {
+          benchmarkStages(filename, prefix);
+        } catch(const exception& e) {
+          fprintf(stderr, "%s\n", e.what());
+          status = 1;
+        }
+        fflush(stdout);
+        _exit(status);
+      }
+      int status = 1;
+      if(child < 0 || waitpid(child, &status, 0) != child || status != 0) {
+        remove(filename.c_str());
+        throw runtime_error("Benchmark of '" + filename + "' failed");
+      }
+#endif
+      remove(filename.c_str());
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  try {
+    if(mode == "numbers") {
+      benchmarkNumbers(argc > 2 ? argv[2] : "");
+    } else if(mode == "load" && argc > 2) {
+      const bool presize = strcmp(argv[2], "--no-presize") != 0;
+      const int fileArgument = presize ? 2 : 3;
+      if(fileArgument >= argc) {
+        throw runtime_error("No file to load");
+      }
+      vector<int> threadCounts;
+      for(int i = fileArgument + 1; i < argc; i++) {
+        threadCounts.push_back(atoi(argv[i]));
+      }
+      if(threadCounts.empty()) {
+        threadCounts.push_back(1);
+        threadCounts.push_back(0);
+      }
+      benchmarkLoad(argv[fileArgument], threadCounts, presize);
+    } else if(mode == "cache" && argc > 2) {
+      benchmarkCache(argv[2]);
+    } else if(mode == "bbox" && argc > 2) {
+      benchmarkBounds(argv[2]);
+    } else if(mode == "mex" && argc > 2) {
+      const bool viaMesh = strcmp(argv[2], "--via-mesh") == 0;
+      const bool native = strcmp(argv[2], "--native") == 0;
+      if((viaMesh || native) && argc < 4) {
+        throw runtime_error("No file to load");
+      }
+      benchmarkMex(argv[viaMesh || native ? 3 : 2], viaMesh, native);
+    } else if(mode == "convert") {
+      benchmarkConvert();
+    } else if(mode == "weld" && argc > 2) {
+      vector<int> threadCounts;
+      for(int i = 3; i < argc; i++) {
+        threadCounts.push_back(atoi(argv[i]));
+      }
+      if(threadCounts.empty()) {
+        threadCounts.push_back(1);
+        threadCounts.push_back(0);
+      }
+      benchmarkWeld(argv[2], threadCounts);
+    } else if(mode == "many" && argc > 2) {
+      benchmarkMany(argv[2], argc > 3 ? atoi(argv[3]) : 10000);
+    } else if(mode == "soa" && argc > 2) {
+      benchmarkLayouts(argv[2]);
+    } else if(mode == "instance" && argc > 2) {
+      benchmarkInstances(argv[2], argc > 3 ? atoi(argv[3]) : 1000);
+    } else if(mode == "groups" && argc > 2) {
+      benchmarkGroups(argv[2], vector<string>(argv + 3, argv + argc));
+    } else if(mode == "generate" && argc > 3) {
+      const int64_t tris = writeSyntheticOBJ(argv[2], atoll(argv[3]),
+        SyntheticSpec(argc > 4 ? argv[4] : ""));
+      printf("generate_tris %lld\n", (long long)tris);
+    } else if(mode == "stages" && argc > 2) {
+      benchmarkStages(argv[2], "stages");
+    } else if(mode == "suite") {
+      benchmarkSuite(argc > 2 ? argv[2] : ".", argc > 3 ? atoll(argv[3]) : 1000000);
+    } else if(mode == "index" && argc > 2) {
+      benchmarkIndex(argv[2], argc > 4 ? atoi(argv[3]) : -1, argc > 4 ? atoi(argv[4]) : -1);
+    } else if(mode == "readahead" && argc > 2) {
+      benchmarkReadAhead(argv[2]);
+    } else if(mode == "compressed" && argc > 2) {
+      benchmarkCompressed(argv[2]);
+    } else if(mode == "write" && argc > 2) {
+      vector<int> threadCounts;
+      for(int i = 3; i < argc; i++) {
+        threadCounts.push_back(atoi(argv[i]));
+      }
+      if(threadCounts.empty()) {
+        threadCounts.push_back(1);
+        threadCounts.push_back(0);
+      }
+      benchmarkWrite(argv[2], threadCounts);
+    } else if(mode == "channels") {
+      benchmarkChannels(argc > 2 ? atoi(argv[2]) : 10000);
+    } else if(mode == "batch" && argc > 2) {
+      vector<int> threadCounts;
+      for(int i = 4; i < argc; i++) {
+        threadCounts.push_back(atoi(argv[i]));
+      }
+      if(threadCounts.empty()) {
+        threadCounts.push_back(1);
+        threadCounts.push_back(0);
+      }
+      benchmarkBatch(argv[2], argc > 3 ? atoi(argv[3]) : 1000, threadCounts);
+    } else {
+      fprintf(stderr, "Usage: %s numbers [file.obj]\n"
+        "       %s load [--no-presize] file.obj [threads...]\n"
+        "       %s cache file.obj\n"
+        "       %s bbox file.obj\n"
+        "       %s mex [--via-mesh | --native] file.obj\n"
+        "       %s convert\n"
+        "       %s weld file.obj [threads...]\n"
+        "       %s many file.obj [count]\n"
+        "       %s soa file.obj\n"
+        "       %s batch file.obj [count [threads...]]\n"
+        "       %s channels [max count]\n"
+        "       %s instance file.obj [count]\n"
+        "       %s groups file.obj [name...]\n"
+        "       %s index file.obj [first end]\n"
+        "       %s readahead file.obj\n"
+        "       %s compressed file.obj\n"
+        "       %s write file.obj [threads...]\n"
+        "       %s generate file.obj faces [spec]\n"
+        "       %s stages file.obj\n"
+        "       %s suite [directory [max faces]]\n",
+        argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+        argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+      return 1;
+    }
+  } catch(const exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -1,273 +1,2964 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <future>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "obj_common.h"
+#include "arena.h"
+#include "channel_convert.h"
+#include "decoding_reader.h"
 #include "mesh.h"
-#include "fixed_vector.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "number_formatter.h"
+#include "number_scanner.h"
+#include "obj_index.h"
+#include "sidecar_file.h"
+#include "thread_pool.h"
 
 using namespace Geometry;
 using namespace std;
 
-int mapIndex(const int index, const Channel* const channel) {
+// attributeCount is the number of attributes read so far, which is what
+// negative (relative) indices count back from
+int mapIndex(const int index, const int attributeCount) {
   if(index < 0) {
-    return channel->getSize() + index;
+    return attributeCount + index;
   } else {
-    if(index - 1 > channel->getSize() - 1) {
-      //LOG_WARNING << index << " and " << channel->getSize();
+    if(index - 1 > attributeCount - 1) {
+      //LOG_WARNING << index << " and " << attributeCount;
     }
     return index - 1;
   }
 }
 
-void addTri(const int index0, const int index1, const int index2,
-  TriChannel* const triChannel, const Channel* const attributeChannel){
+// Corners without an index (0) map to -1, so a face without normals or
+// texcoords gets -1 -1 -1, not a tri of the first one
+Tri makeTri(const int index0, const int index1, const int index2,
+  const int attributeCount){
   if(index0 == 0 && index1 == 0 && index2 == 0) {
-    triChannel->add(Tri(0, 0, 0));
+    return Tri(-1, -1, -1);
   } else {
-    const int mappedIndex0 = mapIndex(index0, attributeChannel);
-    const int mappedIndex1 = mapIndex(index1, attributeChannel);
-    const int mappedIndex2 = mapIndex(index2, attributeChannel);
-    triChannel->add(Tri(mappedIndex0, mappedIndex1, mappedIndex2));
+    const int mappedIndex0 = mapIndex(index0, attributeCount);
+    const int mappedIndex1 = mapIndex(index1, attributeCount);
+    const int mappedIndex2 = mapIndex(index2, attributeCount);
+    return Tri(mappedIndex0, mappedIndex1, mappedIndex2);
   }
 }
 
-typedef FixedVector<int, 16> Indices;
+// One corner of a face as written in the file, 1-based or negative, 0 if
+// it is missing
+struct FaceVertex {
+  int position;
+  int texCoord;
+  int normal;
+};
 
-int stringToInt(const string& s){
-	return atoi(s.c_str());
+// Adds the wall time from its construction to stop(), or to its end, to a
+// phase of the stats. Does nothing without stats or OBJ_PROFILE.
+class OBJPhaseTimer {
+  
+private:
+  
+  double* phase;
+  chrono::steady_clock::time_point start;
+  
+public:
+  
+  OBJPhaseTimer(OBJLoadStats* const stats, double OBJLoadStats::* const member) :
+    phase(OBJ_PROFILE && stats ? &(stats->*member) : NULL) {
+    if(phase) {
+      start = chrono::steady_clock::now();
+    }
+  }
+  
+  ~OBJPhaseTimer() {
+    stop();
+  }
+  
+  void stop() {
+    if(phase) {
+      *phase += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      phase = NULL;
+    }
+  }
+};
+
+// The parser hands every element of the file to a handler, in file order:
+//
+//   addPosition(const Vec3f&), addNormal(const Vec3f&),
+//   addTexCoord(const Vec2f&), useMaterial(const string&),
+//   addMaterialLibrary(const string&), setGroup(const string&),
+//   setObject(const string&), beginFace(), addFaceVertex(const FaceVertex&),
+//   endFace(), and countLine(OBJElement, int tokenCount) after every line
+//
+// and asks it for getPositionCount(), getNormalCount() and
+// getTexCoordCount(), which relative indices count back from. The handler
+// is a template parameter, so building a mesh costs no virtual calls.
+
+// Writes a value either at the end of the channel or, if the channel has
+// been sized up front, at its index
+template<typename ChannelType, typename T> static void writeValue(ChannelType* const channel,
+  const bool presized, const int index, const T& value) {
+  if(presized) {
+    if(index >= channel->getSize()) {
+      throw runtime_error("OBJ file changed between counting and parsing");
+    }
+    channel->setAt(index, value);
+  } else {
+    channel->add(value);
+  }
+}
+
+// What count values of the channel take up in an arena, one array per
+// component if it is planar
+static size_t getArenaSize(const Channel* const channel, const int count) {
+  const ElementType& elementType = channel->getElementType();
+  const size_t arrayCount = elementType.isPlanar ? size_t(elementType.componentCount) : 1;
+  return arrayCount * Arena::roundUp(size_t(elementType.stride) * size_t(count));
+}
+
+// Where OBJParseState puts the values of a mesh: channels that are appended
+// to, or written in place once presized. The channels belong to the
+// storage until addChannelsToMesh hands them over, except that a copy
+// (the storage of a chunk of the file) shares them. Positions, normals and
+// texcoords go into BaseChannels or SoAChannels.
+template<typename Vec3Channel, typename Vec2Channel> struct OBJChannelStorage {
+  Vec3Channel* positionChannel;
+  Vec3Channel* normalChannel;
+  Vec2Channel* texCoordChannel;
+  TriChannel* positionTriChannel;
+  TriChannel* normalTriChannel;
+  TriChannel* texCoordTriChannel;
+  IntChannel* materialIdChannel;
+  bool ownsChannels;
+  bool presized;
+  
+  explicit OBJChannelStorage(Mesh* const mesh) {
+    positionChannel = new Vec3Channel("Position", mesh);
+    normalChannel = new Vec3Channel("Normal", mesh);
+    texCoordChannel = new Vec2Channel("TexCoord", mesh);
+    positionTriChannel = new TriChannel("Tri", mesh);
+    normalTriChannel = new TriChannel("Normal Tri", mesh);
+    texCoordTriChannel = new TriChannel("TexCoord Tri", mesh);
+    materialIdChannel = new IntChannel("MaterialId", mesh);
+    ownsChannels = true;
+    presized = false;
+  }
+  
+  OBJChannelStorage(const OBJChannelStorage& fileStorage) {
+    positionChannel = fileStorage.positionChannel;
+    normalChannel = fileStorage.normalChannel;
+    texCoordChannel = fileStorage.texCoordChannel;
+    positionTriChannel = fileStorage.positionTriChannel;
+    normalTriChannel = fileStorage.normalTriChannel;
+    texCoordTriChannel = fileStorage.texCoordTriChannel;
+    materialIdChannel = fileStorage.materialIdChannel;
+    ownsChannels = false;
+    // Chunks only ever write into channels sized for the whole file
+    presized = true;
+  }
+  
+  ~OBJChannelStorage() {
+    if(ownsChannels) {
+      delete positionChannel;
+      delete normalChannel;
+      delete texCoordChannel;
+      delete positionTriChannel;
+      delete normalTriChannel;
+      delete texCoordTriChannel;
+      delete materialIdChannel;
+    }
+  }
+  
+  // Sizes the channels once, for values parsed after that to be written in
+  // place. Those addChannelsToMesh would drop stay empty, the others all go
+  // into one block of the mesh's arena.
+  void presize(const int positionTotal, const int normalTotal,
+    const int texCoordTotal, const int triTotal, const int materialCount) {
+    const int normalTriTotal = normalTotal > 0 ? triTotal : 0;
+    const int texCoordTriTotal = texCoordTotal > 0 ? triTotal : 0;
+    const int materialIdTotal = materialCount > 1 ? triTotal : 0;
+    Arena* const arena = positionChannel->getArena();
+    if(arena) {
+      arena->reserve(getArenaSize(positionChannel, positionTotal) +
+        getArenaSize(normalChannel, normalTotal) +
+        getArenaSize(texCoordChannel, texCoordTotal) +
+        getArenaSize(positionTriChannel, triTotal) +
+        getArenaSize(normalTriChannel, normalTriTotal) +
+        getArenaSize(texCoordTriChannel, texCoordTriTotal) +
+        getArenaSize(materialIdChannel, materialIdTotal));
+    }
+    positionChannel->resize(positionTotal);
+    normalChannel->resize(normalTotal);
+    texCoordChannel->resize(texCoordTotal);
+    positionTriChannel->resize(triTotal);
+    normalTriChannel->resize(normalTriTotal);
+    texCoordTriChannel->resize(texCoordTriTotal);
+    materialIdChannel->resize(materialIdTotal);
+    presized = true;
+  }
+  
+  void setPosition(const int index, const Vec3f& position) {
+    writeValue(positionChannel, presized, index, position);
+  }
+  
+  void setNormal(const int index, const Vec3f& normal) {
+    writeValue(normalChannel, presized, index, normal);
+  }
+  
+  void setTexCoord(const int index, const Vec2f& texCoord) {
+    writeValue(texCoordChannel, presized, index, texCoord);
+  }
+  
+  void setTri(const int index, const Tri& positionTri, const Tri& texCoordTri,
+    const Tri& normalTri, const int materialId) {
+    writeValue(positionTriChannel, presized, index, positionTri);
+    // Channels presize() left empty are dropped by addChannelsToMesh
+    if(!presized || texCoordTriChannel->getSize()) {
+      writeValue(texCoordTriChannel, presized, index, texCoordTri);
+    }
+    if(!presized || normalTriChannel->getSize()) {
+      writeValue(normalTriChannel, presized, index, normalTri);
+    }
+    if(!presized || materialIdChannel->getSize()) {
+      writeValue(materialIdChannel, presized, index, materialId);
+    }
+  }
+};
+
+typedef OBJChannelStorage<Vec3fChannel, Vec2fChannel> OBJMeshStorage;
+typedef OBJChannelStorage<SoAVec3fChannel, SoAVec2fChannel> OBJSoAMeshStorage;
+
+// The memory of one field from an OBJFieldSink, NULL if the file has no
+// such field or the sink did not want it
+struct OBJFieldBuffer {
+  void* data;
+  OBJScalarType type;
+  int componentCount;
+  size_t valueCount;
+  // Added to every index written to the field
+  int indexBase;
+  
+  OBJFieldBuffer() : data(NULL), type(OBJ_DOUBLE), componentCount(0), valueCount(0),
+    indexBase(0) {
+  }
+  
+  template<typename Target, typename Source> static void convert(Target* const target,
+    const Source* const values, const int count) {
+    for(int i = 0; i < count; i++) {
+      target[i] = Target(values[i]);
+    }
+  }
+  
+  // Writes the components of value number index. The type is looked at once
+  // per value, the components are converted in a straight loop.
+  template<typename Source> void set(const int index, const Source* const values) {
+    if(!data) {
+      return;
+    }
+    if(size_t(index) >= valueCount) {
+      throw runtime_error("OBJ file changed between counting and parsing");
+    }
+    const size_t first = size_t(index) * componentCount;
+    switch(type) {
+    case OBJ_DOUBLE:
+      convert(static_cast<double*>(data) + first, values, componentCount);
+      break;
+    case OBJ_SINGLE:
+      convert(static_cast<float*>(data) + first, values, componentCount);
+      break;
+    case OBJ_INT32:
+      convert(static_cast<int32_t*>(data) + first, values, componentCount);
+      break;
+    case OBJ_UINT32:
+      convert(static_cast<uint32_t*>(data) + first, values, componentCount);
+      break;
+    }
+  }
+  
+  void setIndices(const int index, const int* const indices) {
+    int based[4];
+    for(int i = 0; i < componentCount; i++) {
+      based[i] = indices[i] + indexBase;
+    }
+    set(index, based);
+  }
+  
+  // Every value of the channel at once, whatever its type. Doubles go
+  // through the vector kernels.
+  void setAll(const Channel& channel) {
+    if(type == OBJ_DOUBLE && data) {
+      convertChannelToDoubles(channel, indexBase, static_cast<double*>(data));
+      return;
+    }
+    // Values are put together through getComponentData, which every
+    // layout has
+    const ElementType& elementType = channel.getElementType();
+    const char* components[4];
+    for(int c = 0; c < componentCount; c++) {
+      components[c] = static_cast<const char*>(channel.getComponentData(c));
+    }
+    for(size_t i = 0; i < valueCount; i++) {
+      if(elementType.scalarType == FLOAT_SCALAR) {
+        float value[4];
+        for(int c = 0; c < componentCount; c++) {
+          value[c] = *reinterpret_cast<const float*>(components[c] + i * elementType.stride);
+        }
+        set(int(i), value);
+      } else {
+        int value[4];
+        for(int c = 0; c < componentCount; c++) {
+          value[c] = *reinterpret_cast<const int*>(components[c] + i * elementType.stride);
+        }
+        setIndices(int(i), value);
+      }
+    }
+  }
+};
+
+// Where OBJParseState puts the values for an OBJFieldSink. The file has to
+// be counted first, that is when the fields are allocated. Copies share
+// the fields.
+struct OBJFieldStorage {
+  OBJFieldSink* sink;
+  OBJFieldBuffer positionField;
+  OBJFieldBuffer normalField;
+  OBJFieldBuffer texCoordField;
+  OBJFieldBuffer positionTriField;
+  OBJFieldBuffer normalTriField;
+  OBJFieldBuffer texCoordTriField;
+  OBJFieldBuffer materialIdField;
+  // Fields the sink allocated, and their bytes
+  uint64_t allocationCount;
+  uint64_t allocatedBytes;
+  // Whether the file has MaterialId and "MaterialId Tri" fields, which it
+  // may have with no values
+  bool hasMaterialIds;
+  // False once the sink skipped a field with values
+  bool complete;
+  
+  explicit OBJFieldStorage(OBJFieldSink& sink) : sink(&sink), allocationCount(0),
+    allocatedBytes(0), hasMaterialIds(false), complete(true) {
+  }
+  
+  OBJFieldBuffer allocate(const string& name, const OBJScalarType nativeType,
+    const int componentCount, const int valueCount) {
+    OBJFieldBuffer field;
+    field.type = sink->getFieldType(name, nativeType);
+    field.data = sink->allocateField(name, field.type, componentCount, valueCount);
+    field.componentCount = componentCount;
+    field.valueCount = field.data ? size_t(valueCount) : 0;
+    field.indexBase = nativeType == OBJ_INT32 ? sink->getIndexBase(name) : 0;
+    if(field.data) {
+      allocationCount++;
+      allocatedBytes += uint64_t(field.type == OBJ_DOUBLE ? 8 : 4) * field.valueCount *
+        uint64_t(componentCount);
+    } else if(componentCount > 0 && valueCount > 0) {
+      complete = false;
+    }
+    return field;
+  }
+  
+  void addCountsTo(OBJLoadStats* const stats) const {
+    if(OBJ_PROFILE && stats) {
+      stats->allocations += allocationCount;
+      stats->outputBytes += allocatedBytes;
+    }
+  }
+  
+  // The fields a mesh would have as channels, in the same order
+  void presize(const int positionTotal, const int normalTotal,
+    const int texCoordTotal, const int triTotal, const int materialCount) {
+    if(positionTotal) {
+      positionField = allocate("Position", OBJ_SINGLE, 3, positionTotal);
+      positionTriField = allocate("Tri", OBJ_INT32, 3, triTotal);
+    }
+    if(normalTotal) {
+      normalField = allocate("Normal", OBJ_SINGLE, 3, normalTotal);
+      normalTriField = allocate("Normal Tri", OBJ_INT32, 3, triTotal);
+    }
+    if(texCoordTotal) {
+      texCoordField = allocate("TexCoord", OBJ_SINGLE, 2, texCoordTotal);
+      texCoordTriField = allocate("TexCoord Tri", OBJ_INT32, 3, triTotal);
+    }
+    if(materialCount > 1) {
+      materialIdField = allocate("MaterialId", OBJ_INT32, 1, triTotal);
+      allocate("MaterialId Tri", OBJ_INT32, 0, 0);
+      hasMaterialIds = true;
+    }
+  }
+  
+  void setPosition(const int index, const Vec3f& position) {
+    const float values[] = { position.x, position.y, position.z };
+    positionField.set(index, values);
+  }
+  
+  void setNormal(const int index, const Vec3f& normal) {
+    const float values[] = { normal.x, normal.y, normal.z };
+    normalField.set(index, values);
+  }
+  
+  void setTexCoord(const int index, const Vec2f& texCoord) {
+    const float values[] = { texCoord.x, texCoord.y };
+    texCoordField.set(index, values);
+  }
+  
+  void setTri(const int index, const Tri& positionTri, const Tri& texCoordTri,
+    const Tri& normalTri, const int materialId) {
+    positionTriField.setIndices(index, positionTri.indices);
+    texCoordTriField.setIndices(index, texCoordTri.indices);
+    normalTriField.setIndices(index, normalTri.indices);
+    materialIdField.setIndices(index, &materialId);
+  }
+};
+
+// What a logical line holds
+enum OBJElement {
+  OBJ_IGNORED,
+  OBJ_POSITION,
+  OBJ_NORMAL,
+  OBJ_TEXCOORD,
+  OBJ_FACE,
+  OBJ_MATERIAL_LIBRARY,
+  OBJ_USE_MATERIAL,
+  OBJ_GROUP,
+  OBJ_OBJECT,
+  OBJ_UNSUPPORTED
+};
+
+class OBJMaterialLibraries;
+
+// Where a g or o line changed the names of the tris that follow
+struct OBJGroupStart {
+  int tri;
+  bool isObject;
+  string name;
+  
+  OBJGroupStart(const int tri, const bool isObject, const string& name) :
+    tri(tri), isObject(isObject), name(name) {
+  }
+};
+
+static void addMaterialLibrary(OBJMaterialLibraries* const libraries, const string& name);
+
+// The handler that builds a mesh (OBJMeshStorage) or fills the fields of a
+// sink (OBJFieldStorage). Everything that has to survive from one line to
+// the next.
+template<typename Storage> struct OBJParseState {
+  Storage storage;
+  
+  unordered_map<string, int> previousMaterials;
+  int currentMaterialId;
+  
+  // Where mtllib lines go, NULL to ignore them. Shared with the states of
+  // the other chunks of the file.
+  OBJMaterialLibraries* libraries;
+  
+  // In file order, turned into the Group channel once the file is parsed
+  vector<OBJGroupStart> groupStarts;
+  
+  // Where the phases of the load are timed, NULL for none
+  OBJLoadStats* stats;
+  
+  // For the stats: logical lines of every OBJElement and the values of v,
+  // vn and vt lines and corners of f lines parsed
+  uint64_t lineCounts[OBJ_UNSUPPORTED + 1];
+  uint64_t tokenCount;
+  
+  // Values that come before the parsed part of the file, when it is parsed
+  // in chunks
+  int positionBase;
+  int normalBase;
+  int texCoordBase;
+  int triBase;
+  
+  // Values this state has parsed
+  int positionCount;
+  int normalCount;
+  int texCoordCount;
+  int triCount;
+  
+  // The face being read, triangulated as a fan: only its first and
+  // previous corner are needed for that
+  FaceVertex faceFirst;
+  FaceVertex facePrevious;
+  int faceVertexCount;
+  
+  // Whatever the storage is made from: a mesh, a sink, or the storage of
+  // the whole file for the state of a chunk of it
+  template<typename StorageSource> explicit OBJParseState(StorageSource& source) :
+    storage(source) {
+    currentMaterialId = -1;
+    libraries = NULL;
+    stats = NULL;
+    fill(lineCounts, lineCounts + OBJ_UNSUPPORTED + 1, uint64_t(0));
+    tokenCount = 0;
+    positionBase = normalBase = texCoordBase = triBase = 0;
+    positionCount = normalCount = texCoordCount = triCount = 0;
+    faceVertexCount = 0;
+  }
+  
+  // Sizes the storage once, for values parsed after that to be written in
+  // place. The material count is the number of materials in the file.
+  void presize(const int positionTotal, const int normalTotal,
+    const int texCoordTotal, const int triTotal, const int materialCount) {
+    storage.presize(positionTotal, normalTotal, texCoordTotal, triTotal, materialCount);
+  }
+  
+  int getPositionCount() const {
+    return positionBase + positionCount;
+  }
+  
+  int getNormalCount() const {
+    return normalBase + normalCount;
+  }
+  
+  int getTexCoordCount() const {
+    return texCoordBase + texCoordCount;
+  }
+  
+  void addPosition(const Vec3f& position) {
+    storage.setPosition(getPositionCount(), position);
+    positionCount++;
+  }
+  
+  void addNormal(const Vec3f& normal) {
+    storage.setNormal(getNormalCount(), normal);
+    normalCount++;
+  }
+  
+  void addTexCoord(const Vec2f& texCoord) {
+    storage.setTexCoord(getTexCoordCount(), texCoord);
+    texCoordCount++;
+  }
+  
+  void addTri(const Tri& positionTri, const Tri& texCoordTri, const Tri& normalTri) {
+    storage.setTri(triBase + triCount, positionTri, texCoordTri, normalTri,
+      currentMaterialId);
+    triCount++;
+  }
+  
+  void addMaterialLibrary(const string& name) {
+    ::addMaterialLibrary(libraries, name);
+  }
+  
+  void setGroup(const string& name) {
+    groupStarts.push_back(OBJGroupStart(triBase + triCount, false, name));
+  }
+  
+  void setObject(const string& name) {
+    groupStarts.push_back(OBJGroupStart(triBase + triCount, true, name));
+  }
+  
+  void useMaterial(const string& materialName) {
+    const unordered_map<string, int>::iterator search = previousMaterials.find(materialName);
+    if(search == previousMaterials.end()) {
+      currentMaterialId = int(previousMaterials.size());
+      //LOG_INFO << "Creating new material '" << materialName << "' mapped to id " << currentMaterialId;
+      previousMaterials[materialName] = currentMaterialId;
+    } else {
+      currentMaterialId = search->second;
+      //LOG_INFO << "Re-using material named '" << materialName << "' mapped to id " << currentMaterialId;
+    }
+  }
+  
+  void beginFace() {
+    faceVertexCount = 0;
+  }
+  
+  void addFaceVertex(const FaceVertex& vertex) {
+    if(faceVertexCount == 0) {
+      faceFirst = vertex;
+    } else if(faceVertexCount >= 2) {
+      addTri(
+        makeTri(faceFirst.position, facePrevious.position, vertex.position,
+          getPositionCount()),
+        makeTri(faceFirst.texCoord, facePrevious.texCoord, vertex.texCoord,
+          getTexCoordCount()),
+        makeTri(faceFirst.normal, facePrevious.normal, vertex.normal,
+          getNormalCount()));
+    }
+    facePrevious = vertex;
+    faceVertexCount++;
+  }
+  
+  void endFace() {
+  }
+  
+  void countLine(const OBJElement element, const int lineTokenCount) {
+    if(OBJ_PROFILE) {
+      lineCounts[element]++;
+      tokenCount += uint64_t(lineTokenCount);
+    }
+  }
+  
+  // Adds up what the state of a chunk counted
+  void addCounts(const OBJParseState& chunkState) {
+    for(int i = 0; i <= OBJ_UNSUPPORTED; i++) {
+      lineCounts[i] += chunkState.lineCounts[i];
+    }
+    tokenCount += chunkState.tokenCount;
+  }
+  
+  // Hands the counts to the stats, if there are any
+  void addCountsTo(OBJLoadStats* const loadStats) const {
+    if(!OBJ_PROFILE || !loadStats) {
+      return;
+    }
+    loadStats->positionLines += lineCounts[OBJ_POSITION];
+    loadStats->normalLines += lineCounts[OBJ_NORMAL];
+    loadStats->texCoordLines += lineCounts[OBJ_TEXCOORD];
+    loadStats->faceLines += lineCounts[OBJ_FACE];
+    for(int i = 0; i <= OBJ_UNSUPPORTED; i++) {
+      if(i != OBJ_POSITION && i != OBJ_NORMAL && i != OBJ_TEXCOORD && i != OBJ_FACE) {
+        loadStats->otherLines += lineCounts[i];
+      }
+    }
+    loadStats->tokens += tokenCount;
+  }
+};
+
+typedef OBJParseState<OBJMeshStorage> OBJMeshState;
+typedef OBJParseState<OBJSoAMeshStorage> OBJSoAMeshState;
+typedef OBJParseState<OBJFieldStorage> OBJFieldState;
+
+static bool isBlank(const char c) {
+  return c == ' ' || c == '\t';
+}
+
+static bool isElement(const char* const id, const size_t idLength,
+  const char* const name) {
+  return strlen(name) == idLength && memcmp(id, name, idLength) == 0;
+}
+
+// Tells what a logical line holds and sets idEnd to the end of its keyword
+static OBJElement getElement(const char* const begin, const char* const end,
+  const char*& idEnd) {
+  
+  idEnd = begin;
+  if(begin == end) {
+    return OBJ_IGNORED;
+  }
+  
+  if(begin[0] == 'o') {
+    // Anything else starting with 'o' we ignore
+    if(end - begin > 1 && !isBlank(begin[1])) {
+      return OBJ_IGNORED;
+    }
+    idEnd = begin + 1;
+    return OBJ_OBJECT;
+  }
+  
+  if(	begin[0] == 13 ||
+          isBlank(begin[0]) ||
+          begin[0] == '#' ||
+          begin[0] == 's')
+  {
+    // Those are things we ignore, just go on ..
+    return OBJ_IGNORED;
+  }
+  
+  while(idEnd < end && !isBlank(*idEnd)) {
+    idEnd++;
+  }
+  const size_t idLength = size_t(idEnd - begin);
+  
+  if(isElement(begin, idLength, "v")) {
+    return OBJ_POSITION;
+  } else if(isElement(begin, idLength, "vn")) {
+    return OBJ_NORMAL;
+  } else if(isElement(begin, idLength, "vt")) {
+    return OBJ_TEXCOORD;
+  } else if(isElement(begin, idLength, "f")) {
+    return OBJ_FACE;
+  } else if(isElement(begin, idLength, "mtllib")) {
+    return OBJ_MATERIAL_LIBRARY;
+  } else if(isElement(begin, idLength, "usemtl")) {
+    return OBJ_USE_MATERIAL;
+  } else if(isElement(begin, idLength, "g")) {
+    return OBJ_GROUP;
+  }
+  return OBJ_UNSUPPORTED;
+}
+
+// The next word in [cursor, end), moving cursor past it. Empty at the end.
+static string readWord(const char*& cursor, const char* const end) {
+  while(cursor < end && isBlank(*cursor)) {
+    cursor++;
+  }
+  const char* const wordBegin = cursor;
+  while(cursor < end && !isBlank(*cursor)) {
+    cursor++;
+  }
+  return string(wordBegin, cursor);
+}
+
+// The first word in [cursor, end), e.g. the name after "usemtl"
+static string readName(const char* cursor, const char* const end) {
+  return readWord(cursor, end);
+}
+
+// Everything after the blanks at cursor, e.g. the names of a g line
+static string readRest(const char* cursor, const char* const end) {
+  while(cursor < end && isBlank(*cursor)) {
+    cursor++;
+  }
+  return string(cursor, end);
+}
+
+// Reads the next float in [cursor, end), or 0 if the line has run out
+static float parseFloat(const char*& cursor, const char* const end) {
+  while(cursor < end && isBlank(*cursor)) {
+    cursor++;
+  }
+  float value = 0.0f;
+  const char* const next = scanFloat(cursor, end, value);
+  cursor = next > cursor ? next : end;
+  return value;
+}
+
+static void addFaceComponent(const int value, int* const components,
+  int& componentCount) {
+  if(componentCount == 3) {
+    throw runtime_error("Unsupported face format");
+  }
+  components[componentCount++] = value;
+}
+
+// Reads "v", "v/vt", "v/vt/vn" or "v//vn" from [begin, end). "v//vn" is
+// read as "v/1/vn" so that the normal stays the third component, then the
+// made up texcoord index is dropped.
+static FaceVertex parseFaceVertex(const char* const begin, const char* const end) {
+  int components[3];
+  int componentCount = 0;
+  bool texCoordSkipped = false;
+  
+  const char* cursor = begin;
+  while(cursor < end) {
+    if(*cursor == '/') {
+      if(cursor + 1 < end && cursor[1] == '/') {
+        texCoordSkipped = texCoordSkipped || componentCount == 1;
+        addFaceComponent(1, components, componentCount);
+      }
+      cursor++;
+      continue;
+    }
+    const char* componentEnd = cursor;
+    while(componentEnd < end && *componentEnd != '/') {
+      componentEnd++;
+    }
+    int value = 0;
+    scanInt(cursor, componentEnd, value);
+    addFaceComponent(value, components, componentCount);
+    cursor = componentEnd;
+  }
+  
+  if(componentCount == 0) {
+    throw runtime_error("Unsupported face format");
+  }
+  FaceVertex vertex;
+  vertex.position = components[0];
+  vertex.texCoord = componentCount > 1 && !texCoordSkipped ? components[1] : 0;
+  vertex.normal = componentCount > 2 ? components[2] : 0;
+  return vertex;
+}
+
+// Hands the corners of a face over one at a time, so that faces can have
+// any number of corners without a buffer for them. Returns the number of
+// corners.
+template<typename Handler> static int parseFace(const char* cursor,
+  const char* const end, Handler& handler) {
+  
+  int cornerCount = 0;
+  handler.beginFace();
+  while(true) {
+    while(cursor < end && isBlank(*cursor)) {
+      cursor++;
+    }
+    if(cursor == end) {
+      break;
+    }
+    const char* vertexEnd = cursor;
+    while(vertexEnd < end && !isBlank(*vertexEnd)) {
+      vertexEnd++;
+    }
+    const FaceVertex vertex = parseFaceVertex(cursor, vertexEnd);
+    cornerCount++;
+    handler.addFaceVertex(vertex);
+    cursor = vertexEnd;
+  }
+  handler.endFace();
+  return cornerCount;
+}
+
+// Parses one logical line, [begin, end) has no line break or trailing
+// whitespace left in it.
+template<typename Handler> static void parseLine(const char* const begin,
+  const char* const end, Handler& handler) {
+  
+  const char* idEnd;
+  const OBJElement element = getElement(begin, end, idEnd);
+  const char* cursor = idEnd;
+  
+  switch(element) {
+  case OBJ_POSITION: {
+    const float x = parseFloat(cursor, end);
+    const float y = parseFloat(cursor, end);
+    const float z = parseFloat(cursor, end);
+    handler.addPosition(Vec3f(x, y, z));
+    handler.countLine(element, 3);
+    break;
+  }
+  case OBJ_NORMAL: {
+    const float nx = parseFloat(cursor, end);
+    const float ny = parseFloat(cursor, end);
+    const float nz = parseFloat(cursor, end);
+    handler.addNormal(Vec3f(nx, ny, nz));
+    handler.countLine(element, 3);
+    break;
+  }
+  case OBJ_TEXCOORD: {
+    const float s = parseFloat(cursor, end);
+    const float t = parseFloat(cursor, end);
+    handler.addTexCoord(Vec2f(s, t));
+    handler.countLine(element, 2);
+    break;
+  }
+  case OBJ_FACE: {
+    const int cornerCount = parseFace(idEnd, end, handler);
+    handler.countLine(element, cornerCount);
+    break;
+  }
+  case OBJ_USE_MATERIAL:
+    handler.useMaterial(readName(cursor, end));
+    handler.countLine(element, 0);
+    break;
+  case OBJ_MATERIAL_LIBRARY:
+    // Any number of files
+    for(string name = readWord(cursor, end); !name.empty(); name = readWord(cursor, end)) {
+      handler.addMaterialLibrary(name);
+    }
+    handler.countLine(element, 0);
+    break;
+  case OBJ_GROUP:
+    handler.setGroup(readRest(cursor, end));
+    handler.countLine(element, 0);
+    break;
+  case OBJ_OBJECT:
+    handler.setObject(readRest(cursor, end));
+    handler.countLine(element, 0);
+    break;
+  case OBJ_IGNORED:
+    handler.countLine(element, 0);
+    break;
+  case OBJ_UNSUPPORTED:
+    throw runtime_error("Unsupported element in line '" + string(begin, end) + "'");
+  }
+}
+
+// Drops the '\r' of a "\r\n" line ending
+static const char* stripCarriageReturn(const char* const begin, const char* end) {
+  if(end > begin && end[-1] == '\r') {
+    end--;
+  }
+  return end;
+}
+
+// Drops trailing whitespaces, that includes stray '\r's
+static const char* stripTrailingWhitespace(const char* const begin, const char* end) {
+  while(end > begin && (isBlank(end[-1]) || end[-1] == '\r')) {
+    end--;
+  }
+  return end;
+}
+
+static bool isContinued(const char* const begin, const char* const end) {
+  return end > begin && end[-1] == '\\';
+}
+
+// Finds the line starting at cursor and moves cursor to the next one.
+// Returns false if the line runs into the end of the buffer without a '\n'.
+static bool nextLine(const char*& cursor, const char* const end,
+  const char*& lineBegin, const char*& lineEnd) {
+  lineBegin = cursor;
+  const char* const newline = static_cast<const char*>(
+    memchr(cursor, '\n', size_t(end - cursor)));
+  if(newline) {
+    lineEnd = stripCarriageReturn(lineBegin, newline);
+    cursor = newline + 1;
+    return true;
+  }
+  lineEnd = stripCarriageReturn(lineBegin, end);
+  cursor = end;
+  return false;
+}
+
+// Calls lineFunction(begin, end, source) for every logical line in the
+// buffer: continued lines are joined, line breaks and trailing whitespaces
+// are dropped. Lines are passed straight out of the buffer, only lines
+// continued with '\' and an unterminated last line get copied, into a
+// terminated line in the thread's scratch arena. source is where the line
+// starts in the buffer either way.
+template<typename LineFunction> static void forEachSourceLine(const char* const begin,
+  const char* const end, LineFunction& lineFunction) {
+  
+  ScratchString joinedLine(getScratchAllocator<char>());
+  const char* cursor = begin;
+  while(cursor < end) {
+    const char* lineBegin;
+    const char* lineEnd;
+    const bool terminated = nextLine(cursor, end, lineBegin, lineEnd);
+    
+    if(terminated && !isContinued(lineBegin, lineEnd)) {
+      lineFunction(lineBegin, stripTrailingWhitespace(lineBegin, lineEnd), lineBegin);
+      continue;
+    }
+    
+    const char* const source = lineBegin;
+    joinedLine.assign(lineBegin, lineEnd);
+    
+    // Concatenate "\"'s on the end
+    while(isContinued(joinedLine.data(), joinedLine.data() + joinedLine.size()) &&
+      cursor < end) {
+      nextLine(cursor, end, lineBegin, lineEnd);
+      joinedLine.erase(joinedLine.size() - 1);
+      joinedLine += ' ';
+      joinedLine.append(lineBegin, lineEnd);
+    }
+    
+    const char* const joinedBegin = joinedLine.c_str();
+    lineFunction(joinedBegin, stripTrailingWhitespace(joinedBegin,
+      joinedBegin + joinedLine.size()), source);
+  }
+}
+
+// forEachSourceLine for lineFunction(begin, end)
+template<typename LineFunction> static void forEachLine(const char* const begin,
+  const char* const end, LineFunction& lineFunction) {
+  const auto sourceLineFunction = [&lineFunction](const char* const lineBegin,
+    const char* const lineEnd, const char* const /* source */) {
+    lineFunction(lineBegin, lineEnd);
+  };
+  forEachSourceLine(begin, end, sourceLineFunction);
+}
+
+// Parses a whole OBJ file (or a chunk of one) held in memory
+template<typename Handler> static void parseBuffer(const char* const begin,
+  const char* const end, Handler& handler) {
+  const auto lineParser = [&handler](const char* const lineBegin, const char* const lineEnd) {
+    parseLine(lineBegin, lineEnd, handler);
+  };
+  forEachLine(begin, end, lineParser);
+}
+
+// Corners of a face line, the same way parseFace splits it
+static int countFaceCorners(const char* cursor, const char* const end) {
+  int cornerCount = 0;
+  while(true) {
+    while(cursor < end && isBlank(*cursor)) {
+      cursor++;
+    }
+    if(cursor == end) {
+      return cornerCount;
+    }
+    while(cursor < end && !isBlank(*cursor)) {
+      cursor++;
+    }
+    cornerCount++;
+  }
+}
+
+// A piece of a mapped file, cut at a line boundary, with what a quick
+// counting pass found in it. That is enough to size the channels up front
+// and to parse every chunk as if everything before it had been parsed
+// already.
+struct OBJChunk {
+  const char* begin;
+  const char* end;
+  int positionCount;
+  int normalCount;
+  int texCoordCount;
+  int triCount;
+  // In the order of their usemtl lines
+  vector<string> materialNames;
+  
+  OBJChunk() : begin(NULL), end(NULL), positionCount(0), normalCount(0),
+    texCoordCount(0), triCount(0) {
+  }
+};
+
+static void countChunk(OBJChunk& chunk) {
+  const auto lineCounter = [&chunk](const char* const lineBegin, const char* const lineEnd) {
+    const char* idEnd;
+    switch(getElement(lineBegin, lineEnd, idEnd)) {
+    case OBJ_POSITION:
+      chunk.positionCount++;
+      break;
+    case OBJ_NORMAL:
+      chunk.normalCount++;
+      break;
+    case OBJ_TEXCOORD:
+      chunk.texCoordCount++;
+      break;
+    case OBJ_FACE:
+      // A fan of n - 2 tris
+      chunk.triCount += max(countFaceCorners(idEnd, lineEnd) - 2, 0);
+      break;
+    case OBJ_USE_MATERIAL:
+      chunk.materialNames.push_back(readName(idEnd, lineEnd));
+      break;
+    default:
+      break;
+    }
+  };
+  forEachLine(chunk.begin, chunk.end, lineCounter);
+}
+
+// The first logical line start at or after cursor
+static const char* findLineStart(const char* const begin, const char* const end,
+  const char* cursor) {
+  if(cursor <= begin) {
+    return begin;
+  }
+  // cursor may already be a line start, so look from the character before
+  cursor--;
+  while(cursor < end) {
+    const char* const newline = static_cast<const char*>(
+      memchr(cursor, '\n', size_t(end - cursor)));
+    if(!newline) {
+      return end;
+    }
+    cursor = newline + 1;
+    if(!isContinued(begin, stripCarriageReturn(begin, newline))) {
+      return cursor;
+    }
+  }
+  return end;
+}
+
+// Serial passes over a mapped file go a window of about this size at a time
+static const size_t windowSize = 16 << 20;
+
+// Cuts the buffer into chunkCount chunks of about the same size, at line
+// boundaries
+static vector<OBJChunk> splitIntoChunks(const char* const begin, const char* const end,
+  const int chunkCount) {
+  vector<OBJChunk> chunks(chunkCount);
+  const char* chunkBegin = begin;
+  for(int i = 0; i < chunkCount; i++) {
+    const char* chunkEnd = i == chunkCount - 1 ? end :
+      findLineStart(begin, end, begin + (end - begin) * (i + 1) / chunkCount);
+    if(chunkEnd < chunkBegin) {
+      chunkEnd = chunkBegin;
+    }
+    chunks[i].begin = chunkBegin;
+    chunks[i].end = chunkEnd;
+    chunkBegin = chunkEnd;
+  }
+  return chunks;
+}
+
+// Gives the pages of a chunk of a mapped file back once it has been read,
+// so that the file does not add up to the peak memory of a load. file is
+// NULL if the buffer is not a mapping.
+static void releaseChunk(MappedFile* const file, const OBJChunk& chunk) {
+  if(file) {
+    file->release(size_t(chunk.begin - file->getData()), size_t(chunk.end - chunk.begin));
+  }
+}
+
+// Counts everything in the buffer first, so that every channel is
+// allocated once at its final size, then parses into it. Both passes go a
+// window at a time, giving the pages of a mapped file back behind them.
+template<typename State> static void parseBufferPresized(const char* const begin,
+  const char* const end, State& state, MappedFile* const file) {
+  const int windowCount = int(size_t(end - begin) / windowSize) + 1;
+  vector<OBJChunk> windows = splitIntoChunks(begin, end, windowCount);
+  
+  OBJPhaseTimer countTimer(state.stats, &OBJLoadStats::countSeconds);
+  OBJChunk total;
+  for(int i = 0; i < windowCount; i++) {
+    countChunk(windows[i]);
+    releaseChunk(file, windows[i]);
+    total.positionCount += windows[i].positionCount;
+    total.normalCount += windows[i].normalCount;
+    total.texCoordCount += windows[i].texCoordCount;
+    total.triCount += windows[i].triCount;
+    total.materialNames.insert(total.materialNames.end(),
+      windows[i].materialNames.begin(), windows[i].materialNames.end());
+  }
+  const unordered_set<string> materialNames(total.materialNames.begin(), total.materialNames.end());
+  state.presize(total.positionCount, total.normalCount, total.texCoordCount,
+    total.triCount, int(materialNames.size()));
+  countTimer.stop();
+  
+  OBJPhaseTimer parseTimer(state.stats, &OBJLoadStats::parseSeconds);
+  for(int i = 0; i < windowCount; i++) {
+    parseBuffer(windows[i].begin, windows[i].end, state);
+    releaseChunk(file, windows[i]);
+  }
+}
+
+// Splits the buffer into chunks at line boundaries and counts them on a
+// thread pool. The channels are then sized once and every chunk parses
+// straight into its own range of them, so nothing has to be merged.
+// Relative indices and material ids come out exactly as parseBuffer would
+// have them.
+template<typename State> static void parseBufferInParallel(const char* const begin,
+  const char* const end, State& state, const int threadCount, MappedFile* const file) {
+  
+  // More chunks than threads, so that a slow chunk does not hold up the rest
+  const int chunkCount = threadCount * 4;
+  vector<OBJChunk> chunks = splitIntoChunks(begin, end, chunkCount);
+  
+  ThreadPool pool(threadCount - 1);
+  OBJPhaseTimer countTimer(state.stats, &OBJLoadStats::countSeconds);
+  pool.parallelFor(chunkCount, [&chunks, file](const int i) {
+    countChunk(chunks[i]);
+    releaseChunk(file, chunks[i]);
+  });
+  
+  vector<unique_ptr<State> > chunkStates(chunkCount);
+  int positionTotal = 0;
+  int normalTotal = 0;
+  int texCoordTotal = 0;
+  int triTotal = 0;
+  for(int i = 0; i < chunkCount; i++) {
+    chunkStates[i].reset(new State(state.storage));
+    State& chunkState = *chunkStates[i];
+    chunkState.libraries = state.libraries;
+    chunkState.positionBase = positionTotal;
+    chunkState.normalBase = normalTotal;
+    chunkState.texCoordBase = texCoordTotal;
+    chunkState.triBase = triTotal;
+    positionTotal += chunks[i].positionCount;
+    normalTotal += chunks[i].normalCount;
+    texCoordTotal += chunks[i].texCoordCount;
+    triTotal += chunks[i].triCount;
+    
+    // Hand out the material ids in the order the serial parser would
+    chunkState.currentMaterialId = state.currentMaterialId;
+    const int nameCount = int(chunks[i].materialNames.size());
+    for(int j = 0; j < nameCount; j++) {
+      state.useMaterial(chunks[i].materialNames[j]);
+    }
+  }
+  for(int i = 0; i < chunkCount; i++) {
+    chunkStates[i]->previousMaterials = state.previousMaterials;
+  }
+  
+  state.presize(positionTotal, normalTotal, texCoordTotal, triTotal,
+    int(state.previousMaterials.size()));
+  countTimer.stop();
+  OBJPhaseTimer parseTimer(state.stats, &OBJLoadStats::parseSeconds);
+  pool.parallelFor(chunkCount, [&chunks, &chunkStates, file](const int i) {
+    parseBuffer(chunks[i].begin, chunks[i].end, *chunkStates[i]);
+    releaseChunk(file, chunks[i]);
+  });
+  state.positionCount = positionTotal;
+  state.normalCount = normalTotal;
+  state.texCoordCount = texCoordTotal;
+  state.triCount = triTotal;
+  for(int i = 0; i < chunkCount; i++) {
+    state.groupStarts.insert(state.groupStarts.end(),
+      chunkStates[i]->groupStarts.begin(), chunkStates[i]->groupStarts.end());
+    state.addCounts(*chunkStates[i]);
+  }
+}
+
+// Resolves the indices of a file for an OBJVisitor. A face is all it keeps,
+// in a scratch buffer that only grows to the biggest face of the file.
+class OBJVisitorHandler {
+  
+private:
+  
+  OBJVisitor& visitor;
+  int positionCount;
+  int normalCount;
+  int texCoordCount;
+  vector<OBJFaceVertex, ArenaAllocator<OBJFaceVertex> > face;
+  
+  static int resolveIndex(const int index, const int attributeCount) {
+    return index == 0 ? -1 : mapIndex(index, attributeCount);
+  }
+  
+public:
+  
+  explicit OBJVisitorHandler(OBJVisitor& visitor) : visitor(visitor),
+    positionCount(0), normalCount(0), texCoordCount(0),
+    face(getScratchAllocator<OBJFaceVertex>()) {
+  }
+  
+  int getPositionCount() const {
+    return positionCount;
+  }
+  
+  int getNormalCount() const {
+    return normalCount;
+  }
+  
+  int getTexCoordCount() const {
+    return texCoordCount;
+  }
+  
+  void addPosition(const Vec3f& position) {
+    positionCount++;
+    visitor.onVertex(position);
+  }
+  
+  void addNormal(const Vec3f& normal) {
+    normalCount++;
+    visitor.onNormal(normal);
+  }
+  
+  void addTexCoord(const Vec2f& texCoord) {
+    texCoordCount++;
+    visitor.onTexCoord(texCoord);
+  }
+  
+  void useMaterial(const string& materialName) {
+    visitor.onUseMaterial(materialName);
+  }
+  
+  void addMaterialLibrary(const string& name) {
+    visitor.onMaterialLibrary(name);
+  }
+  
+  void setGroup(const string& name) {
+    visitor.onGroup(name);
+  }
+  
+  void setObject(const string& name) {
+    visitor.onObject(name);
+  }
+  
+  void beginFace() {
+    face.clear();
+  }
+  
+  void addFaceVertex(const FaceVertex& vertex) {
+    OBJFaceVertex resolved;
+    resolved.position = resolveIndex(vertex.position, positionCount);
+    resolved.texCoord = resolveIndex(vertex.texCoord, texCoordCount);
+    resolved.normal = resolveIndex(vertex.normal, normalCount);
+    face.push_back(resolved);
+  }
+  
+  void endFace() {
+    visitor.onFace(face.empty() ? NULL : &face[0], int(face.size()));
+  }
+  
+  void countLine(const OBJElement /* element */, const int /* tokenCount */) {
+  }
+};
+
+// "Kd r g b", or "Kd r" for a grey. Anything else ("Kd spectral file.rfl",
+// "Kd xyz x y z") leaves the color as it was.
+static Vec3f parseColor(const char* cursor, const char* const end, const Vec3f& color) {
+  float values[3];
+  int count = 0;
+  while(count < 3) {
+    while(cursor < end && isBlank(*cursor)) {
+      cursor++;
+    }
+    const char* const next = scanFloat(cursor, end, values[count]);
+    if(next == cursor) {
+      break;
+    }
+    cursor = next;
+    count++;
+  }
+  if(count == 0) {
+    return color;
+  }
+  return count == 3 ? Vec3f(values[0], values[1], values[2]) :
+    Vec3f(values[0], values[0], values[0]);
+}
+
+// The last word of the line: texture options ("-s 1 1 1", "-bm 0.5") come
+// before the file
+static string readLastWord(const char* const begin, const char* end) {
+  end = stripTrailingWhitespace(begin, end);
+  const char* wordBegin = end;
+  while(wordBegin > begin && !isBlank(wordBegin[-1])) {
+    wordBegin--;
+  }
+  return string(wordBegin, end);
+}
+
+// Parses a .mtl file held in memory. Elements we have no use for (illum,
+// Ni, Ke, ...) and anything before the first newmtl are dropped.
+static void parseMaterialLibrary(const char* const begin, const char* const end,
+  vector<Material>& materials) {
+  const auto lineParser = [&materials](const char* lineBegin, const char* const lineEnd) {
+    // Definitions are often indented
+    while(lineBegin < lineEnd && isBlank(*lineBegin)) {
+      lineBegin++;
+    }
+    const char* cursor = lineBegin;
+    while(cursor < lineEnd && !isBlank(*cursor)) {
+      cursor++;
+    }
+    const size_t idLength = size_t(cursor - lineBegin);
+    if(isElement(lineBegin, idLength, "newmtl")) {
+      materials.push_back(Material(readName(cursor, lineEnd)));
+      return;
+    }
+    if(materials.empty()) {
+      return;
+    }
+    Material& material = materials.back();
+    if(isElement(lineBegin, idLength, "Ka")) {
+      material.ambient = parseColor(cursor, lineEnd, material.ambient);
+    } else if(isElement(lineBegin, idLength, "Kd")) {
+      material.diffuse = parseColor(cursor, lineEnd, material.diffuse);
+    } else if(isElement(lineBegin, idLength, "Ks")) {
+      material.specular = parseColor(cursor, lineEnd, material.specular);
+    } else if(isElement(lineBegin, idLength, "Ns")) {
+      material.shininess = parseFloat(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "d")) {
+      // "d -halo 0.5" is read as "d 0.5"
+      const char* value = cursor;
+      if(readWord(value, lineEnd) != "-halo") {
+        value = cursor;
+      }
+      material.opacity = parseFloat(value, lineEnd);
+    } else if(isElement(lineBegin, idLength, "Tr")) {
+      material.opacity = 1 - parseFloat(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "map_Ka")) {
+      material.ambientMap = readLastWord(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "map_Kd")) {
+      material.diffuseMap = readLastWord(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "map_Ks")) {
+      material.specularMap = readLastWord(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "map_Ns")) {
+      material.shininessMap = readLastWord(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "map_d")) {
+      material.opacityMap = readLastWord(cursor, lineEnd);
+    } else if(isElement(lineBegin, idLength, "bump") ||
+      isElement(lineBegin, idLength, "map_bump") || isElement(lineBegin, idLength, "map_Bump")) {
+      material.bumpMap = readLastWord(cursor, lineEnd);
+    }
+  };
+  forEachLine(begin, end, lineParser);
+}
+
+// False if the file cannot be read
+static bool readMaterialLibrary(const string& filename, vector<Material>& materials) {
+  MappedFile file;
+  if(file.open(filename)) {
+    parseMaterialLibrary(file.getData(), file.getData() + file.getSize(), materials);
+    return true;
+  }
+  ifstream stream(filename.c_str(), ios_base::in | ios_base::binary);
+  if(!stream.is_open()) {
+    return false;
+  }
+  const string contents((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+  parseMaterialLibrary(contents.data(), contents.data() + contents.size(), materials);
+  return true;
+}
+
+static vector<Material> readMaterialLibrary(const string& filename) {
+  vector<Material> materials;
+  readMaterialLibrary(filename, materials);
+  return materials;
+}
+
+vector<Material> loadFromMTLFile(const std::string& filename) {
+  vector<Material> materials;
+  if(!readMaterialLibrary(filename, materials)) {
+    throw runtime_error("File not found while reading MTL file: '" + filename + "'");
+  }
+  return materials;
+}
+
+// Where the files of an OBJ file are looked for, with the separator
+static string getDirectory(const string& filename) {
+  const size_t separator = filename.find_last_of("/\\");
+  return separator == string::npos ? "" : filename.substr(0, separator + 1);
+}
+
+static bool isAbsolutePath(const string& filename) {
+  return !filename.empty() && (filename[0] == '/' || filename[0] == '\\' ||
+    (filename.size() > 1 && filename[1] == ':'));
+}
+
+// The material libraries of one OBJ file, each read once however often it
+// is named. In parallel every library is read on a thread of its own as
+// soon as a parsing thread comes across it, otherwise when the table is
+// asked for.
+class OBJMaterialLibraries {
+  
+private:
+  
+  const string directory;
+  const bool parallel;
+  mutex lock;
+  // Paths as they are opened
+  vector<string> filenames;
+  vector<future<vector<Material> > > libraries;
+  
+public:
+  
+  OBJMaterialLibraries(const string& directory, const bool parallel) :
+    directory(directory), parallel(parallel) {
+  }
+  
+  void add(const string& name) {
+    const string filename = isAbsolutePath(name) ? name : directory + name;
+    lock_guard<mutex> guard(lock);
+    if(find(filenames.begin(), filenames.end(), filename) != filenames.end()) {
+      return;
+    }
+    filenames.push_back(filename);
+    libraries.push_back(async(parallel ? launch::async : launch::deferred,
+      static_cast<vector<Material> (*)(const string&)>(readMaterialLibrary), filename));
+  }
+  
+  const vector<string>& getFilenames() const {
+    return filenames;
+  }
+  
+  // Material i for material id i, with the definition of the first library
+  // that has one, then the materials no face uses in library order
+  vector<Material> getMaterials(const unordered_map<string, int>& materialIds) {
+    vector<Material> materials(materialIds.size());
+    for(unordered_map<string, int>::const_iterator it = materialIds.begin();
+      it != materialIds.end();
+      ++it)
+    {
+      materials[it->second].name = it->first;
+    }
+    vector<bool> defined(materials.size(), false);
+    unordered_set<string> unused;
+    for(size_t i = 0; i < libraries.size(); i++) {
+      const vector<Material> library = libraries[i].get();
+      for(size_t j = 0; j < library.size(); j++) {
+        const unordered_map<string, int>::const_iterator search = materialIds.find(library[j].name);
+        if(search == materialIds.end()) {
+          if(unused.insert(library[j].name).second) {
+            materials.push_back(library[j]);
+          }
+        } else if(!defined[search->second]) {
+          materials[search->second] = library[j];
+          defined[search->second] = true;
+        }
+      }
+    }
+    libraries.clear();
+    return materials;
+  }
+};
+
+static void addMaterialLibrary(OBJMaterialLibraries* const libraries, const string& name) {
+  if(libraries) {
+    libraries->add(name);
+  }
+}
+
+// The runs of tris the g and o lines make: the first tri of each and its
+// names. Empty runs are dropped and a run with the names of the one before
+// joins it. Nothing if the file has no g or o lines, or no tris.
+static void getGroupRuns(const vector<OBJGroupStart>& starts, const int triCount,
+  vector<int>& firstTris, vector<Group>& groups) {
+  firstTris.clear();
+  groups.clear();
+  if(starts.empty() || triCount == 0) {
+    return;
+  }
+  Group current;
+  firstTris.push_back(0);
+  groups.push_back(current);
+  for(size_t i = 0; i < starts.size(); i++) {
+    (starts[i].isObject ? current.object : current.name) = starts[i].name;
+    if(starts[i].tri == firstTris.back()) {
+      // The run has no tris yet, rename it
+      groups.back() = current;
+      if(groups.size() > 1 && groups[groups.size() - 2] == current) {
+        firstTris.pop_back();
+        groups.pop_back();
+      }
+    } else if(!(groups.back() == current)) {
+      firstTris.push_back(starts[i].tri);
+      groups.push_back(current);
+    }
+  }
+  if(firstTris.back() >= triCount) {
+    firstTris.pop_back();
+    groups.pop_back();
+  }
+}
+
+// Hands the non-empty channels over to the mesh, the state deletes the rest
+template<typename Storage> static void addChannelsToMesh(OBJParseState<Storage>& state,
+  Mesh* const mesh) {
+  
+  // Would it make things simpler to cull tri channel that are the same as the position tri channel?
+  // Simply go over those chanels, and if the same, to the manual replace
+  
+  OBJPhaseTimer buildTimer(state.stats, &OBJLoadStats::buildSeconds);
+  const int triCount = state.storage.positionTriChannel->getSize();
+  TriChannel* const positionTriChannel = state.storage.positionChannel->getSize() ?
+    state.storage.positionTriChannel : NULL;
+  if(positionTriChannel) {
+    mesh->addChannel(state.storage.positionChannel);
+    mesh->addChannel(state.storage.positionTriChannel);
+    mesh->addRealization(state.storage.positionChannel, state.storage.positionTriChannel);
+    state.storage.positionChannel = NULL;
+    state.storage.positionTriChannel = NULL;
+  }
+  if(state.storage.normalChannel->getSize()) {
+    // Number of normal tris must be the same as the number of position tri
+    assert(state.storage.normalTriChannel->getSize() == triCount);
+    
+    mesh->addChannel(state.storage.normalChannel);
+    mesh->addChannel(state.storage.normalTriChannel);
+    mesh->addRealization(state.storage.normalChannel, state.storage.normalTriChannel);
+    state.storage.normalChannel = NULL;
+    state.storage.normalTriChannel = NULL;
+  }
+  if(state.storage.texCoordChannel->getSize()) {
+    // Number of texcoord tris must be the same as the number of position tri
+    assert(state.storage.texCoordTriChannel->getSize() == triCount);
+    mesh->addChannel(state.storage.texCoordChannel);
+    mesh->addChannel(state.storage.texCoordTriChannel);
+    mesh->addRealization(state.storage.texCoordChannel, state.storage.texCoordTriChannel);
+    state.storage.texCoordChannel = NULL;
+    state.storage.texCoordTriChannel = NULL;
+  }
+  
+  // Add the material channel, but only if it is non-trivial, e.g. contains more than one value
+  if(state.previousMaterials.size() > 1) {
+    mesh->addChannel(state.storage.materialIdChannel);
+    FlatChannel* const materialIdTriChannel = new FlatChannel("MaterialId Tri", mesh);
+    mesh->addChannel(materialIdTriChannel);
+    mesh->addRealization(state.storage.materialIdChannel, materialIdTriChannel);
+    state.storage.materialIdChannel = NULL;
+  }
+  
+  // The runs of the g and o lines, realized on the tris they start
+  vector<int> firstTris;
+  getGroupRuns(state.groupStarts, triCount, firstTris, mesh->getGroups());
+  if(positionTriChannel && !firstTris.empty()) {
+    IntChannel* const groupChannel = new IntChannel("Group", mesh);
+    groupChannel->getValues().assign(firstTris.begin(), firstTris.end());
+    mesh->addChannel(groupChannel);
+    mesh->addRealization(groupChannel, positionTriChannel);
+  } else {
+    mesh->getGroups().clear();
+  }
+  
+  buildTimer.stop();
+  
+  if(state.libraries) {
+    OBJPhaseTimer materialTimer(state.stats, &OBJLoadStats::materialSeconds);
+    mesh->getMaterials() = state.libraries->getMaterials(state.previousMaterials);
+  }
+}
+
+// Reads line by line, for anything that cannot be mapped. The lines live
+// in the thread's scratch arena.
+template<typename Handler> static void parseStream(istream& stream, Handler& handler) {
+  ScratchString line(getScratchAllocator<char>());
+  ScratchString continuedLine(getScratchAllocator<char>());
+  while(getline(stream, line)) {
+    line.erase(stripCarriageReturn(line.data(), line.data() + line.size()) - line.data());
+    
+    // Concatenate "\"'s on the end
+    while(isContinued(line.data(), line.data() + line.size()) &&
+      getline(stream, continuedLine)) {
+      line.erase(line.size() - 1);
+      line += ' ';
+      line.append(continuedLine.data(),
+        stripCarriageReturn(continuedLine.data(), continuedLine.data() + continuedLine.size()));
+    }
+    
+    const char* const lineBegin = line.c_str();
+    parseLine(lineBegin, stripTrailingWhitespace(lineBegin, lineBegin + line.size()), handler);
+  }
+}
+
+// Where the last logical line that ends in [begin, end) ends, begin if
+// there is none
+static const char* findLastLineEnd(const char* const begin, const char* const end) {
+  for(const char* cursor = end; cursor > begin; cursor--) {
+    if(cursor[-1] == '\n' && !isContinued(begin, stripCarriageReturn(begin, cursor - 1))) {
+      return cursor;
+    }
+  }
+  return begin;
+}
+
+// Parses the blocks of the reader as they come in. Each block is parsed in
+// place up to its last logical line end; the rest, a line cut in two by
+// the block boundary, is kept and completed from the next block.
+template<typename Handler> static void parseBlocks(DecodingReader& reader, Handler& handler) {
+  string pending;
+  size_t size;
+  for(const char* block = reader.next(size); block; block = reader.next(size)) {
+    const char* cursor = block;
+    const char* const end = block + size;
+    
+    // Finish the line the last block ended in
+    while(!pending.empty() && cursor < end) {
+      const char* const newline = static_cast<const char*>(
+        memchr(cursor, '\n', size_t(end - cursor)));
+      const char* const pieceEnd = newline ? newline + 1 : end;
+      pending.append(cursor, pieceEnd);
+      cursor = pieceEnd;
+      if(newline && !isContinued(pending.data(),
+        stripCarriageReturn(pending.data(), pending.data() + pending.size() - 1))) {
+        parseBuffer(pending.data(), pending.data() + pending.size(), handler);
+        pending.clear();
+      }
+    }
+    
+    const char* const linesEnd = findLastLineEnd(cursor, end);
+    parseBuffer(cursor, linesEnd, handler);
+    pending.append(linesEnd, end);
+  }
+  parseBuffer(pending.data(), pending.data() + pending.size(), handler);
+}
+
+// Opens filename for parseBlocks, pipes, devices and compressed files
+// included
+static void openBlocks(const string& filename, DecodingReader& reader) {
+  if(!reader.open(filename)) {
+    throw runtime_error("File not found while reading OBJ file: '" + filename + "'");
+  }
+}
+
+// Maps the file unless it is compressed, which is decompressed as it is read
+static bool mapUncompressed(const string& filename, MappedFile& file) {
+  if(!file.open(filename)) {
+    return false;
+  }
+  if(getCompression(file.getData(), file.getSize()) != COMPRESSION_NONE) {
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+void loadFromOBJStream(std::istream& stream, Mesh* const mesh) {
+  
+  mesh->clear();
+  
+  OBJMaterialLibraries libraries("", true);
+  OBJMeshState state(mesh);
+  state.libraries = &libraries;
+  parseStream(stream, state);
+  addChannelsToMesh(state, mesh);
+}
+
+void visitOBJStream(std::istream& stream, OBJVisitor& visitor) {
+  OBJVisitorHandler handler(visitor);
+  parseStream(stream, handler);
+}
+
+void visitOBJFile(const std::string& filename, OBJVisitor& visitor) {
+  MappedFile file;
+  if(mapUncompressed(filename, file)) {
+    // Read a window at a time and give its pages back before the next
+    const char* const begin = file.getData();
+    const char* const end = begin + file.getSize();
+    const vector<OBJChunk> windows = splitIntoChunks(begin, end,
+      int(file.getSize() / windowSize) + 1);
+    OBJVisitorHandler handler(visitor);
+    for(size_t i = 0; i < windows.size(); i++) {
+      parseBuffer(windows[i].begin, windows[i].end, handler);
+      releaseChunk(&file, windows[i]);
+    }
+    return;
+  }
+  
+  DecodingReader reader;
+  openBlocks(filename, reader);
+  OBJVisitorHandler handler(visitor);
+  parseBlocks(reader, handler);
+}
+
+// Threads only pay off with at least a megabyte for each of them
+static int getThreadCount(const OBJLoadOptions& options, const size_t fileSize) {
+  const size_t minimumBytesPerThread = 1 << 20;
+  const int threadCount = options.threadCount > 0 ? options.threadCount :
+    int(thread::hardware_concurrency());
+  return int(min(size_t(max(threadCount, 1)), fileSize / minimumBytesPerThread));
+}
+
+template<typename Storage> static void parseMappedFile(MappedFile& file, Mesh* const mesh,
+  const OBJLoadOptions& options, OBJMaterialLibraries& libraries) {
+  const int threadCount = getThreadCount(options, file.getSize());
+  OBJParseState<Storage> state(mesh);
+  state.libraries = &libraries;
+  state.stats = options.stats;
+  if(threadCount > 1) {
+    parseBufferInParallel(file.getData(), file.getData() + file.getSize(),
+      state, threadCount, &file);
+  } else if(options.presize) {
+    parseBufferPresized(file.getData(), file.getData() + file.getSize(), state, &file);
+  } else {
+    OBJPhaseTimer parseTimer(options.stats, &OBJLoadStats::parseSeconds);
+    parseBuffer(file.getData(), file.getData() + file.getSize(), state);
+  }
+  state.addCountsTo(options.stats);
+  if(OBJ_PROFILE && options.stats) {
+    options.stats->bytesRead += file.getSize();
+  }
+  addChannelsToMesh(state, mesh);
+}
+
+// Parses the file as the reader reads it, on this thread
+template<typename Storage> static void parseFileBlocks(DecodingReader& reader, Mesh* const mesh,
+  const OBJLoadOptions& options, OBJMaterialLibraries& libraries) {
+  OBJParseState<Storage> state(mesh);
+  state.libraries = &libraries;
+  state.stats = options.stats;
+  OBJPhaseTimer parseTimer(options.stats, &OBJLoadStats::parseSeconds);
+  parseBlocks(reader, state);
+  parseTimer.stop();
+  state.addCountsTo(options.stats);
+  if(OBJ_PROFILE && options.stats) {
+    options.stats->bytesRead += reader.getBytesRead();
+  }
+  addChannelsToMesh(state, mesh);
+}
+
+// Maps the file, or reads it (decompressed) into contents if it cannot be
+// mapped or mapFile is false. Returns the mapping, NULL if the file was
+// read.
+static MappedFile* openBuffer(const string& filename, const OBJLoadOptions& options,
+  MappedFile& file, string& contents, const char*& begin, const char*& end,
+  bool& regularFile) {
+  regularFile = true;
+  if(options.mapFile && mapUncompressed(filename, file)) {
+    begin = file.getData();
+    end = begin + file.getSize();
+    return &file;
+  }
+  DecodingReader reader(options.threadCount);
+  openBlocks(filename, reader);
+  regularFile = reader.isRegularFile();
+  size_t size;
+  for(const char* block = reader.next(size); block; block = reader.next(size)) {
+    contents.append(block, size);
+  }
+  begin = contents.data();
+  end = begin + contents.size();
+  return NULL;
+}
+
+// A section ends after this many vertex and face lines
+static const int sectionElementCount = 1 << 14;
+
+// Only looks at the keyword of most lines, faces are not even split. Goes
+// a window at a time, giving the pages of a mapped file back behind it.
+static OBJIndex indexBuffer(const char* const begin, const char* const end,
+  MappedFile* const file) {
+  OBJIndex index;
+  // Groups by name and object, joined by a newline no name can have
+  unordered_map<string, int> groupIds;
+  unordered_map<string, int> materialIds;
+  Group group;
+  index.groups.push_back(group);
+  groupIds["\n"] = 0;
+  OBJSection section;
+  int elementCount = 0;
+  
+  // The next section starts at source, with the names and material of the
+  // one before until a line changes them
+  const auto endSection = [&](const char* const source) {
+    section.end = size_t(source - begin);
+    if(section.end > section.begin) {
+      index.sections.push_back(section);
+    }
+    section.begin = section.end;
+    section.positionBase += section.positionCount;
+    section.normalBase += section.normalCount;
+    section.texCoordBase += section.texCoordCount;
+    section.triBase += section.triCount;
+    section.positionCount = section.normalCount = section.texCoordCount = section.triCount = 0;
+    elementCount = 0;
+  };
+  const auto lineIndexer = [&](const char* const lineBegin, const char* const lineEnd,
+    const char* const source) {
+    const char* idEnd;
+    const OBJElement element = getElement(lineBegin, lineEnd, idEnd);
+    if(element == OBJ_POSITION || element == OBJ_NORMAL || element == OBJ_TEXCOORD ||
+      element == OBJ_FACE) {
+      if(elementCount == sectionElementCount) {
+        endSection(source);
+      }
+      elementCount++;
+    }
+    switch(element) {
+    case OBJ_POSITION:
+      section.positionCount++;
+      break;
+    case OBJ_NORMAL:
+      section.normalCount++;
+      break;
+    case OBJ_TEXCOORD:
+      section.texCoordCount++;
+      break;
+    case OBJ_FACE:
+      // A fan of n - 2 tris
+      section.triCount += max(countFaceCorners(idEnd, lineEnd) - 2, 0);
+      break;
+    case OBJ_USE_MATERIAL: {
+      // Only tris need the material of their section
+      if(section.triCount) {
+        endSection(source);
+      }
+      const pair<unordered_map<string, int>::iterator, bool> added = materialIds.insert(
+        make_pair(readName(idEnd, lineEnd), int(index.materials.size())));
+      if(added.second) {
+        index.materials.push_back(added.first->first);
+      }
+      section.material = added.first->second;
+      break;
+    }
+    case OBJ_MATERIAL_LIBRARY: {
+      const char* cursor = idEnd;
+      for(string name = readWord(cursor, lineEnd); !name.empty(); name = readWord(cursor, lineEnd)) {
+        index.materialLibraries.push_back(name);
+      }
+      break;
+    }
+    case OBJ_GROUP:
+    case OBJ_OBJECT: {
+      if(section.triCount) {
+        endSection(source);
+      }
+      (element == OBJ_OBJECT ? group.object : group.name) = readRest(idEnd, lineEnd);
+      const pair<unordered_map<string, int>::iterator, bool> added = groupIds.insert(
+        make_pair(group.name + '\n' + group.object, int(index.groups.size())));
+      if(added.second) {
+        index.groups.push_back(group);
+      }
+      section.group = added.first->second;
+      break;
+    }
+    default:
+      break;
+    }
+  };
+  const int windowCount = int(size_t(end - begin) / windowSize) + 1;
+  const vector<OBJChunk> windows = splitIntoChunks(begin, end, windowCount);
+  for(int i = 0; i < windowCount; i++) {
+    forEachSourceLine(windows[i].begin, windows[i].end, lineIndexer);
+    releaseChunk(file, windows[i]);
+  }
+  section.end = size_t(end - begin);
+  if(index.sections.empty() || section.end > section.begin) {
+    index.sections.push_back(section);
+  }
+  return index;
+}
+
+// The sidecar index if it is current, else a new one, saved for the next
+// load if the options allow. Only mapped files have a sidecar.
+static OBJIndex getIndex(const string& filename, const char* const begin,
+  const char* const end, MappedFile* const file, const OBJLoadOptions& options) {
+  OBJIndex index;
+  const string indexFilename = getOBJIndexFilename(filename);
+  if(file && options.useCache && loadOBJIndex(indexFilename, index, filename) &&
+    index.sections.back().end == size_t(end - begin)) {
+    return index;
+  }
+  index = indexBuffer(begin, end, file);
+  if(file && options.useCache) {
+    saveOBJIndex(indexFilename, index, filename);
+  }
+  return index;
 }
 
-int stringToIndex(const string& s) {
-  if(s == "") return 0;
-  //const int index = StringTools::stringToInt(s);
-  return stringToInt(s);
+// A tri is in the group or object of every name on its g line and of its
+// o line
+static bool isSelected(const Group& group, const unordered_set<string>& names) {
+  if(names.count(group.name) || names.count(group.object)) {
+    return true;
+  }
+  const char* cursor = group.name.data();
+  const char* const end = cursor + group.name.size();
+  for(string name = readWord(cursor, end); !name.empty(); name = readWord(cursor, end)) {
+    if(names.count(name)) {
+      return true;
+    }
+  }
+  return false;
 }
 
-// From http://www.digitalpeer.com/id/simple
-template<int maxTokenCount> static void fastTokenize(const std::string& str,
-  const std::string& delimiters, FixedVector<std::string, maxTokenCount>& tokens) {
+// Where OBJParseState puts what a selective load parses: the tris of the
+// selected sections in the tri range with their file indices, and values
+// with the index they have in the file. Values are kept unless a filter
+// leaves them out.
+struct OBJSelectionStorage {
+  vector<pair<int, Vec3f> > positions;
+  vector<pair<int, Vec3f> > normals;
+  vector<pair<int, Vec2f> > texCoords;
+  vector<Tri> positionTris;
+  vector<Tri> texCoordTris;
+  vector<Tri> normalTris;
+  vector<int> materialIds;
+  // The file's number of every kept tri, ascending
+  vector<int> triIndices;
   
-  // skip delimiters at beginning.
-  std::string::size_type lastPos = str.find_first_not_of(delimiters, 0);
+  // Sorted indices of the values to keep, NULL for all
+  const vector<int>* positionFilter;
+  const vector<int>* normalFilter;
+  const vector<int>* texCoordFilter;
   
-  // find first "non-delimiter".
-  std::string::size_type pos = str.find_first_of(delimiters, lastPos);
+  // Tris outside [triBegin, triEnd) are dropped
+  int triBegin;
+  int triEnd;
   
-  while (std::string::npos != pos || std::string::npos != lastPos)
-  {
-    // found a token, add it to the vector.
-    tokens.push_back(str.substr(lastPos, pos - lastPos));
-    
-    // skip delimiters.  Note the "not_of"
-    lastPos = str.find_first_not_of(delimiters, pos);
-    
-    // find next "non-delimiter"
-    pos = str.find_first_of(delimiters, lastPos);
+  explicit OBJSelectionStorage(const OBJLoadOptions& options) : positionFilter(NULL),
+    normalFilter(NULL), texCoordFilter(NULL), triBegin(max(options.triBegin, 0)),
+    triEnd(options.triEnd < 0 ? INT_MAX : options.triEnd) {
+  }
+  
+  template<typename T> static void keep(vector<pair<int, T> >& values,
+    const vector<int>* const filter, const int index, const T& value) {
+    if(!filter || binary_search(filter->begin(), filter->end(), index)) {
+      values.push_back(make_pair(index, value));
+    }
+  }
+  
+  void presize(const int /* positionTotal */, const int /* normalTotal */,
+    const int /* texCoordTotal */, const int /* triTotal */, const int /* materialCount */) {
+  }
+  
+  void setPosition(const int index, const Vec3f& position) {
+    keep(positions, positionFilter, index, position);
+  }
+  
+  void setNormal(const int index, const Vec3f& normal) {
+    keep(normals, normalFilter, index, normal);
+  }
+  
+  void setTexCoord(const int index, const Vec2f& texCoord) {
+    keep(texCoords, texCoordFilter, index, texCoord);
+  }
+  
+  void setTri(const int index, const Tri& positionTri, const Tri& texCoordTri,
+    const Tri& normalTri, const int materialId) {
+    if(index < triBegin || index >= triEnd) {
+      return;
+    }
+    triIndices.push_back(index);
+    positionTris.push_back(positionTri);
+    texCoordTris.push_back(texCoordTri);
+    normalTris.push_back(normalTri);
+    materialIds.push_back(materialId);
+  }
+};
+
+typedef OBJParseState<OBJSelectionStorage> OBJSelectionState;
+
+// Sets the state up as if the file had been parsed up to the section
+static void beginSection(OBJSelectionState& state, const OBJIndex& index,
+  const OBJSection& section) {
+  state.positionBase = section.positionBase;
+  state.normalBase = section.normalBase;
+  state.texCoordBase = section.texCoordBase;
+  state.triBase = section.triBase;
+  state.positionCount = state.normalCount = state.texCoordCount = state.triCount = 0;
+  const Group& group = index.groups[section.group];
+  state.groupStarts.push_back(OBJGroupStart(state.triBase, true, group.object));
+  state.groupStarts.push_back(OBJGroupStart(state.triBase, false, group.name));
+  if(section.material < 0) {
+    state.currentMaterialId = -1;
+  } else {
+    state.useMaterial(index.materials[section.material]);
   }
 }
 
-void getIndicesFromLine(const char* const line, Indices& positionIndices,
-  Indices& normalIndices, Indices& texCoordIndices) {
-  FixedVector<string, 16> vertexTokens;
-  fastTokenize(line + 2, " \t", vertexTokens);
+// What a selective load keeps of one kind of values
+struct OBJUsedValues {
+  // File indices, sorted
+  vector<int> indices;
+  // Index in the result of every value of the file from first on, -1 if
+  // it is not kept. Only spans the used values, not the whole file.
+  int first;
+  vector<int> newIndices;
+  // Used values that the selected sections do not have
+  vector<int> missing;
   
-  const int vertexTokenCount = int(vertexTokens.size());
-  for(int i = 0; i < vertexTokenCount; i++) {
-    const string& vertexToken = vertexTokens[i];
-    
-    FixedVector<string, 16> componentTokens;
-    fastTokenize(vertexToken, "/", componentTokens);
-    const int componentCount = int(componentTokens.size());
-    
-    if(componentCount == 1) {
-      positionIndices.push_back(stringToIndex(componentTokens[0]));
-      normalIndices.push_back(0);
-      texCoordIndices.push_back(0);
-    } else if(componentCount == 2) {
-      positionIndices.push_back(stringToIndex(componentTokens[0]));
-      normalIndices.push_back(stringToIndex(componentTokens[1]));
-      texCoordIndices.push_back(0);
-    } else if(componentCount == 3) {
-      positionIndices.push_back(stringToIndex(componentTokens[0]));
-      normalIndices.push_back(stringToIndex(componentTokens[1]));
-      texCoordIndices.push_back(stringToIndex(componentTokens[2]));
-    } else {
-      throw runtime_error("Unsupported face format");
+  OBJUsedValues() : first(0) {
+  }
+};
+
+// The indices of the tris' values that the file has
+static void getUsedIndices(const vector<Tri>& tris, const int total, OBJUsedValues& used) {
+  int last = -1;
+  used.first = total;
+  for(size_t i = 0; i < tris.size(); i++) {
+    for(int c = 0; c < 3; c++) {
+      if(tris[i].indices[c] >= 0 && tris[i].indices[c] < total) {
+        used.first = min(used.first, tris[i].indices[c]);
+        last = max(last, tris[i].indices[c]);
+      }
+    }
+  }
+  used.newIndices.assign(size_t(max(last - used.first + 1, 0)), -1);
+  for(size_t i = 0; i < tris.size(); i++) {
+    for(int c = 0; c < 3; c++) {
+      if(tris[i].indices[c] >= 0 && tris[i].indices[c] < total) {
+        used.newIndices[tris[i].indices[c] - used.first] = 0;
+      }
+    }
+  }
+  used.indices.clear();
+  for(size_t i = 0; i < used.newIndices.size(); i++) {
+    if(used.newIndices[i] == 0) {
+      used.newIndices[i] = int(used.indices.size());
+      used.indices.push_back(used.first + int(i));
     }
   }
 }
 
-void loadFromOBJFile(const std::string& filename, Mesh* const mesh) {
-  
-  mesh->clear();
+// Those of the used indices that have no value yet
+template<typename T> static vector<int> getMissingIndices(const vector<int>& used,
+  const vector<pair<int, T> >& values) {
+  vector<int> have(values.size());
+  for(size_t i = 0; i < values.size(); i++) {
+    have[i] = values[i].first;
+  }
+  sort(have.begin(), have.end());
+  vector<int> missing;
+  set_difference(used.begin(), used.end(), have.begin(), have.end(), back_inserter(missing));
+  return missing;
+}
+
+static bool isAnyInRange(const vector<int>& indices, const int begin, const int count) {
+  const vector<int>::const_iterator search = lower_bound(indices.begin(), indices.end(), begin);
+  return search != indices.end() && *search < begin + count;
+}
+
+// Value i of the result is the value of used[i], in the order of used
+template<typename T> static vector<T> getUsedValues(const vector<int>& used,
+  vector<pair<int, T> >& values) {
+  sort(values.begin(), values.end(),
+    [](const pair<int, T>& a, const pair<int, T>& b) { return a.first < b.first; });
+  vector<T> result(used.size());
+  size_t j = 0;
+  for(size_t i = 0; i < used.size(); i++) {
+    while(j < values.size() && values[j].first < used[i]) {
+      j++;
+    }
+    if(j == values.size() || values[j].first != used[i]) {
+      throw runtime_error("OBJ file changed between indexing and parsing");
+    }
+    result[i] = values[j].second;
+  }
+  return result;
+}
+
+// The tri with indices into the used values, -1 for those the file lacks
+static Tri remapTri(const Tri& tri, const OBJUsedValues& used) {
+  Tri result;
+  for(int c = 0; c < 3; c++) {
+    const int offset = tri.indices[c] - used.first;
+    result.indices[c] = tri.indices[c] >= 0 && offset >= 0 &&
+      offset < int(used.newIndices.size()) ? used.newIndices[offset] : -1;
+  }
+  return result;
+}
+
+// Puts the selection into the mesh the way a full load would, with the
+// values numbered in file order
+template<typename Storage> static void addSelectionToMesh(OBJSelectionState& selection,
+  const OBJUsedValues& usedPositions, const OBJUsedValues& usedNormals,
+  const OBJUsedValues& usedTexCoords, OBJMaterialLibraries& libraries, Mesh* const mesh) {
+  OBJSelectionStorage& selected = selection.storage;
+  const vector<Vec3f> positions = getUsedValues(usedPositions.indices, selected.positions);
+  const vector<Vec3f> normals = getUsedValues(usedNormals.indices, selected.normals);
+  const vector<Vec2f> texCoords = getUsedValues(usedTexCoords.indices, selected.texCoords);
   
-  Vec3fChannel* const positionChannel = new Vec3fChannel("Position", mesh);
-  Vec3fChannel* const normalChannel = new Vec3fChannel("Normal", mesh);
-  Vec2fChannel* const texCoordChannel = new Vec2fChannel("TexCoord", mesh);
-  TriChannel* const positionTriChannel = new TriChannel("Tri", mesh);
-  TriChannel* const normalTriChannel = new TriChannel("Normal Tri", mesh);
-  TriChannel* const texCoordTriChannel = new TriChannel("TexCoord Tri", mesh);
-  IntChannel* const materialIdChannel = new IntChannel("MaterialId", mesh);
+  OBJParseState<Storage> state(mesh);
+  state.libraries = &libraries;
+  state.stats = selection.stats;
+  state.previousMaterials = selection.previousMaterials;
+  state.groupStarts.swap(selection.groupStarts);
+  const int triCount = int(selected.positionTris.size());
+  state.presize(int(positions.size()), int(normals.size()), int(texCoords.size()),
+    triCount, int(state.previousMaterials.size()));
+  for(size_t i = 0; i < positions.size(); i++) {
+    state.storage.setPosition(int(i), positions[i]);
+  }
+  for(size_t i = 0; i < normals.size(); i++) {
+    state.storage.setNormal(int(i), normals[i]);
+  }
+  for(size_t i = 0; i < texCoords.size(); i++) {
+    state.storage.setTexCoord(int(i), texCoords[i]);
+  }
+  for(int i = 0; i < triCount; i++) {
+    state.storage.setTri(i, remapTri(selected.positionTris[i], usedPositions),
+      remapTri(selected.texCoordTris[i], usedTexCoords),
+      remapTri(selected.normalTris[i], usedNormals), selected.materialIds[i]);
+  }
+  addChannelsToMesh(state, mesh);
+}
+
+// Only some of the file is wanted
+static bool isPartialLoad(const OBJLoadOptions& options) {
+  return !options.groups.empty() || options.triBegin > 0 || options.triEnd >= 0;
+}
+
+// Indexes the file, parses the sections with tris of the selected groups
+// in the tri range, then only the vertex lines of the other sections that
+// hold values their tris use
+static void loadSelection(const string& filename, Mesh* const mesh,
+  const OBJLoadOptions& options) {
+  MappedFile file;
+  string contents;
+  const char* begin;
+  const char* end;
+  bool regularFile;
+  OBJPhaseTimer openTimer(options.stats, &OBJLoadStats::openSeconds);
+  MappedFile* const mapping = openBuffer(filename, options, file, contents,
+    begin, end, regularFile);
+  openTimer.stop();
   
-  fstream stream;
-  stream.open(filename.c_str(), ios_base::in | ios_base::binary);
+  mesh->clear();
+  OBJPhaseTimer indexTimer(options.stats, &OBJLoadStats::indexSeconds);
+  const OBJIndex index = getIndex(filename, begin, end, mapping, options);
+  indexTimer.stop();
+  OBJMaterialLibraries libraries(getDirectory(filename), options.threadCount != 1);
+  for(size_t i = 0; i < index.materialLibraries.size(); i++) {
+    libraries.add(index.materialLibraries[i]);
+  }
   
-  if(!stream.is_open()) {
-    throw runtime_error("File not found while reading OBJ file: '" + filename + "'");
+  unordered_set<string> names(options.groups.begin(), options.groups.end());
+  names.erase("");
+  vector<bool> selectedGroups(index.groups.size());
+  for(size_t i = 0; i < index.groups.size(); i++) {
+    selectedGroups[i] = options.groups.empty() || isSelected(index.groups[i], names);
+  }
+  vector<bool> selected(index.sections.size());
+  OBJSelectionState selection(options);
+  selection.libraries = &libraries;
+  selection.stats = options.stats;
+  OBJSelectionStorage& storage = selection.storage;
+  OBJPhaseTimer parseTimer(options.stats, &OBJLoadStats::parseSeconds);
+  uint64_t bytesRead = 0;
+  int positionTotal = 0;
+  int normalTotal = 0;
+  int texCoordTotal = 0;
+  for(size_t i = 0; i < index.sections.size(); i++) {
+    const OBJSection& section = index.sections[i];
+    positionTotal += section.positionCount;
+    normalTotal += section.normalCount;
+    texCoordTotal += section.texCoordCount;
+    selected[i] = section.triCount > 0 && selectedGroups[section.group] &&
+      section.triBase < storage.triEnd && section.triBase + section.triCount > storage.triBegin;
+    if(selected[i]) {
+      beginSection(selection, index, section);
+      parseBuffer(begin + section.begin, begin + section.end, selection);
+      bytesRead += section.end - section.begin;
+    }
   }
   
-  map<string, int> previousMaterials;
-  int currentMaterialId = -1;
+  // Group starts count the tris of the file, the result only has some
+  for(size_t i = 0; i < selection.groupStarts.size(); i++) {
+    int& tri = selection.groupStarts[i].tri;
+    tri = int(lower_bound(storage.triIndices.begin(), storage.triIndices.end(), tri) -
+      storage.triIndices.begin());
+  }
   
-  int lineIndex = 0;
-  while(!stream.eof()) {
-    const int maxLineLength = 512;
-    
-    char brokenLine[maxLineLength];
-    stream.getline(brokenLine, maxLineLength);
-    
-    char line[4 * maxLineLength];
-    int unbreakIndexIn = 0;
-    int unbreakIndexOut = 0;
-    while(brokenLine[unbreakIndexIn] != 0 && unbreakIndexIn < maxLineLength) {
-      if(	brokenLine[unbreakIndexIn + 0] == '/' &&
-              brokenLine[unbreakIndexIn + 1] == '/')
-      {
-        line[unbreakIndexOut++] = '/';
-        line[unbreakIndexOut++] = '1';
-        unbreakIndexIn++;
-      } else {
-        line[unbreakIndexOut++] = brokenLine[unbreakIndexIn++];
-      }
+  OBJUsedValues positions;
+  OBJUsedValues normals;
+  OBJUsedValues texCoords;
+  getUsedIndices(storage.positionTris, positionTotal, positions);
+  getUsedIndices(storage.normalTris, normalTotal, normals);
+  getUsedIndices(storage.texCoordTris, texCoordTotal, texCoords);
+  positions.missing = getMissingIndices(positions.indices, storage.positions);
+  normals.missing = getMissingIndices(normals.indices, storage.normals);
+  texCoords.missing = getMissingIndices(texCoords.indices, storage.texCoords);
+  storage.positionFilter = &positions.missing;
+  storage.normalFilter = &normals.missing;
+  storage.texCoordFilter = &texCoords.missing;
+  const auto vertexParser = [&selection](const char* const lineBegin, const char* const lineEnd) {
+    const char* idEnd;
+    const OBJElement element = getElement(lineBegin, lineEnd, idEnd);
+    if(element == OBJ_POSITION || element == OBJ_NORMAL || element == OBJ_TEXCOORD) {
+      parseLine(lineBegin, lineEnd, selection);
     }
-    line[unbreakIndexOut] = 0;
-    
-    if(unbreakIndexOut != unbreakIndexIn) {
-      //LOG_INFO << "Fixed line: " << line;
+  };
+  for(size_t i = 0; i < index.sections.size(); i++) {
+    const OBJSection& section = index.sections[i];
+    if(!selected[i] && (
+      isAnyInRange(positions.missing, section.positionBase, section.positionCount) ||
+      isAnyInRange(normals.missing, section.normalBase, section.normalCount) ||
+      isAnyInRange(texCoords.missing, section.texCoordBase, section.texCoordCount))) {
+      selection.positionBase = section.positionBase;
+      selection.normalBase = section.normalBase;
+      selection.texCoordBase = section.texCoordBase;
+      selection.positionCount = selection.normalCount = selection.texCoordCount = 0;
+      forEachLine(begin + section.begin, begin + section.end, vertexParser);
+      bytesRead += section.end - section.begin;
     }
-    
-    // Concatenate "/"'s on the end
-    while(line[strlen(line) - 2] == '\\') {
-      char nextLine[maxLineLength];
-      stream.getline(nextLine, maxLineLength);
-      line[strlen(line) - 2] = 0;
-      strcat(line, " ");
-      strcat(line, nextLine);
-      //LOG_INFO << "Concatenating " << lineIndex << " to be '" << line << "'";
-      lineIndex++;
+  }
+  parseTimer.stop();
+  selection.addCountsTo(options.stats);
+  if(OBJ_PROFILE && options.stats) {
+    options.stats->bytesRead += bytesRead;
+  }
+  
+  if(options.structureOfArrays) {
+    addSelectionToMesh<OBJSoAMeshStorage>(selection, positions, normals, texCoords,
+      libraries, mesh);
+  } else {
+    addSelectionToMesh<OBJMeshStorage>(selection, positions, normals, texCoords,
+      libraries, mesh);
+  }
+}
+
+// What a load that found the mesh cache read
+static void addCacheHitTo(const string& cacheFilename, OBJLoadStats* const stats) {
+  uint64_t size;
+  int64_t modified;
+  if(OBJ_PROFILE && stats && getFileStamp(cacheFilename, size, modified)) {
+    stats->fromCache = true;
+    stats->bytesRead += size;
+  }
+}
+
+static void loadMesh(const string& filename, Mesh* const mesh,
+  const OBJLoadOptions& options) {
+  
+  if(isPartialLoad(options)) {
+    loadSelection(filename, mesh, options);
+    return;
+  }
+  
+  const string cacheFilename = getMeshCacheFilename(filename);
+  if(options.useCache) {
+    OBJPhaseTimer cacheTimer(options.stats, &OBJLoadStats::cacheSeconds);
+    if(loadMeshCache(cacheFilename, mesh, filename)) {
+      cacheTimer.stop();
+      addCacheHitTo(cacheFilename, options.stats);
+      OBJPhaseTimer convertTimer(options.stats, &OBJLoadStats::convertSeconds);
+      convertVectorChannels(mesh, options.structureOfArrays);
+      return;
     }
-    
-    // Remove trailing whitespaces
-    while(true) {
-      const int endIndex = int(strlen(line)) - 2;
-      if(endIndex > 0 && (line[endIndex] == ' ' || line[endIndex] == '\t')) {
-        line[endIndex] = 0;
-      } else {
-        break;
+  }
+  
+  // Pipes, devices, compressed files and files not to be mapped are read a
+  // block at a time
+  MappedFile file;
+  DecodingReader reader(options.threadCount);
+  OBJPhaseTimer openTimer(options.stats, &OBJLoadStats::openSeconds);
+  const bool mapped = options.mapFile && mapUncompressed(filename, file);
+  if(!mapped) {
+    openBlocks(filename, reader);
+  }
+  openTimer.stop();
+  
+  mesh->clear();
+  OBJMaterialLibraries libraries(getDirectory(filename), options.threadCount != 1);
+  if(mapped && options.structureOfArrays) {
+    parseMappedFile<OBJSoAMeshStorage>(file, mesh, options, libraries);
+  } else if(mapped) {
+    parseMappedFile<OBJMeshStorage>(file, mesh, options, libraries);
+  } else if(options.structureOfArrays) {
+    parseFileBlocks<OBJSoAMeshStorage>(reader, mesh, options, libraries);
+  } else {
+    parseFileBlocks<OBJMeshStorage>(reader, mesh, options, libraries);
+  }
+  
+  // Only regular files get a sidecar, a pipe would never match it. It
+  // goes stale with the libraries too.
+  if(options.useCache && (mapped || reader.isRegularFile())) {
+    OBJPhaseTimer cacheWriteTimer(options.stats, &OBJLoadStats::cacheWriteSeconds);
+    saveMeshCache(cacheFilename, *mesh, filename, libraries.getFilenames());
+  }
+}
+
+// Resets the stats of a load, NULL if there are none to fill in
+static OBJLoadStats* beginStats(const OBJLoadOptions& options) {
+  if(!OBJ_PROFILE || !options.stats) {
+    return NULL;
+  }
+  *options.stats = OBJLoadStats();
+  return options.stats;
+}
+
+void loadFromOBJFile(const std::string& filename, Mesh* const mesh,
+  const OBJLoadOptions& options) {
+  OBJLoadStats* const stats = beginStats(options);
+  OBJPhaseTimer totalTimer(stats, &OBJLoadStats::totalSeconds);
+  loadMesh(filename, mesh, options);
+  totalTimer.stop();
+  if(stats) {
+    const vector<Channel*>& channels = mesh->getChannels();
+    for(size_t i = 0; i < channels.size(); i++) {
+      if(channels[i]->getSize() && channels[i]->getElementType().scalarType != NO_SCALAR) {
+        stats->allocations++;
+        stats->outputBytes += uint64_t(channels[i]->getMemoryUsage());
       }
     }
-    
-    char elementID[256];
-    sscanf(line, "%s", elementID);
-    
-    if(	line[0] == 'o'||
-            line[0] == 13 ||
-            line[0] == ' ' ||
-            line[0] == '\0' ||
-            line[0] == '#' ||
-            line[0] == 's')
-    {
-      // Those are things we ignore, just go on ..
-    } else if(!strcmp(elementID, "v")) {
-      float x, y, z;
-      sscanf(line, "v %f %f %f", &x, &y, &z);
-      positionChannel->add(Vec3f(x, y, z));
-    } else if(!strcmp(elementID, "vn")) {
-      float nx, ny, nz;
-      sscanf(line, "vn %f %f %f", &nx, &ny, &nz);
-      normalChannel->add(Vec3f(nx, ny, nz));
-    } else if(!strcmp(elementID, "vt")) {
-      float s, t;
-      sscanf(line, "vt %f %f", &s, &t);
-      texCoordChannel->add(Vec2f(s, t));
-    } else if(!strcmp(elementID, "f")) {
-      
-      Indices positionIndices;
-      Indices normalIndices;
-      Indices texCoordIndices;
-      getIndicesFromLine(line, positionIndices, normalIndices, texCoordIndices);
-      
-      const int indexCount = int(positionIndices.size());
-      const int triCount = indexCount - 2;
-      
-      for(int i = 0; i < triCount; i++) {
-        const int positionIndex0 = positionIndices[0];
-        const int positionIndex1 = positionIndices[i + 1];
-        const int positionIndex2 = positionIndices[i + 2];
-        const int texCoordIndex0 = normalIndices[0];
-        const int texCoordIndex1 = normalIndices[i + 1];
-        const int texCoordIndex2 = normalIndices[i + 2];
-        const int normalIndex0 = texCoordIndices[0];
-        const int normalIndex1 = texCoordIndices[i + 1];
-        const int normalIndex2 = texCoordIndices[i + 2];
-        
-        addTri(positionIndex0, positionIndex1, positionIndex2, positionTriChannel, positionChannel);
-        addTri(texCoordIndex0, texCoordIndex1, texCoordIndex2, texCoordTriChannel, texCoordChannel);
-        addTri(normalIndex0, normalIndex1, normalIndex2, normalTriChannel, normalChannel);
-        materialIdChannel->add(currentMaterialId);
-      }
-      
-    } else if(!strcmp(elementID, "mtllib")) {
-      // This is a material definition -- ignore it
-    } else if(!strcmp(elementID, "usemtl")) {
-      
-      char materialName[256];
-      sscanf(line, "usemtl %s", materialName);
-      
-      const map<string, int>::iterator search = previousMaterials.find(materialName);
-      if(search == previousMaterials.end()) {
-        currentMaterialId = int(previousMaterials.size());
-        //LOG_INFO << "Creating new material '" << materialName << "' mapped to id " << currentMaterialId;
-        previousMaterials[materialName] = currentMaterialId;
-      } else {
-        currentMaterialId = search->second;
-        //LOG_INFO << "Re-using material named '" << materialName << "' mapped to id " << currentMaterialId;
-      }
-    } else if(!strcmp(elementID, "g")) {
-    } else {
-      throw runtime_error("Unsupported element in line '" + string(line) + "'");
+  }
+}
+
+// Hands the channels of a mesh to the sink, as if the file had just been
+// parsed. Floats are offered as single and ints as int32 indices.
+static void copyMeshToSink(const Mesh& mesh, OBJFieldSink& sink, OBJLoadStats* const stats) {
+  OBJPhaseTimer convertTimer(stats, &OBJLoadStats::convertSeconds);
+  OBJFieldStorage storage(sink);
+  const vector<Channel*>& channels = mesh.getChannels();
+  for(size_t i = 0; i < channels.size(); i++) {
+    const Channel* const channel = channels[i];
+    const ElementType& elementType = channel->getElementType();
+    if(elementType.scalarType == NO_SCALAR) {
+      storage.allocate(channel->getName(), OBJ_INT32, 0, 0);
+      continue;
     }
-    
-    lineIndex++;
+    OBJFieldBuffer field = storage.allocate(channel->getName(),
+      elementType.scalarType == FLOAT_SCALAR ? OBJ_SINGLE : OBJ_INT32,
+      elementType.componentCount, channel->getSize());
+    field.setAll(*channel);
+  }
+  storage.addCountsTo(stats);
+  sink.setMaterials(mesh.getMaterials());
+  sink.setGroups(mesh.getGroups());
+}
+
+// Whether the field holds the values of a channel of this scalar type
+// exactly, which it does unless the sink took floats as integers or
+// indices as single
+static bool isExactField(const OBJFieldBuffer& field, const ScalarType scalarType) {
+  return !field.data || (scalarType == FLOAT_SCALAR ?
+    field.type == OBJ_SINGLE || field.type == OBJ_DOUBLE : field.type != OBJ_SINGLE);
+}
+
+// Scalar number index of the field, without the index base
+template<typename Scalar> static Scalar getFieldScalar(const OBJFieldBuffer& field,
+  const size_t index) {
+  Scalar value;
+  switch(field.type) {
+  case OBJ_DOUBLE:
+    value = Scalar(static_cast<const double*>(field.data)[index]);
+    break;
+  case OBJ_SINGLE:
+    value = Scalar(static_cast<const float*>(field.data)[index]);
+    break;
+  case OBJ_INT32:
+    value = Scalar(static_cast<const int32_t*>(field.data)[index]);
+    break;
+  default:
+    value = Scalar(int32_t(static_cast<const uint32_t*>(field.data)[index]));
+    break;
+  }
+  return value - Scalar(field.indexBase);
+}
+
+template<typename T> static BaseChannel<T>* makeChannelFromField(const string& name,
+  const OBJFieldBuffer& field, Mesh* const mesh) {
+  typedef ElementTraits<T> Traits;
+  BaseChannel<T>* const channel = new BaseChannel<T>(name, mesh);
+  channel->resize(int(field.valueCount));
+  for(size_t i = 0; i < field.valueCount; i++) {
+    // Padding included, as the cache writes it
+    T value;
+    memset(static_cast<void*>(&value), 0, sizeof(T));
+    for(int c = 0; c < Traits::componentCount; c++) {
+      Traits::setComponent(value, c, getFieldScalar<typename Traits::Scalar>(field,
+        i * Traits::componentCount + c));
+    }
+    channel->setAt(int(i), value);
+  }
+  return channel;
+}
+
+// The other way round from copyMeshToSink: the mesh a load of the file into
+// a mesh would have made, from the fields the sink was given. False, with
+// the mesh empty, if they do not hold all of it.
+static bool copyFieldsToMesh(const OBJFieldStorage& storage, const OBJFieldBuffer& groupField,
+  const vector<Material>& materials, const vector<Group>& groups, Mesh* const mesh) {
+  mesh->clear();
+  const OBJFieldBuffer* const floatFields[] = { &storage.positionField, &storage.normalField,
+    &storage.texCoordField };
+  const OBJFieldBuffer* const intFields[] = { &storage.positionTriField,
+    &storage.normalTriField, &storage.texCoordTriField, &storage.materialIdField, &groupField };
+  bool exact = storage.complete;
+  for(int i = 0; i < 3; i++) {
+    exact = exact && isExactField(*floatFields[i], FLOAT_SCALAR);
+  }
+  for(int i = 0; i < 5; i++) {
+    exact = exact && isExactField(*intFields[i], INT_SCALAR);
+  }
+  if(!exact) {
+    return false;
   }
   
-  // Would it make things simpler to cull tri channel that are the same as the position tri channel?
-  // Simply go over those chanels, and if the same, to the manual replace
-  
-  if(positionChannel->getSize()) {
+  TriChannel* positionTriChannel = NULL;
+  if(storage.positionField.valueCount) {
+    Vec3fChannel* const positionChannel = makeChannelFromField<Vec3f>("Position",
+      storage.positionField, mesh);
+    positionTriChannel = makeChannelFromField<Tri>("Tri", storage.positionTriField, mesh);
     mesh->addChannel(positionChannel);
     mesh->addChannel(positionTriChannel);
     mesh->addRealization(positionChannel, positionTriChannel);
   }
-  if(normalChannel->getSize()) {
-    // Number of normal tris must be the same as the number of position tri
-    assert(normalTriChannel->getSize() == positionTriChannel->getSize());
-    
+  if(storage.normalField.valueCount) {
+    Vec3fChannel* const normalChannel = makeChannelFromField<Vec3f>("Normal",
+      storage.normalField, mesh);
+    TriChannel* const normalTriChannel = makeChannelFromField<Tri>("Normal Tri",
+      storage.normalTriField, mesh);
     mesh->addChannel(normalChannel);
     mesh->addChannel(normalTriChannel);
     mesh->addRealization(normalChannel, normalTriChannel);
   }
-  if(texCoordChannel->getSize()) {
-    // Number of texcoord tris must be the same as the number of position tri
-    assert(texCoordTriChannel->getSize() == positionTriChannel->getSize());
+  if(storage.texCoordField.valueCount) {
+    Vec2fChannel* const texCoordChannel = makeChannelFromField<Vec2f>("TexCoord",
+      storage.texCoordField, mesh);
+    TriChannel* const texCoordTriChannel = makeChannelFromField<Tri>("TexCoord Tri",
+      storage.texCoordTriField, mesh);
     mesh->addChannel(texCoordChannel);
     mesh->addChannel(texCoordTriChannel);
     mesh->addRealization(texCoordChannel, texCoordTriChannel);
   }
-  
-  // Add the material channel, but only if it is non-trivial, e.g. contains more than one value
-  if(previousMaterials.size() > 1) {
-    mesh->addChannel(materialIdChannel);
+  if(storage.hasMaterialIds) {
+    IntChannel* const materialIdChannel = makeChannelFromField<int>("MaterialId",
+      storage.materialIdField, mesh);
     FlatChannel* const materialIdTriChannel = new FlatChannel("MaterialId Tri", mesh);
+    mesh->addChannel(materialIdChannel);
     mesh->addChannel(materialIdTriChannel);
     mesh->addRealization(materialIdChannel, materialIdTriChannel);
   }
+  if(positionTriChannel && groupField.valueCount) {
+    IntChannel* const groupChannel = makeChannelFromField<int>("Group", groupField, mesh);
+    mesh->addChannel(groupChannel);
+    mesh->addRealization(groupChannel, positionTriChannel);
+    mesh->getGroups() = groups;
+  }
+  mesh->getMaterials() = materials;
+  return true;
+}
+
+static void loadIntoSink(const string& filename, OBJFieldSink& sink,
+  const OBJLoadOptions& options) {
+  
+  if(isPartialLoad(options)) {
+    Mesh mesh;
+    loadSelection(filename, &mesh, options);
+    copyMeshToSink(mesh, sink, options.stats);
+    return;
+  }
+  
+  if(options.useCache) {
+    Mesh mesh;
+    const string cacheFilename = getMeshCacheFilename(filename);
+    OBJPhaseTimer cacheTimer(options.stats, &OBJLoadStats::cacheSeconds);
+    if(loadMeshCache(cacheFilename, &mesh, filename)) {
+      cacheTimer.stop();
+      addCacheHitTo(cacheFilename, options.stats);
+      copyMeshToSink(mesh, sink, options.stats);
+      return;
+    }
+  }
+  
+  // The fields have to be counted before they are filled, so anything we
+  // cannot map is read into memory first
+  MappedFile file;
+  string contents;
+  const char* begin;
+  const char* end;
+  bool regularFile;
+  OBJPhaseTimer openTimer(options.stats, &OBJLoadStats::openSeconds);
+  MappedFile* const mapping = openBuffer(filename, options, file, contents,
+    begin, end, regularFile);
+  openTimer.stop();
+  
+  OBJMaterialLibraries libraries(getDirectory(filename), options.threadCount != 1);
+  OBJFieldState state(sink);
+  state.libraries = &libraries;
+  state.stats = options.stats;
+  const int threadCount = getThreadCount(options, size_t(end - begin));
+  if(threadCount > 1) {
+    parseBufferInParallel(begin, end, state, threadCount, mapping);
+  } else {
+    parseBufferPresized(begin, end, state, mapping);
+  }
+  state.addCountsTo(options.stats);
+  if(OBJ_PROFILE && options.stats) {
+    options.stats->bytesRead += uint64_t(end - begin);
+  }
+  
+  // The Group field is only sized once the file is parsed, a mesh has its
+  // channel last too
+  OBJPhaseTimer buildTimer(options.stats, &OBJLoadStats::buildSeconds);
+  vector<int> firstTris;
+  vector<Group> groups;
+  if(state.getPositionCount()) {
+    getGroupRuns(state.groupStarts, state.triCount, firstTris, groups);
+  }
+  OBJFieldBuffer groupField;
+  if(!firstTris.empty()) {
+    groupField = state.storage.allocate("Group", OBJ_INT32, 1, int(firstTris.size()));
+    for(size_t i = 0; i < firstTris.size(); i++) {
+      groupField.setIndices(int(i), &firstTris[i]);
+    }
+  }
+  state.storage.addCountsTo(options.stats);
+  buildTimer.stop();
+  OBJPhaseTimer materialTimer(options.stats, &OBJLoadStats::materialSeconds);
+  const vector<Material> materials = libraries.getMaterials(state.previousMaterials);
+  materialTimer.stop();
+  
+  // The sidecar a load into a mesh would have written, so that the next
+  // load of the file, into a sink or a mesh, finds it. Building the mesh
+  // for it takes a copy of the values, once per change of the file.
+  if(options.useCache && (mapping || regularFile)) {
+    OBJPhaseTimer cacheWriteTimer(options.stats, &OBJLoadStats::cacheWriteSeconds);
+    Mesh mesh;
+    if(copyFieldsToMesh(state.storage, groupField, materials, groups, &mesh)) {
+      saveMeshCache(getMeshCacheFilename(filename), mesh, filename, libraries.getFilenames());
+    }
+  }
+  sink.setMaterials(materials);
+  sink.setGroups(groups);
+}
+
+void loadFromOBJFile(const std::string& filename, OBJFieldSink& sink,
+  const OBJLoadOptions& options) {
+  OBJLoadStats* const stats = beginStats(options);
+  OBJPhaseTimer totalTimer(stats, &OBJLoadStats::totalSeconds);
+  loadIntoSink(filename, sink, options);
+}
+
+// The message of a failed load, never empty so that "" can mean success
+static string getErrorMessage(const string& filename, const char* const what) {
+  return what && *what ? string(what) :
+    "Unknown error while reading OBJ file: '" + filename + "'";
+}
+
+// What loadFilesInParallel does with a mesh or a sink. A mesh that failed
+// is left empty, the fields a sink got before its file failed are for the
+// caller to drop.
+static void loadTarget(const string& filename, Mesh* const mesh,
+  const OBJLoadOptions& options) {
+  loadFromOBJFile(filename, mesh, options);
+}
+
+static void loadTarget(const string& filename, OBJFieldSink* const sink,
+  const OBJLoadOptions& options) {
+  loadFromOBJFile(filename, *sink, options);
+}
+
+static void resetTarget(Mesh* const mesh) {
+  mesh->clear();
+}
+
+static void resetTarget(OBJFieldSink* const /* sink */) {
+}
+
+// Loads file i into target i on a pool, one file per thread at a time.
+// The pool hands out the next file to whichever thread is free, so a big
+// file holds up one thread and not the batch. A failure is kept as the
+// file's error.
+template<typename Target> static vector<string> loadFilesInParallel(
+  const vector<string>& filenames, const vector<Target*>& targets,
+  const OBJLoadOptions& options) {
+  if(targets.size() != filenames.size()) {
+    throw runtime_error("loadFromOBJFiles needs one target per file");
+  }
+  const int fileCount = int(filenames.size());
+  vector<string> errors(fileCount);
+  if(!fileCount) {
+    return errors;
+  }
+  
+  // The batch is parallel already, every file goes on one thread
+  OBJLoadOptions fileOptions = options;
+  fileOptions.threadCount = 1;
+  const int threadCount = min(max(options.threadCount > 0 ? options.threadCount :
+    int(thread::hardware_concurrency()), 1), fileCount);
+  
+  ThreadPool pool(threadCount - 1);
+  pool.parallelFor(fileCount, [&](const int i) {
+    OBJLoadOptions targetOptions = fileOptions;
+    targetOptions.stats = options.stats ? options.stats + i : NULL;
+    try {
+      loadTarget(filenames[i], targets[i], targetOptions);
+    } catch(const exception& e) {
+      errors[i] = getErrorMessage(filenames[i], e.what());
+      resetTarget(targets[i]);
+    } catch(...) {
+      errors[i] = getErrorMessage(filenames[i], NULL);
+      resetTarget(targets[i]);
+    }
+  });
+  return errors;
+}
+
+vector<string> loadFromOBJFiles(const vector<string>& filenames, const vector<Mesh*>& meshes,
+  const OBJLoadOptions& options) {
+  return loadFilesInParallel(filenames, meshes, options);
+}
+
+vector<string> loadFromOBJFiles(const vector<string>& filenames,
+  const vector<OBJFieldSink*>& sinks, const OBJLoadOptions& options) {
+  return loadFilesInParallel(filenames, sinks, options);
+}
+
+// Writes all of the text to the file, false if that failed
+static bool writeText(FILE* const file, const string& text) {
+  return fwrite(text.data(), 1, text.size(), file) == text.size();
+}
+
+static string formatColor(const char* const element, const Vec3f& color) {
+  char text[3 * formattedNumberSize];
+  char* cursor = text;
+  for(int i = 0; i < 3; i++) {
+    *cursor++ = ' ';
+    cursor = formatFloat(color[i], cursor);
+  }
+  return element + string(text, cursor) + "\n";
+}
+
+static string formatScalar(const char* const element, const float value) {
+  char text[formattedNumberSize];
+  return element + string(" ") + string(text, formatFloat(value, text)) + "\n";
+}
+
+void saveToMTLFile(const std::string& filename, const std::vector<Material>& materials) {
+  string text;
+  for(size_t i = 0; i < materials.size(); i++) {
+    const Material& material = materials[i];
+    text += (i ? "\nnewmtl " : "newmtl ") + material.name + "\n";
+    text += formatColor("Ka", material.ambient);
+    text += formatColor("Kd", material.diffuse);
+    text += formatColor("Ks", material.specular);
+    text += formatScalar("Ns", material.shininess);
+    text += formatScalar("d", material.opacity);
+    const char* const mapElements[] = { "map_Ka", "map_Kd", "map_Ks", "map_Ns", "map_d",
+      "bump" };
+    const string* const maps[] = { &material.ambientMap, &material.diffuseMap,
+      &material.specularMap, &material.shininessMap, &material.opacityMap, &material.bumpMap };
+    for(int j = 0; j < 6; j++) {
+      if(!maps[j]->empty()) {
+        text += mapElements[j] + string(" ") + *maps[j] + "\n";
+      }
+    }
+  }
+  FILE* const file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    throw runtime_error("Cannot write MTL file: '" + filename + "'");
+  }
+  const bool written = writeText(file, text);
+  if(fclose(file) != 0 || !written) {
+    remove(filename.c_str());
+    throw runtime_error("Error writing MTL file: '" + filename + "'");
+  }
+}
+
+// "mesh.obj" gets "mesh.mtl", without the directory
+static string getMaterialLibraryName(const string& filename) {
+  const string name = filename.substr(getDirectory(filename).size());
+  const size_t extension = name.find_last_of('.');
+  const string library = (extension == string::npos || extension == 0 ? name :
+    name.substr(0, extension)) + ".mtl";
+  return library == name ? name + ".mtl" : library;
+}
+
+// The channels saveToOBJFile writes, in either layout, checked once. Tri
+// channels that do not go with a tri of "Tri" each, and value channels
+// without a tri channel, are left out.
+struct OBJSaveChannels {
+  ChannelReader<Vec3f> positions;
+  ChannelReader<Vec2f> texCoords;
+  ChannelReader<Vec3f> normals;
+  ChannelReader<Tri> positionTris;
+  ChannelReader<Tri> texCoordTris;
+  ChannelReader<Tri> normalTris;
+  ChannelReader<int> materialIds;
+  bool hasTexCoords;
+  bool hasNormals;
+  bool hasMaterialIds;
+  int triCount;
+  const vector<Material>& materials;
+  // The tri the usemtl lines of the material table go ahead of, triCount
+  // if they go after the last one
+  int firstMaterialTri;
+  // The first tri of every run of the group table
+  vector<int> groupTris;
+  const vector<Group>& groups;
+  
+  explicit OBJSaveChannels(const Mesh& mesh) :
+    positions(mesh.getChannelByName("Position")),
+    texCoords(mesh.getChannelByName("TexCoord")),
+    normals(mesh.getChannelByName("Normal")),
+    positionTris(mesh.getChannelByName("Tri")),
+    texCoordTris(mesh.getChannelByName("TexCoord Tri")),
+    normalTris(mesh.getChannelByName("Normal Tri")),
+    materialIds(mesh.getChannelByName("MaterialId")),
+    triCount(positionTris.getSize()),
+    materials(mesh.getMaterials()),
+    groups(mesh.getGroups()) {
+    if(texCoordTris.getSize() != triCount) {
+      texCoordTris = texCoords.getSize() == positions.getSize() ? positionTris :
+        ChannelReader<Tri>(NULL);
+    }
+    if(normalTris.getSize() != triCount) {
+      normalTris = normals.getSize() == positions.getSize() ? positionTris :
+        ChannelReader<Tri>(NULL);
+    }
+    hasTexCoords = texCoords.getSize() > 0 && texCoordTris.isValid();
+    hasNormals = normals.getSize() > 0 && normalTris.isValid();
+    hasMaterialIds = materialIds.isValid() && materialIds.getSize() == triCount;
+    
+    // Tris before the first usemtl line have no material, -1
+    firstMaterialTri = hasMaterialIds ? triCount : 0;
+    if(hasMaterialIds) {
+      int previous = -1;
+      for(int i = 0; i < triCount; i++) {
+        const int materialId = materialIds.getAt(i);
+        if(materialId >= int(materials.size()) || (materialId < 0 && previous >= 0)) {
+          throw runtime_error("Cannot write MaterialId " + to_string(materialId) +
+            " of tri " + to_string(i) + " to an OBJ file");
+        }
+        if(materialId >= 0 && previous < 0) {
+          firstMaterialTri = i;
+        }
+        previous = materialId;
+      }
+    }
+    const ChannelReader<int> groupChannel(mesh.getChannelByName("Group"));
+    if(triCount > 0 && groupChannel.getSize() == int(groups.size())) {
+      groupTris.resize(groups.size());
+      for(size_t i = 0; i < groups.size(); i++) {
+        groupTris[i] = groupChannel.getAt(int(i));
+      }
+    }
+  }
+};
+
+// What one chunk of the file holds: values [begin, end) of a section
+enum OBJSaveSection {
+  OBJ_SAVE_POSITIONS,
+  OBJ_SAVE_TEXCOORDS,
+  OBJ_SAVE_NORMALS,
+  OBJ_SAVE_FACES
+};
+
+struct OBJSaveChunk {
+  OBJSaveSection section;
+  int begin;
+  int end;
+};
+
+// Values formatted per chunk, a megabyte or so of text
+static const int saveChunkValueCount = 1 << 14;
+
+static void addSaveChunks(const OBJSaveSection section, const int count,
+  vector<OBJSaveChunk>& chunks) {
+  for(int begin = 0; begin < count; begin += saveChunkValueCount) {
+    const OBJSaveChunk chunk = { section, begin, min(begin + saveChunkValueCount, count) };
+    chunks.push_back(chunk);
+  }
+}
+
+template<typename T> static void formatValues(const char* const element,
+  const ChannelReader<T>& values, const OBJSaveChunk& chunk, string& text) {
+  const int componentCount = ElementTraits<T>::componentCount;
+  char line[4 + 4 * formattedNumberSize];
+  memcpy(line, element, strlen(element));
+  for(int i = chunk.begin; i < chunk.end; i++) {
+    const T value = values.getAt(i);
+    char* cursor = line + strlen(element);
+    for(int j = 0; j < componentCount; j++) {
+      *cursor++ = ' ';
+      cursor = formatFloat(ElementTraits<T>::getComponent(value, j), cursor);
+    }
+    *cursor++ = '\n';
+    text.append(line, cursor);
+  }
+}
+
+// The g and o lines that start run i, naming what changed from the run
+// before. The first run always gets a g line, so that a file whose tris
+// are all in the unnamed group still has a group table.
+static void formatGroupStart(const OBJSaveChannels& channels, const size_t i, string& text) {
+  const Group previous = i > 0 ? channels.groups[i - 1] : Group();
+  const Group& group = channels.groups[i];
+  if(group.object != previous.object) {
+    text += group.object.empty() ? "o\n" : "o " + group.object + "\n";
+  }
+  if(group.name != previous.name || i == 0) {
+    text += group.name.empty() ? "g\n" : "g " + group.name + "\n";
+  }
+}
+
+// The loader numbers materials by their first usemtl line and only makes
+// a MaterialId channel for more than one, so naming the whole table in
+// order gives back its order and the ids. Without a MaterialId channel the
+// first material is named, which a file with a single usemtl line had.
+static void formatMaterialTable(const OBJSaveChannels& channels, string& text) {
+  const size_t count = channels.hasMaterialIds ? channels.materials.size() :
+    min(channels.materials.size(), size_t(1));
+  for(size_t i = 0; i < count; i++) {
+    text += "usemtl " + channels.materials[i].name + "\n";
+  }
+}
+
+static char* formatIndex(const int index, char* const cursor) {
+  return formatInt(index + 1, cursor);
+}
+
+static void formatFaces(const OBJSaveChannels& channels, const OBJSaveChunk& chunk,
+  string& text) {
+  size_t group = lower_bound(channels.groupTris.begin(), channels.groupTris.end(),
+    chunk.begin) - channels.groupTris.begin();
+  char line[2 + 3 * (3 * formattedNumberSize + 3)];
+  line[0] = 'f';
+  for(int i = chunk.begin; i < chunk.end; i++) {
+    for(; group < channels.groupTris.size() && channels.groupTris[group] <= i; group++) {
+      formatGroupStart(channels, group, text);
+    }
+    if(i == channels.firstMaterialTri) {
+      formatMaterialTable(channels, text);
+    }
+    if(channels.hasMaterialIds) {
+      const int materialId = channels.materialIds.getAt(i);
+      if(materialId >= 0 &&
+        (i == channels.firstMaterialTri || channels.materialIds.getAt(i - 1) != materialId)) {
+        text += "usemtl " + channels.materials[materialId].name + "\n";
+      }
+    }
+    const Tri positionTri = channels.positionTris.getAt(i);
+    const Tri texCoordTri = channels.hasTexCoords ? channels.texCoordTris.getAt(i) : Tri();
+    const Tri normalTri = channels.hasNormals ? channels.normalTris.getAt(i) : Tri();
+    char* cursor = line + 1;
+    for(int j = 0; j < 3; j++) {
+      *cursor++ = ' ';
+      cursor = formatIndex(positionTri[j], cursor);
+      if(channels.hasTexCoords) {
+        *cursor++ = '/';
+        cursor = formatIndex(texCoordTri[j], cursor);
+      }
+      if(channels.hasNormals) {
+        if(!channels.hasTexCoords) {
+          *cursor++ = '/';
+        }
+        *cursor++ = '/';
+        cursor = formatIndex(normalTri[j], cursor);
+      }
+    }
+    *cursor++ = '\n';
+    text.append(line, cursor);
+  }
+}
+
+static void formatChunk(const OBJSaveChannels& channels, const OBJSaveChunk& chunk,
+  string& text) {
+  text.clear();
+  switch(chunk.section) {
+  case OBJ_SAVE_POSITIONS:
+    formatValues("v", channels.positions, chunk, text);
+    break;
+  case OBJ_SAVE_TEXCOORDS:
+    formatValues("vt", channels.texCoords, chunk, text);
+    break;
+  case OBJ_SAVE_NORMALS:
+    formatValues("vn", channels.normals, chunk, text);
+    break;
+  case OBJ_SAVE_FACES:
+    formatFaces(channels, chunk, text);
+    break;
+  }
+}
+
+void saveToOBJFile(const std::string& filename, const Mesh& mesh,
+  const OBJSaveOptions& options) {
+  const OBJSaveChannels channels(mesh);
+  string header;
+  if(options.writeMaterialLibrary && !mesh.getMaterials().empty()) {
+    const string library = getMaterialLibraryName(filename);
+    saveToMTLFile(getDirectory(filename) + library, mesh.getMaterials());
+    header = "mtllib " + library + "\n";
+  }
+  vector<OBJSaveChunk> chunks;
+  addSaveChunks(OBJ_SAVE_POSITIONS, channels.positions.getSize(), chunks);
+  addSaveChunks(OBJ_SAVE_TEXCOORDS, channels.hasTexCoords ? channels.texCoords.getSize() : 0,
+    chunks);
+  addSaveChunks(OBJ_SAVE_NORMALS, channels.hasNormals ? channels.normals.getSize() : 0, chunks);
+  addSaveChunks(OBJ_SAVE_FACES, channels.triCount, chunks);
+  
+  FILE* const file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    throw runtime_error("Cannot write OBJ file: '" + filename + "'");
+  }
+  // The chunks are big enough to go to the file as they are
+  setvbuf(file, NULL, _IONBF, 0);
+  
+  // One batch is written while the next one is formatted into the other
+  // set of buffers
+  const int threadCount = max(options.threadCount > 0 ? options.threadCount :
+    int(thread::hardware_concurrency()), 1);
+  const int batchSize = threadCount * 2;
+  vector<string> texts[2] = { vector<string>(batchSize), vector<string>(batchSize) };
+  future<bool> writing;
+  bool written = writeText(file, header);
+  try {
+    ThreadPool pool(threadCount - 1);
+    for(int batch = 0; batch * batchSize < int(chunks.size()); batch++) {
+      const int first = batch * batchSize;
+      const int count = min(batchSize, int(chunks.size()) - first);
+      vector<string>& batchTexts = texts[batch % 2];
+      pool.parallelFor(count, [&](const int i) {
+        formatChunk(channels, chunks[first + i], batchTexts[i]);
+      });
+      if(writing.valid()) {
+        written = writing.get() && written;
+      }
+      writing = async(launch::async, [file, &batchTexts, count]() {
+        bool batchWritten = true;
+        for(int i = 0; i < count && batchWritten; i++) {
+          batchWritten = writeText(file, batchTexts[i]);
+        }
+        return batchWritten;
+      });
+    }
+    if(writing.valid()) {
+      written = writing.get() && written;
+    }
+    if(channels.firstMaterialTri == channels.triCount) {
+      string trailer;
+      formatMaterialTable(channels, trailer);
+      written = writeText(file, trailer) && written;
+    }
+  } catch(...) {
+    if(writing.valid()) {
+      writing.wait();
+    }
+    fclose(file);
+    remove(filename.c_str());
+    throw;
+  }
+  if(fclose(file) != 0 || !written) {
+    remove(filename.c_str());
+    throw runtime_error("Error writing OBJ file: '" + filename + "'");
+  }
+  // Both go by the time and size of the file, which a rewrite of the same
+  // size can keep where file times are in seconds
+  remove(getMeshCacheFilename(filename).c_str());
+  remove(getOBJIndexFilename(filename).c_str());
 }
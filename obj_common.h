@@ -1,4 +1,310 @@
+#pragma once
+
+#include <istream>
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include "mesh.h"
 
-void loadFromOBJFile(const std::string& filename, Geometry::Mesh* const mesh);
\ No newline at end of file
+// Build with -DOBJ_PROFILE=0 to compile out the timing and counting behind
+// OBJLoadOptions::stats
+#ifndef OBJ_PROFILE
+#define OBJ_PROFILE 1
+#endif
+
+// What a load did and where its time went. Phases a load skips stay 0, and
+// so does everything if OBJ_PROFILE is 0.
+struct OBJLoadStats {
+  // Wall time in seconds of mapping the file (reading it if it cannot be
+  // mapped), looking for and reading the mesh cache, getting the index of
+  // a partial load, the pass that counts what to allocate, tokenizing and
+  // parsing the numbers into the channels or fields, waiting for the
+  // material libraries, handing the channels to the mesh with the group
+  // and material tables, copying a mesh to a sink (values converted to the
+  // sink's types) and writing the mesh cache
+  double openSeconds;
+  double cacheSeconds;
+  double indexSeconds;
+  double countSeconds;
+  double parseSeconds;
+  double materialSeconds;
+  double buildSeconds;
+  double convertSeconds;
+  double cacheWriteSeconds;
+  double totalSeconds;
+  
+  // Of the OBJ text parsed, or of the mesh cache read instead of it.
+  // Unknown (0) for files that have to be read as streams.
+  uint64_t bytesRead;
+  // Logical lines by element; comments, blank lines, usemtl, mtllib, g, o
+  // and s lines are the other ones
+  uint64_t positionLines;
+  uint64_t normalLines;
+  uint64_t texCoordLines;
+  uint64_t faceLines;
+  uint64_t otherLines;
+  // Values parsed: the coordinates of v, vn and vt lines and the corners
+  // ("1/2/3") of f lines
+  uint64_t tokens;
+  // Buffers allocated for the result, one per channel or field
+  uint64_t allocations;
+  // What the values of the result take up
+  uint64_t outputBytes;
+  bool fromCache;
+  
+  OBJLoadStats() : openSeconds(0), cacheSeconds(0), indexSeconds(0), countSeconds(0),
+    parseSeconds(0), materialSeconds(0), buildSeconds(0), convertSeconds(0),
+    cacheWriteSeconds(0), totalSeconds(0), bytesRead(0), positionLines(0), normalLines(0),
+    texCoordLines(0), faceLines(0), otherLines(0), tokens(0), allocations(0),
+    outputBytes(0), fromCache(false) {
+  }
+};
+
+struct OBJLoadOptions {
+  // Threads parsing a mapped file, 0 uses every core. Small files use
+  // fewer threads, down to one below a couple of megabytes.
+  int threadCount;
+  
+  // Count the file before parsing it, so that every channel is allocated
+  // once at its final size. The parallel loader always does.
+  bool presize;
+  
+  // Map regular files into memory. Off, files are read by a thread of their
+  // own, a few large blocks ahead of the parser, which keeps page faults on
+  // network file systems from stalling it. Meshes are then parsed on one
+  // thread without presizing, sinks and partial loads read the whole file
+  // before parsing it.
+  bool mapFile;
+  
+  // Load from the binary sidecar (getMeshCacheFilename) when it was written
+  // from the current version of the file, and write it after every parse
+  // that could not. Failing to write it is not an error. The same goes for
+  // the index sidecar of partial loads.
+  bool useCache;
+  
+  // Positions, normals and texcoords as SoAChannels (x[], y[], z[]) instead
+  // of BaseChannels, parsed straight into that layout
+  bool structureOfArrays;
+  
+  // Only load the tris of these groups and objects (see Geometry::Group)
+  // and the values they use, renumbered in file order. Empty loads
+  // everything.
+  std::vector<std::string> groups;
+  
+  // Only load the tris a full load would number triBegin to triEnd - 1,
+  // of the selected groups if there are any. triEnd -1 is the end of the
+  // file.
+  //
+  // Either selection goes by an index of the file (obj_index.h), built in
+  // one pass on the first such load and kept in a sidecar if useCache
+  // allows. Only the sections of the index with wanted tris are parsed,
+  // then the vertex lines of the sections that hold values they use. The
+  // mesh cache is neither read nor written.
+  int triBegin;
+  int triEnd;
+  
+  // Reset and filled in by the load if not NULL. loadFromOBJFiles takes
+  // an array of one per file.
+  OBJLoadStats* stats;
+  
+  OBJLoadOptions() : threadCount(0), presize(true), mapFile(true), useCache(true),
+    structureOfArrays(false), triBegin(0), triEnd(-1), stats(NULL) {
+  }
+};
+
+// Memory maps the file and parses it in place, in parallel chunks for big
+// files. Files that cannot be mapped (pipes, devices) are read through
+// loadFromOBJStream instead.
+//
+// The material libraries of mtllib lines are read relative to the file,
+// on threads of their own while the geometry is parsed unless threadCount
+// is 1. The mesh's material table has the materials in MaterialId order,
+// then those the libraries define and no face uses. A library that cannot
+// be read leaves its materials at their defaults.
+//
+// If the file has g or o lines, the "Group" channel (realized on "Tri")
+// has the first tri of every run of tris under the same names, and the
+// mesh's group table the names of the run.
+void loadFromOBJFile(const std::string& filename, Geometry::Mesh* const mesh,
+  const OBJLoadOptions& options = OBJLoadOptions());
+
+// Reads line by line from any stream, e.g. one wrapping a pipe. Material
+// libraries are read relative to the working directory.
+void loadFromOBJStream(std::istream& stream, Geometry::Mesh* const mesh);
+
+// The materials of a .mtl file in file order. Throws if it cannot be read.
+std::vector<Geometry::Material> loadFromMTLFile(const std::string& filename);
+
+// Writes the materials as a .mtl file loadFromMTLFile reads back the same.
+// Throws if it cannot be written.
+void saveToMTLFile(const std::string& filename,
+  const std::vector<Geometry::Material>& materials);
+
+struct OBJSaveOptions {
+  // Threads formatting the text, 0 uses every core
+  int threadCount;
+  
+  // Write the material table next to the file, to the .mtl file named
+  // after it ("mesh.obj" gets "mesh.mtl"), and name that in an mtllib line.
+  // Off, the materials are only named by the usemtl lines.
+  bool writeMaterialLibrary;
+  
+  OBJSaveOptions() : threadCount(0), writeMaterialLibrary(true) {
+  }
+};
+
+// Writes "Position", "TexCoord" and "Normal" (in either layout) as v, vt
+// and vn lines and "Tri" as f lines whose corners have the indices of
+// "TexCoord Tri" and "Normal Tri" too ("1/2/3", "1//3"). Texcoords and
+// normals without a tri channel of their own but with a value per position
+// go by "Tri", as on a welded mesh. Runs of "MaterialId" start with usemtl
+// lines, runs of "Group" with g and o lines. Missing indices (-1) are
+// written as 0, which reads back as missing.
+//
+// Floats are written with the fewest digits that read back as the same
+// float. The loader numbers materials by their first usemtl line, so the
+// whole material table is named in order ahead of the first face with a
+// material (after the last face if none has one), or only its first
+// material without a MaterialId channel. Loading the file with its
+// material library thus gives back the channels, MaterialId values and
+// material and group tables of any mesh loaded from an OBJ file, in the
+// same order and bit for bit. Without the library the materials come back
+// with their names only, and only the first one without a MaterialId
+// channel.
+//
+// The text is formatted in chunks on threadCount threads, a batch at a
+// time, and written straight from the chunks while the next batch is
+// formatted. The mesh cache and index of an earlier file of that name are
+// deleted. Throws runtime_error if the file cannot be written or the mesh
+// cannot be written as OBJ: a MaterialId out of the material table, or -1
+// after tris with a material.
+void saveToOBJFile(const std::string& filename, const Geometry::Mesh& mesh,
+  const OBJSaveOptions& options = OBJSaveOptions());
+
+// The type of the values of a field, named after the MATLAB classes
+enum OBJScalarType {
+  OBJ_DOUBLE,
+  OBJ_SINGLE,
+  OBJ_INT32,
+  OBJ_UINT32
+};
+
+// Takes the channels of an OBJ file as plain arrays in memory it hands
+// out, e.g. the arrays of a MATLAB struct. Fields are named and ordered
+// like the channels of a mesh loaded from the same file. The values of a
+// field are stored one after the other, with their components next to
+// each other (a componentCount x valueCount matrix in column major order).
+// Indices are 0-based unless getIndexBase says otherwise.
+class OBJFieldSink {
+  
+public:
+  
+  virtual ~OBJFieldSink() {
+  }
+  
+  // The type to write the field's values as. Positions, normals and
+  // texcoords are single, indices and material ids int32.
+  virtual OBJScalarType getFieldType(const std::string& /* name */,
+    const OBJScalarType nativeType) {
+    return nativeType;
+  }
+  
+  // Added to the indices and material ids of the field, 1 for MATLAB
+  // style indices. Missing indices (-1) and the material id of faces
+  // before the first usemtl (-1) get it too.
+  virtual int getIndexBase(const std::string& /* name */) {
+    return 0;
+  }
+  
+  // Memory for componentCount * valueCount values of the given type, or
+  // NULL to skip the field. Called once per field, before any value is
+  // parsed, except for the Group field: it is sized after the parse.
+  virtual void* allocateField(const std::string& name, const OBJScalarType type,
+    const int componentCount, const int valueCount) = 0;
+  
+  // The material table of the file, as loadFromOBJFile puts it on a mesh.
+  // Called once, after the fields are filled.
+  virtual void setMaterials(const std::vector<Geometry::Material>& /* materials */) {
+  }
+  
+  // The names of the runs of the Group field, as loadFromOBJFile puts them
+  // on a mesh. Called once, after the fields are filled.
+  virtual void setGroups(const std::vector<Geometry::Group>& /* groups */) {
+  }
+};
+
+// Parses the file straight into the sink's memory, without a mesh in
+// between. The file is counted first to size the fields, streams are read
+// into memory for that. A current binary sidecar is copied from instead.
+// Without one, the sidecar a load into a mesh would write is written from
+// the fields, which takes a mesh's worth of memory for the time: unless
+// the sink skipped a field or took values in a type that loses them
+// (floats as integers, indices as single).
+void loadFromOBJFile(const std::string& filename, OBJFieldSink& sink,
+  const OBJLoadOptions& options = OBJLoadOptions());
+
+// Loads many files at once, file i into meshes[i] or sinks[i], with
+// options.threadCount files (0: one per core) parsed at a time and each
+// file on a single thread. A file that fails does not stop the others:
+// the returned vector has its message where the others have "". Its mesh
+// is left empty; a sink may have allocated fields before the failure.
+std::vector<std::string> loadFromOBJFiles(const std::vector<std::string>& filenames,
+  const std::vector<Geometry::Mesh*>& meshes, const OBJLoadOptions& options = OBJLoadOptions());
+
+std::vector<std::string> loadFromOBJFiles(const std::vector<std::string>& filenames,
+  const std::vector<OBJFieldSink*>& sinks, const OBJLoadOptions& options = OBJLoadOptions());
+
+// One corner of a face, as 0-based indices into the vertices, normals and
+// texcoords read so far. Relative indices are resolved, -1 means the
+// corner has no such index.
+struct OBJFaceVertex {
+  int position;
+  int texCoord;
+  int normal;
+};
+
+// Receives the elements of an OBJ file in file order, nothing is kept
+// between calls. Override the ones you need.
+class OBJVisitor {
+  
+public:
+  
+  virtual ~OBJVisitor() {
+  }
+  
+  virtual void onVertex(const Vec3f& /* position */) {
+  }
+  
+  virtual void onNormal(const Vec3f& /* normal */) {
+  }
+  
+  virtual void onTexCoord(const Vec2f& /* texCoord */) {
+  }
+  
+  // A face with all of its corners, not triangulated. The array is only
+  // valid during the call.
+  virtual void onFace(const OBJFaceVertex* const /* vertices */, const int /* vertexCount */) {
+  }
+  
+  virtual void onUseMaterial(const std::string& /* name */) {
+  }
+  
+  // Once per file of an mtllib line, which is not read
+  virtual void onMaterialLibrary(const std::string& /* filename */) {
+  }
+  
+  // The rest of a g line, the names of the groups of the faces after it
+  virtual void onGroup(const std::string& /* names */) {
+  }
+  
+  // The name of an o line
+  virtual void onObject(const std::string& /* name */) {
+  }
+};
+
+// Runs the visitor over the file in constant memory: it is mapped and read
+// front to back, and the pages already read are given back on the way.
+// Unmappable files go through visitOBJStream.
+void visitOBJFile(const std::string& filename, OBJVisitor& visitor);
+
+void visitOBJStream(std::istream& stream, OBJVisitor& visitor);
@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include "obj_index.h"
+#include "mapped_file.h"
+#include "sidecar_file.h"
+
+using namespace Geometry;
+using namespace std;
+
+// Bump whenever the layout below changes
+static const uint32_t indexVersion = 1;
+static const char indexMagic[8] = { 'O', 'B', 'J', 'I', 'N', 'D', 'E', 'X' };
+
+// The file is a header, the sections, the length of every string, then
+// the strings: the name and object of every group, the materials and the
+// material libraries. The checksum covers everything after the header.
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t sectionCount;
+  uint32_t groupCount;
+  uint32_t materialCount;
+  uint64_t sourceSize;
+  int64_t sourceModified;
+  uint64_t fileSize;
+  uint64_t checksum;
+  uint32_t libraryCount;
+  uint32_t reserved;
+};
+
+struct IndexSection {
+  uint64_t begin;
+  uint64_t end;
+  int32_t group;
+  int32_t material;
+  int32_t positionBase;
+  int32_t normalBase;
+  int32_t texCoordBase;
+  int32_t triBase;
+  int32_t positionCount;
+  int32_t normalCount;
+  int32_t texCoordCount;
+  int32_t triCount;
+};
+
+string getOBJIndexFilename(const string& sourceFilename) {
+  return sourceFilename + ".objindex";
+}
+
+bool saveOBJIndex(const string& indexFilename, const OBJIndex& index,
+  const string& sourceFilename) {
+  
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, indexMagic, sizeof(indexMagic));
+  header.version = indexVersion;
+  if(!getFileStamp(sourceFilename, header.sourceSize, header.sourceModified)) {
+    return false;
+  }
+  
+  vector<IndexSection> table(index.sections.size());
+  for(size_t i = 0; i < table.size(); i++) {
+    const OBJSection& section = index.sections[i];
+    IndexSection& entry = table[i];
+    entry.begin = section.begin;
+    entry.end = section.end;
+    entry.group = section.group;
+    entry.material = section.material;
+    entry.positionBase = section.positionBase;
+    entry.normalBase = section.normalBase;
+    entry.texCoordBase = section.texCoordBase;
+    entry.triBase = section.triBase;
+    entry.positionCount = section.positionCount;
+    entry.normalCount = section.normalCount;
+    entry.texCoordCount = section.texCoordCount;
+    entry.triCount = section.triCount;
+  }
+  header.sectionCount = uint32_t(table.size());
+  header.groupCount = uint32_t(index.groups.size());
+  header.materialCount = uint32_t(index.materials.size());
+  header.libraryCount = uint32_t(index.materialLibraries.size());
+  
+  vector<uint32_t> lengths;
+  string strings;
+  const auto addString = [&lengths, &strings](const string& value) {
+    lengths.push_back(uint32_t(value.size()));
+    strings += value;
+  };
+  for(size_t i = 0; i < index.groups.size(); i++) {
+    addString(index.groups[i].name);
+    addString(index.groups[i].object);
+  }
+  for(size_t i = 0; i < index.materials.size(); i++) {
+    addString(index.materials[i]);
+  }
+  for(size_t i = 0; i < index.materialLibraries.size(); i++) {
+    addString(index.materialLibraries[i]);
+  }
+  header.fileSize = sizeof(IndexHeader) + sizeof(IndexSection) * table.size() +
+    sizeof(uint32_t) * lengths.size() + strings.size();
+  
+  string temporaryFilename;
+  FILE* const file = createTemporaryFile(indexFilename, temporaryFilename);
+  if(!file) {
+    return false;
+  }
+  
+  // The header goes in last, once the checksum of the rest is known
+  Checksum checksum;
+  bool written = fseek(file, long(sizeof(IndexHeader)), SEEK_SET) == 0;
+  const auto write = [&](const char* const data, const size_t size) {
+    checksum.add(data, size);
+    written = written && fwrite(data, 1, size, file) == size;
+  };
+  write(reinterpret_cast<const char*>(table.data()), sizeof(IndexSection) * table.size());
+  write(reinterpret_cast<const char*>(lengths.data()), sizeof(uint32_t) * lengths.size());
+  write(strings.data(), strings.size());
+  header.checksum = checksum.get();
+  written = written && fseek(file, 0, SEEK_SET) == 0 &&
+    fwrite(&header, sizeof(header), 1, file) == 1;
+  if(fclose(file) != 0 || !written) {
+    remove(temporaryFilename.c_str());
+    return false;
+  }
+  return replaceFile(temporaryFilename, indexFilename);
+}
+
+bool loadOBJIndex(const string& indexFilename, OBJIndex& index,
+  const string& sourceFilename) {
+  
+  MappedFile file;
+  if(!file.open(indexFilename) || file.getSize() < sizeof(IndexHeader)) {
+    return false;
+  }
+  const char* const data = file.getData();
+  IndexHeader header;
+  memcpy(&header, data, sizeof(header));
+  uint64_t sourceSize;
+  int64_t sourceModified;
+  if(memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 ||
+    header.version != indexVersion ||
+    header.fileSize != file.getSize() ||
+    !getFileStamp(sourceFilename, sourceSize, sourceModified) ||
+    sourceSize != header.sourceSize || sourceModified != header.sourceModified) {
+    return false;
+  }
+  Checksum checksum;
+  checksum.add(data + sizeof(IndexHeader), file.getSize() - sizeof(IndexHeader));
+  if(checksum.get() != header.checksum) {
+    return false;
+  }
+  
+  const size_t stringCount = size_t(header.groupCount) * 2 + header.materialCount +
+    header.libraryCount;
+  const size_t tableSize = sizeof(IndexSection) * header.sectionCount +
+    sizeof(uint32_t) * stringCount;
+  if(header.sectionCount == 0 || tableSize > file.getSize() - sizeof(IndexHeader)) {
+    return false;
+  }
+  vector<IndexSection> table(header.sectionCount);
+  vector<uint32_t> lengths(stringCount);
+  memcpy(table.data(), data + sizeof(IndexHeader), sizeof(IndexSection) * table.size());
+  memcpy(lengths.data(), data + sizeof(IndexHeader) + sizeof(IndexSection) * table.size(),
+    sizeof(uint32_t) * lengths.size());
+  
+  // Sections must cover the source front to back and only name what the
+  // tables have
+  OBJIndex result;
+  result.sections.resize(table.size());
+  uint64_t previousEnd = 0;
+  for(size_t i = 0; i < table.size(); i++) {
+    const IndexSection& entry = table[i];
+    if(entry.begin != previousEnd || entry.end < entry.begin ||
+      entry.group < 0 || uint32_t(entry.group) >= header.groupCount ||
+      entry.material < -1 || entry.material >= int64_t(header.materialCount)) {
+      return false;
+    }
+    previousEnd = entry.end;
+    OBJSection& section = result.sections[i];
+    section.begin = size_t(entry.begin);
+    section.end = size_t(entry.end);
+    section.group = entry.group;
+    section.material = entry.material;
+    section.positionBase = entry.positionBase;
+    section.normalBase = entry.normalBase;
+    section.texCoordBase = entry.texCoordBase;
+    section.triBase = entry.triBase;
+    section.positionCount = entry.positionCount;
+    section.normalCount = entry.normalCount;
+    section.texCoordCount = entry.texCoordCount;
+    section.triCount = entry.triCount;
+  }
+  if(previousEnd != sourceSize) {
+    return false;
+  }
+  
+  size_t offset = sizeof(IndexHeader) + tableSize;
+  size_t next = 0;
+  bool valid = true;
+  const auto readString = [&]() {
+    const uint32_t length = lengths[next++];
+    if(!valid || length > file.getSize() - offset) {
+      valid = false;
+      return string();
+    }
+    offset += length;
+    return string(data + offset - length, length);
+  };
+  result.groups.resize(header.groupCount);
+  for(size_t i = 0; i < result.groups.size(); i++) {
+    result.groups[i].name = readString();
+    result.groups[i].object = readString();
+  }
+  result.materials.resize(header.materialCount);
+  for(size_t i = 0; i < result.materials.size(); i++) {
+    result.materials[i] = readString();
+  }
+  result.materialLibraries.resize(header.libraryCount);
+  for(size_t i = 0; i < result.materialLibraries.size(); i++) {
+    result.materialLibraries[i] = readString();
+  }
+  if(!valid || offset != file.getSize()) {
+    return false;
+  }
+  index.sections.swap(result.sections);
+  index.groups.swap(result.groups);
+  index.materials.swap(result.materials);
+  index.materialLibraries.swap(result.materialLibraries);
+  return true;
+}
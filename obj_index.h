@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "group.h"
+
+// A run of lines of an OBJ file that can be parsed on its own: everything
+// a parser would know when it gets to the first line is here. Sections end
+// at g and o lines, at usemtl lines after faces and every so many vertex
+// and face lines, so that one never gets big.
+struct OBJSection {
+  // Byte offsets into the file
+  size_t begin;
+  size_t end;
+  // Into the group and material tables of the index, material -1 before
+  // the first usemtl
+  int group;
+  int material;
+  // Values and tris before the section and in it
+  int positionBase;
+  int normalBase;
+  int texCoordBase;
+  int triBase;
+  int positionCount;
+  int normalCount;
+  int texCoordCount;
+  int triCount;
+  
+  OBJSection() : begin(0), end(0), group(0), material(-1), positionBase(0), normalBase(0),
+    texCoordBase(0), triBase(0), positionCount(0), normalCount(0), texCoordCount(0),
+    triCount(0) {
+  }
+};
+
+// The sections of a file, first to last, with the names they refer to.
+// Group 0 is the one without names, the group of the start of the file.
+struct OBJIndex {
+  std::vector<OBJSection> sections;
+  std::vector<Geometry::Group> groups;
+  std::vector<std::string> materials;
+  // Of every mtllib line of the file
+  std::vector<std::string> materialLibraries;
+};
+
+// The sidecar loadFromOBJFile keeps the index of an OBJ file in. Like a
+// mesh cache (mesh_cache.h), it is tied to the file by its size and
+// modification time, native endian and checksummed.
+std::string getOBJIndexFilename(const std::string& sourceFilename);
+
+// Writes the index through a temporary file. False if it cannot be written.
+bool saveOBJIndex(const std::string& indexFilename, const OBJIndex& index,
+  const std::string& sourceFilename);
+
+// False, with the index untouched, if there is no sidecar or if it is
+// stale, from another version or corrupt
+bool loadOBJIndex(const std::string& indexFilename, OBJIndex& index,
+  const std::string& sourceFilename);
@@ -1,143 +1,565 @@
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
 #include <string>
+#include <vector>
 #include "obj_common.h"
 #include "mex.h"
 
 using namespace Geometry;
 using namespace std;
 
-// The gateway function
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
-  // Only 1 input allowed
-  if (nrhs != 1) {
-    mexErrMsgIdAndTxt("MATLAB:obj_read:invalidNumInputs", 
-      "Specify filename.");
+static mxClassID getClassID(const OBJScalarType type) {
+  switch (type) {
+    case OBJ_SINGLE:
+      return mxSINGLE_CLASS;
+    case OBJ_INT32:
+      return mxINT32_CLASS;
+    case OBJ_UINT32:
+      return mxUINT32_CLASS;
+    default:
+      return mxDOUBLE_CLASS;
   }
-  // input must be a string
-  if (mxIsChar(prhs[0]) != 1) {
-    mexErrMsgIdAndTxt("MATLAB:obj_read:inputNotString",
-      "Input must be a string.");
+}
+
+// Indices into other fields, as opposed to coordinates
+static bool isIndexField(const string& name) {
+  return name == "MaterialId" || name == "Group" || name.find("Tri") != string::npos;
+}
+
+// "Normal Tri" is set as options.NormalTri
+static string getOptionName(const string& fieldName) {
+  string optionName;
+  for (size_t i = 0; i < fieldName.size(); i++) {
+    if (fieldName[i] != ' ') {
+      optionName += fieldName[i];
+    }
   }
-  // copy the string data from prhs[0] into a C string input_ buf.
-  char *filename = mxArrayToString(prhs[0]);
-  if (filename == NULL) {
-    mexErrMsgIdAndTxt("MATLAB:obj_read:conversionFailed",
-      "Could not convert input to string.");
+  return optionName;
+}
+
+// What the options struct of obj_read(filename, options) asks for:
+//
+//   Class       class of every field: 'double' (the default), 'single',
+//               'int32' or 'uint32'; coordinates can only be floating point
+//   IndexClass  class of the index fields (Tri, Normal Tri, TexCoord Tri,
+//               MaterialId, Group), overrides Class
+//   Position, Tri, NormalTri, ...
+//               class of that one field, overrides both
+//   OneBased    true for indices that start at 1, as MATLAB indexing does.
+//               Missing indices become 0 then, and so does the MaterialId of
+//               faces before the first usemtl.
+//   Groups      a name or a cell array of names: only load the tris of
+//               these groups and objects (g and o lines)
+//   Tris        [first last]: only load these tris of the file (of the
+//               groups if there are any), counted like the Tri indices
+//
+// Missing indices are -1 otherwise, which is 4294967295 as uint32.
+struct ReadOptions {
+  ReadOptions() : hasClass(false), hasIndexClass(false), oneBased(false), hasTris(false),
+    firstTri(0), lastTri(0) {
   }
-  // Only 1 input allowed
-  if (nlhs != 1) {
-    mexErrMsgIdAndTxt("MATLAB:obj_read:invalidNumOutputs", 
-      "One output is required");
-  }
-  
-  Mesh* mesh = new Mesh();
-  loadFromOBJFile(filename, mesh);
-  
-  int num_fields = (int)mesh->getChannels().size();
-  
-  const char** field_names;  // Field names for the return struct
-  field_names = (const char**)mxCalloc(num_fields, sizeof(*field_names));
-  
-  for (int i = 0; i < num_fields; i++) {
-	  const Channel* const channel = mesh->getChannels()[i];
-    field_names[i] = channel->getName().c_str();
-  }
-  
-  plhs[0] = mxCreateStructMatrix(1, 1, num_fields, field_names);
-  
-  for (int ifield = 0; ifield < num_fields; ifield++) {
-    const Channel* const channel = mesh->getChannels()[ifield];
-    const int channelMemoryUsage = channel->getMemoryUsage();
-    const int size = channel->getSize();
-    
-    // We don't know what kind of channel it is so just try them all :-(
-    const IntChannel* const intChannel = dynamic_cast<const IntChannel*>(channel);
-    const FloatChannel* const floatChannel = dynamic_cast<const FloatChannel*>(channel);
-    const Vec2fChannel* const vec2fChannel = dynamic_cast<const Vec2fChannel*>(channel);
-    const Vec3fChannel* const vec3fChannel = dynamic_cast<const Vec3fChannel*>(channel);
-    const Vec4fChannel* const vec4fChannel = dynamic_cast<const Vec4fChannel*>(channel);
-    const EdgeChannel* const edgeChannel = dynamic_cast<const EdgeChannel*>(channel);
-    const TriChannel* const triChannel = dynamic_cast<const TriChannel*>(channel);
-    const TetraChannel* const tetraChannel = dynamic_cast<const TetraChannel*>(channel);
-    
-    int dims = 0;
-    if (intChannel) {
-      dims = 1;
-    } else if (floatChannel) {
-      dims = 1;
-    } else if (vec2fChannel) {
-      dims = 2;
-    } else if (vec3fChannel) {
-      dims = 3;
-    } else if (vec4fChannel) {
-      dims = 4;
-    } else if (edgeChannel) {
-      dims = 2;
-    } else if (triChannel) {
-      dims = 3;
-    } else if (tetraChannel) {
-      dims = 4;
-    }
-    
-    // Make all the return values doubles (even indices)
-    mxArray* fout = mxCreateDoubleMatrix(dims, size, mxREAL);
-    double* fout_data = mxGetPr(fout);
-    mxSetFieldByNumber(plhs[0], 0, ifield, fout);
-    
-    if (intChannel) {
-      const std::vector<int>& values = intChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i] = static_cast<double>(values[i]);
+
+  bool hasClass;
+  OBJScalarType valueClass;
+  bool hasIndexClass;
+  OBJScalarType indexClass;
+  map<string, OBJScalarType> fieldClasses;
+  bool oneBased;
+  vector<string> groups;
+  bool hasTris;
+  double firstTri;
+  double lastTri;
+
+  OBJScalarType getFieldClass(const string& name) const {
+    const map<string, OBJScalarType>::const_iterator search =
+      fieldClasses.find(getOptionName(name));
+    if (search != fieldClasses.end()) {
+      return search->second;
+    }
+    if (hasIndexClass && isIndexField(name)) {
+      return indexClass;
+    }
+    return hasClass ? valueClass : OBJ_DOUBLE;
+  }
+};
+
+static OBJScalarType parseClass(const mxArray* const value, const char* const option) {
+  char* const className = mxIsChar(value) ? mxArrayToString(value) : NULL;
+  const string name = className ? className : "";
+  mxFree(className);
+  if (name == "double") {
+    return OBJ_DOUBLE;
+  } else if (name == "single") {
+    return OBJ_SINGLE;
+  } else if (name == "int32") {
+    return OBJ_INT32;
+  } else if (name == "uint32") {
+    return OBJ_UINT32;
+  }
+  mexErrMsgIdAndTxt("MATLAB:obj_read:invalidClass",
+    "options.%s must be 'double', 'single', 'int32' or 'uint32'.", option);
+  return OBJ_DOUBLE;
+}
+
+// A string or a cell array of them
+static vector<string> parseNames(const mxArray* const value, const char* const option) {
+  vector<string> names;
+  const bool isCell = mxIsCell(value);
+  const size_t count = isCell ? mxGetNumberOfElements(value) : 1;
+  for (size_t i = 0; i < count; i++) {
+    const mxArray* const cell = isCell ? mxGetCell(value, i) : value;
+    char* const name = cell && mxIsChar(cell) ? mxArrayToString(cell) : NULL;
+    if (!name) {
+      mexErrMsgIdAndTxt("MATLAB:obj_read:invalidNames",
+        "options.%s must be a string or a cell array of strings.", option);
+    }
+    names.push_back(name);
+    mxFree(name);
+  }
+  return names;
+}
+
+static ReadOptions parseOptions(const mxArray* const options) {
+  if (!mxIsStruct(options) || mxGetNumberOfElements(options) != 1) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:optionsNotStruct",
+      "Options must be a scalar struct.");
+  }
+  const char* const fieldNames[] = { "Position", "Tri", "Normal", "Normal Tri",
+    "TexCoord", "TexCoord Tri", "MaterialId", "Group" };
+  const int fieldCount = sizeof(fieldNames) / sizeof(fieldNames[0]);
+
+  ReadOptions result;
+  for (int i = 0; i < mxGetNumberOfFields(options); i++) {
+    const char* const option = mxGetFieldNameByNumber(options, i);
+    const mxArray* const value = mxGetFieldByNumber(options, 0, i);
+    if (!strcmp(option, "Class")) {
+      result.hasClass = true;
+      result.valueClass = parseClass(value, option);
+    } else if (!strcmp(option, "IndexClass")) {
+      result.hasIndexClass = true;
+      result.indexClass = parseClass(value, option);
+    } else if (!strcmp(option, "OneBased")) {
+      if (!(mxIsLogical(value) || mxIsNumeric(value)) || mxGetNumberOfElements(value) != 1) {
+        mexErrMsgIdAndTxt("MATLAB:obj_read:invalidOneBased",
+          "options.OneBased must be true or false.");
       }
-    } else if (floatChannel) {
-      const std::vector<float>& values = floatChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i] = static_cast<double>(values[i]);
+      result.oneBased = mxGetScalar(value) != 0;
+    } else if (!strcmp(option, "Groups")) {
+      result.groups = parseNames(value, option);
+    } else if (!strcmp(option, "Tris")) {
+      if (mxGetClassID(value) != mxDOUBLE_CLASS || mxGetNumberOfElements(value) != 2) {
+        mexErrMsgIdAndTxt("MATLAB:obj_read:invalidTris",
+          "options.Tris must be [first last].");
       }
-    } else if (vec2fChannel) {
-      const std::vector<Vec2f>& values = vec2fChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*2+0] = static_cast<double>(values[i].x);
-        fout_data[i*2+1] = static_cast<double>(values[i].y);
+      result.hasTris = true;
+      result.firstTri = mxGetPr(value)[0];
+      result.lastTri = mxGetPr(value)[1];
+    } else {
+      int field = 0;
+      while (field < fieldCount && getOptionName(fieldNames[field]) != option) {
+        field++;
       }
-    } else if (vec3fChannel) {
-      const std::vector<Vec3f>& values = vec3fChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*3+0] = static_cast<double>(values[i].x);
-        fout_data[i*3+1] = static_cast<double>(values[i].y);
-        fout_data[i*3+2] = static_cast<double>(values[i].z);
+      if (field == fieldCount) {
+        mexErrMsgIdAndTxt("MATLAB:obj_read:unknownOption",
+          "Unknown option '%s'.", option);
+      }
+      result.fieldClasses[option] = parseClass(value, option);
+    }
+  }
+
+  // Coordinates would be truncated (or worse) as integers
+  for (int field = 0; field < fieldCount; field++) {
+    const OBJScalarType type = result.getFieldClass(fieldNames[field]);
+    if (!isIndexField(fieldNames[field]) && type != OBJ_DOUBLE && type != OBJ_SINGLE) {
+      mexErrMsgIdAndTxt("MATLAB:obj_read:invalidClass",
+        "%s can only be 'double' or 'single'.", fieldNames[field]);
+    }
+  }
+  return result;
+}
+
+// What the options ask of the loader. Tris are counted from 0 there, and
+// an empty range has to stay empty.
+static OBJLoadOptions getLoadOptions(const ReadOptions& options) {
+  OBJLoadOptions loadOptions;
+  loadOptions.groups = options.groups;
+  if (options.hasTris) {
+    const double base = options.oneBased ? 1 : 0;
+    const double limit = 2147483647.0;
+    loadOptions.triBegin = int(max(0.0, min(options.firstTri - base, limit)));
+    loadOptions.triEnd = int(max(0.0, min(options.lastTri - base + 1, limit)));
+  }
+  return loadOptions;
+}
+
+static mxArray* createVector(const Vec3f& value) {
+  mxArray* const vector = mxCreateDoubleMatrix(1, 3, mxREAL);
+  for (int i = 0; i < 3; i++) {
+    mxGetPr(vector)[i] = value[i];
+  }
+  return vector;
+}
+
+// The group table as a 1 x n struct array with the Name (of the g line)
+// and Object (of the o line) of the run of tris Group(i) starts
+static mxArray* createGroupArray(const vector<Group>& groups) {
+  const char* const field_names[] = { "Name", "Object" };
+  mxArray* const result = mxCreateStructMatrix(1, groups.size(), 2,
+    const_cast<const char**>(field_names));
+  for (size_t i = 0; i < groups.size(); i++) {
+    mxSetFieldByNumber(result, i, 0, mxCreateString(groups[i].name.c_str()));
+    mxSetFieldByNumber(result, i, 1, mxCreateString(groups[i].object.c_str()));
+  }
+  return result;
+}
+
+static double getSeconds() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The profiling counters of the loads as an m x n struct array, one element
+// per file. outputSeconds is the time taken to turn each result into arrays.
+static mxArray* createStatsArray(const vector<OBJLoadStats>& stats,
+  const vector<double>& outputSeconds, const size_t m, const size_t n) {
+  const char* const field_names[] = { "OpenSeconds", "CacheSeconds", "IndexSeconds",
+    "CountSeconds", "ParseSeconds", "MaterialSeconds", "BuildSeconds",
+    "ConvertSeconds", "CacheWriteSeconds", "LoadSeconds", "OutputSeconds",
+    "BytesRead", "PositionLines", "NormalLines", "TexCoordLines", "FaceLines",
+    "OtherLines", "Tokens", "Allocations", "OutputBytes", "FromCache" };
+  const int num_fields = sizeof(field_names) / sizeof(field_names[0]);
+  mxArray* const result = mxCreateStructMatrix(m, n, num_fields,
+    const_cast<const char**>(field_names));
+  for (size_t i = 0; i < stats.size(); i++) {
+    const OBJLoadStats& file = stats[i];
+    const double values[] = { file.openSeconds, file.cacheSeconds, file.indexSeconds,
+      file.countSeconds, file.parseSeconds, file.materialSeconds, file.buildSeconds,
+      file.convertSeconds, file.cacheWriteSeconds, file.totalSeconds, outputSeconds[i],
+      double(file.bytesRead), double(file.positionLines), double(file.normalLines),
+      double(file.texCoordLines), double(file.faceLines), double(file.otherLines),
+      double(file.tokens), double(file.allocations), double(file.outputBytes) };
+    for (int j = 0; j < num_fields - 1; j++) {
+      mxSetFieldByNumber(result, i, j, mxCreateDoubleScalar(values[j]));
+    }
+    mxSetFieldByNumber(result, i, num_fields - 1, mxCreateLogicalScalar(file.fromCache));
+  }
+  return result;
+}
+
+// The material table as a 1 x n struct array, material i for MaterialId i
+// (i + 1 when one-based)
+static mxArray* createMaterialArray(const vector<Material>& materials) {
+  const char* const field_names[] = { "Name", "Ambient", "Diffuse", "Specular",
+    "Shininess", "Opacity", "AmbientMap", "DiffuseMap", "SpecularMap",
+    "ShininessMap", "OpacityMap", "BumpMap" };
+  const int num_fields = sizeof(field_names) / sizeof(field_names[0]);
+  mxArray* const result = mxCreateStructMatrix(1, materials.size(), num_fields,
+    const_cast<const char**>(field_names));
+  for (size_t i = 0; i < materials.size(); i++) {
+    const Material& material = materials[i];
+    const string* const strings[] = { &material.ambientMap, &material.diffuseMap,
+      &material.specularMap, &material.shininessMap, &material.opacityMap, &material.bumpMap };
+    mxSetFieldByNumber(result, i, 0, mxCreateString(material.name.c_str()));
+    mxSetFieldByNumber(result, i, 1, createVector(material.ambient));
+    mxSetFieldByNumber(result, i, 2, createVector(material.diffuse));
+    mxSetFieldByNumber(result, i, 3, createVector(material.specular));
+    mxSetFieldByNumber(result, i, 4, mxCreateDoubleScalar(material.shininess));
+    mxSetFieldByNumber(result, i, 5, mxCreateDoubleScalar(material.opacity));
+    for (int j = 0; j < 6; j++) {
+      mxSetFieldByNumber(result, i, 6 + j, mxCreateString(strings[j]->c_str()));
+    }
+  }
+  return result;
+}
+
+// Asks the options for the class and index base of every field
+class OptionsFieldSink : public OBJFieldSink {
+ public:
+  explicit OptionsFieldSink(const ReadOptions& options) : options(options) {
+  }
+
+  virtual OBJScalarType getFieldType(const string& name,
+    const OBJScalarType /* nativeType */) override {
+    return options.getFieldClass(name);
+  }
+
+  virtual int getIndexBase(const string& /* name */) override {
+    return options.oneBased ? 1 : 0;
+  }
+
+  virtual void setMaterials(const vector<Material>& materials) override {
+    this->materials = materials;
+  }
+
+  const vector<Material>& getMaterials() const {
+    return materials;
+  }
+
+  virtual void setGroups(const vector<Group>& groups) override {
+    this->groups = groups;
+  }
+
+  const vector<Group>& getGroups() const {
+    return groups;
+  }
+
+ private:
+  const ReadOptions& options;
+  vector<Material> materials;
+  vector<Group> groups;
+};
+
+// Creates a field of the returned struct whenever the loader asks for one,
+// the loader then parses straight into it. One allocation and one pass per
+// field, no mesh in between.
+class StructFieldSink : public OptionsFieldSink {
+ public:
+  explicit StructFieldSink(const ReadOptions& options) : OptionsFieldSink(options) {
+  }
+
+  ~StructFieldSink() {
+    // Only left if the load failed
+    for (size_t i = 0; i < fields.size(); i++) {
+      mxDestroyArray(fields[i]);
+    }
+  }
+
+  virtual void* allocateField(const string& name, const OBJScalarType type,
+    const int componentCount, const int valueCount) override {
+    mxArray* const field = mxCreateNumericMatrix(componentCount, valueCount,
+      getClassID(type), mxREAL);
+    names.push_back(name);
+    fields.push_back(field);
+    return mxGetData(field);
+  }
+
+  // Hands the fields over to a new struct
+  mxArray* createStruct() {
+    const int num_fields = (int)fields.size();
+    vector<const char*> field_names(num_fields);
+    for (int i = 0; i < num_fields; i++) {
+      field_names[i] = names[i].c_str();
+    }
+    mxArray* const result = mxCreateStructMatrix(1, 1, num_fields,
+      num_fields ? &field_names[0] : NULL);
+    for (int ifield = 0; ifield < num_fields; ifield++) {
+      mxSetFieldByNumber(result, 0, ifield, fields[ifield]);
+    }
+    fields.clear();
+    return result;
+  }
+
+ private:
+  vector<string> names;
+  vector<mxArray*> fields;
+};
+
+// Keeps the fields of one file of a batch in plain memory: the loading
+// threads must not call the MEX API. The arrays are made afterwards, on
+// MATLAB's thread.
+class BufferFieldSink : public OptionsFieldSink {
+ public:
+  struct Field {
+    string name;
+    OBJScalarType type;
+    int componentCount;
+    int valueCount;
+    vector<char> data;
+  };
+
+  explicit BufferFieldSink(const ReadOptions& options) : OptionsFieldSink(options) {
+  }
+
+  virtual void* allocateField(const string& name, const OBJScalarType type,
+    const int componentCount, const int valueCount) override {
+    const size_t valueSize = type == OBJ_DOUBLE ? sizeof(double) : 4;
+    fields.push_back(Field());
+    Field& field = fields.back();
+    field.name = name;
+    field.type = type;
+    field.componentCount = componentCount;
+    field.valueCount = valueCount;
+    // Moving a Field keeps its data where it is
+    field.data.resize(valueSize * componentCount * valueCount);
+    return field.data.empty() ? NULL : &field.data[0];
+  }
+
+  const vector<Field>& getFields() const {
+    return fields;
+  }
+
+ private:
+  vector<Field> fields;
+};
+
+// Files loaded at a time, so that only their fields are held twice
+static const size_t batchSize = 256;
+
+// obj_read({filename, ...}, options): a struct array the shape of the cell
+// array, element i from file i. Its fields are those of every file, in the
+// order they first turn up, [] where a file has none, and Error: '' or why
+// the file could not be loaded. A file that fails does not stop the others.
+// The material and group tables go into cell arrays of the same shape, []
+// for files that failed, and the profiling counters into a struct array.
+static mxArray* readFiles(const mxArray* const filenames, const ReadOptions& options,
+  mxArray** const materialTables, mxArray** const groupTables,
+  mxArray** const statsArray) {
+  const size_t fileCount = mxGetNumberOfElements(filenames);
+  vector<string> names(fileCount);
+  vector<string> errors(fileCount);
+  for (size_t i = 0; i < fileCount; i++) {
+    const mxArray* const cell = mxGetCell(filenames, i);
+    char* const filename = cell && mxIsChar(cell) ? mxArrayToString(cell) : NULL;
+    if (filename) {
+      names[i] = filename;
+    } else {
+      errors[i] = "Filename must be a string.";
+    }
+    mxFree(filename);
+  }
+
+  vector<string> fieldNames;
+  map<string, size_t> fieldNumbers;
+  vector<vector<pair<size_t, mxArray*> > > fileFields(fileCount);
+  if (materialTables) {
+    *materialTables = mxCreateCellMatrix(mxGetM(filenames), mxGetN(filenames));
+  }
+  if (groupTables) {
+    *groupTables = mxCreateCellMatrix(mxGetM(filenames), mxGetN(filenames));
+  }
+  vector<OBJLoadStats> stats(fileCount);
+  vector<double> outputSeconds(fileCount);
+  OBJLoadOptions loadOptions = getLoadOptions(options);
+  for (size_t begin = 0; begin < fileCount; begin += batchSize) {
+    const size_t end = min(begin + batchSize, fileCount);
+    vector<size_t> files;
+    vector<string> batchNames;
+    for (size_t i = begin; i < end; i++) {
+      if (errors[i].empty()) {
+        files.push_back(i);
+        batchNames.push_back(names[i]);
       }
-    } else if (vec4fChannel) {
-      const std::vector<Vec4f>& values = vec4fChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*4+0] = static_cast<double>(values[i].x);
-        fout_data[i*4+1] = static_cast<double>(values[i].y);
-        fout_data[i*4+2] = static_cast<double>(values[i].z);
-        fout_data[i*4+3] = static_cast<double>(values[i].w);
+    }
+    vector<BufferFieldSink> sinks(files.size(), BufferFieldSink(options));
+    vector<OBJFieldSink*> sinkPointers(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+      sinkPointers[i] = &sinks[i];
+    }
+    vector<OBJLoadStats> batchStats(files.size());
+    loadOptions.stats = statsArray && !files.empty() ? &batchStats[0] : NULL;
+    const vector<string> batchErrors = loadFromOBJFiles(batchNames, sinkPointers,
+      loadOptions);
+
+    for (size_t i = 0; i < files.size(); i++) {
+      const size_t file = files[i];
+      errors[file] = batchErrors[i];
+      stats[file] = batchStats[i];
+      if (!errors[file].empty()) {
+        continue;
       }
-    } else if (edgeChannel) {
-      const std::vector<Edge>& values = edgeChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*2+0] = static_cast<double>(values[i].indices[0]);
-        fout_data[i*2+1] = static_cast<double>(values[i].indices[1]);
+      const double outputStart = getSeconds();
+      if (materialTables) {
+        mxSetCell(*materialTables, file, createMaterialArray(sinks[i].getMaterials()));
       }
-    } else if (triChannel) {
-      const std::vector<Tri>& values = triChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*3+0] = static_cast<double>(values[i].indices[0]);
-        fout_data[i*3+1] = static_cast<double>(values[i].indices[1]);
-        fout_data[i*3+2] = static_cast<double>(values[i].indices[2]);
+      if (groupTables) {
+        mxSetCell(*groupTables, file, createGroupArray(sinks[i].getGroups()));
       }
-    } else if (tetraChannel) {
-      const std::vector<Tetra>& values = tetraChannel->getValues();
-      for (int i = 0; i < size; i++) {
-        fout_data[i*4+0] = static_cast<double>(values[i].indices[0]);
-        fout_data[i*4+1] = static_cast<double>(values[i].indices[1]);
-        fout_data[i*4+2] = static_cast<double>(values[i].indices[2]);
-        fout_data[i*4+3] = static_cast<double>(values[i].indices[3]);
+      const vector<BufferFieldSink::Field>& fields = sinks[i].getFields();
+      for (size_t j = 0; j < fields.size(); j++) {
+        const BufferFieldSink::Field& field = fields[j];
+        if (!fieldNumbers.count(field.name)) {
+          fieldNumbers[field.name] = fieldNames.size();
+          fieldNames.push_back(field.name);
+        }
+        mxArray* const array = mxCreateNumericMatrix(field.componentCount,
+          field.valueCount, getClassID(field.type), mxREAL);
+        if (!field.data.empty()) {
+          memcpy(mxGetData(array), &field.data[0], field.data.size());
+        }
+        fileFields[file].push_back(make_pair(fieldNumbers[field.name], array));
       }
+      outputSeconds[file] = getSeconds() - outputStart;
+    }
+  }
+  if (statsArray) {
+    *statsArray = createStatsArray(stats, outputSeconds, mxGetM(filenames),
+      mxGetN(filenames));
+  }
+
+  fieldNames.push_back("Error");
+  vector<const char*> field_names(fieldNames.size());
+  for (size_t i = 0; i < fieldNames.size(); i++) {
+    field_names[i] = fieldNames[i].c_str();
+  }
+  mxArray* const result = mxCreateStructMatrix(mxGetM(filenames), mxGetN(filenames),
+    (int)field_names.size(), &field_names[0]);
+  for (size_t i = 0; i < fileCount; i++) {
+    for (size_t j = 0; j < fileFields[i].size(); j++) {
+      mxSetFieldByNumber(result, i, (int)fileFields[i][j].first, fileFields[i][j].second);
     }
+    mxSetFieldByNumber(result, i, (int)fieldNames.size() - 1,
+      mxCreateString(errors[i].c_str()));
+  }
+  return result;
+}
+
+// The gateway function
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+  // The filename, or a cell array of them, and optionally options
+  if (nrhs != 1 && nrhs != 2) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:invalidNumInputs",
+      "Specify filename and optionally options.");
+  }
+  // input must be a string
+  if (mxIsChar(prhs[0]) != 1 && !mxIsCell(prhs[0])) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:inputNotString",
+      "Input must be a string or a cell array of strings.");
+  }
+  const ReadOptions options = nrhs > 1 ? parseOptions(prhs[1]) : ReadOptions();
+  // The mesh and optionally its material and group tables and the profiling
+  // counters of the load
+  if (nlhs < 1 || nlhs > 4) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:invalidNumOutputs",
+      "One to four outputs are required");
+  }
+  if (mxIsCell(prhs[0])) {
+    plhs[0] = readFiles(prhs[0], options, nlhs > 1 ? &plhs[1] : NULL,
+      nlhs > 2 ? &plhs[2] : NULL, nlhs > 3 ? &plhs[3] : NULL);
+    return;
+  }
+  // copy the string data from prhs[0] into a C string input_ buf.
+  char *filename = mxArrayToString(prhs[0]);
+  if (filename == NULL) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:conversionFailed",
+      "Could not convert input to string.");
+  }
+  StructFieldSink sink(options);
+  vector<OBJLoadStats> stats(1);
+  OBJLoadOptions loadOptions = getLoadOptions(options);
+  loadOptions.stats = nlhs > 3 ? &stats[0] : NULL;
+  string error;
+  try {
+    loadFromOBJFile(filename, sink, loadOptions);
+  } catch (const exception& e) {
+    error = e.what();
+  }
+  mxFree(filename);
+  if (!error.empty()) {
+    mexErrMsgIdAndTxt("MATLAB:obj_read:loadFailed", "%s", error.c_str());
+  }
+
+  const double outputStart = getSeconds();
+  plhs[0] = sink.createStruct();
+  if (nlhs > 1) {
+    plhs[1] = createMaterialArray(sink.getMaterials());
+  }
+  if (nlhs > 2) {
+    plhs[2] = createGroupArray(sink.getGroups());
+  }
+  if (nlhs > 3) {
+    const vector<double> outputSeconds(1, getSeconds() - outputStart);
+    plhs[3] = createStatsArray(stats, outputSeconds, 1, 1);
   }
-  
-  mxFree((void *)field_names);
-}
\ No newline at end of file
+}
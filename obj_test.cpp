@@ -0,0 +1,501 @@
+// Standalone tests of the mesh and the OBJ loader, no MATLAB needed:
+//
+//   g++ -g -std=c++11 -pthread -fsanitize=address -I. obj_test.cpp obj_common.cpp obj_index.cpp number_scanner.cpp mesh_cache.cpp channel_convert.cpp mesh_weld.cpp decoding_reader.cpp number_formatter.cpp -o obj_test
+//
+// Built with -fsanitize=address, memory errors fail a test too.
+//
+//   ./obj_test
+//
+// Prints "name ok" or "name FAILED" for every test and exits with 1 if any
+// failed. Writes its files to the working directory and deletes them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "obj_common.h"
+
+using namespace Geometry;
+using namespace std;
+
+// Bytes held through operator new, which is where channels without an
+// arena keep their values, and the most held since resetPeakHeapBytes()
+static size_t heapBytes = 0;
+static size_t peakHeapBytes = 0;
+
+enum { heapHeaderSize = 16 };
+
+// Not inlined, so that the compiler does not pair the malloc() and free()
+// in them with the new and delete of the callers
+#ifdef __GNUC__
+#define NOT_INLINED __attribute__((noinline))
+#else
+#define NOT_INLINED
+#endif
+
+NOT_INLINED void* operator new(const size_t size) {
+  char* const block = static_cast<char*>(malloc(heapHeaderSize + size));
+  if(!block) {
+    throw bad_alloc();
+  }
+  *reinterpret_cast<size_t*>(block) = size;
+  heapBytes += size;
+  peakHeapBytes = heapBytes > peakHeapBytes ? heapBytes : peakHeapBytes;
+  return block + heapHeaderSize;
+}
+
+NOT_INLINED void operator delete(void* const data) noexcept {
+  if(data) {
+    char* const block = static_cast<char*>(data) - heapHeaderSize;
+    heapBytes -= *reinterpret_cast<size_t*>(block);
+    free(block);
+  }
+}
+
+static void resetPeakHeapBytes() {
+  peakHeapBytes = heapBytes;
+}
+
+// size positions and the tris over them, realized on each other
+static void fillMesh(Mesh* const mesh, const int size) {
+  Vec3fChannel* const positions = new Vec3fChannel("Position", mesh);
+  TriChannel* const tris = new TriChannel("Tri", mesh);
+  for(int i = 0; i < size; i++) {
+    positions->add(Vec3f(float(i), float(i), float(i)));
+  }
+  for(int i = 0; i + 2 < size; i += 3) {
+    tris->add(Tri(i, i + 1, i + 2));
+  }
+  mesh->addChannel(positions);
+  mesh->addChannel(tris);
+  mesh->addRealization(positions, tris);
+}
+
+static bool hasPosition(const Mesh& mesh, const int index, const float value) {
+  const Vec3fChannel* const positions =
+    static_cast<const Vec3fChannel*>(mesh.getChannelByName("Position"));
+  return positions->getAt(index)[0] == value;
+}
+
+// Counts how many were deleted
+class CountedChannel : public IntChannel {
+
+public:
+
+  static int deletedCount;
+
+  CountedChannel(const string& name, const Mesh* const owner) : IntChannel(name, owner) {
+  }
+
+  virtual ~CountedChannel() {
+    deletedCount++;
+  }
+};
+
+int CountedChannel::deletedCount = 0;
+
+// A channel taken out with removeChannel() keeps its values through the
+// mesh's clear(), which gives the arena back. Large enough for a block of
+// its own in the arena.
+static bool testRemovedChannelOutlivesClear() {
+  const int size = 100000;
+  Mesh mesh;
+  Vec3fChannel* const channel = new Vec3fChannel("Position", &mesh);
+  for(int i = 0; i < size; i++) {
+    channel->add(Vec3f(float(i), 0, 0));
+  }
+  mesh.addChannel(channel);
+  mesh.removeChannel(channel);
+  mesh.clear();
+  bool passed = channel->getSize() == size && !mesh.getChannelByName("Position");
+  for(int i = 0; passed && i < size; i++) {
+    passed = channel->getAt(i)[0] == float(i);
+  }
+  delete channel;
+  return passed;
+}
+
+// The same for small channels, which share arena blocks, and the SoA layout
+static bool testRemovedChannelsOutliveMesh() {
+  IntChannel* ints;
+  SoAVec3fChannel* points;
+  {
+    Mesh mesh;
+    ints = new IntChannel("MaterialId", &mesh);
+    points = new SoAVec3fChannel("Position", &mesh);
+    for(int i = 0; i < 10; i++) {
+      ints->add(i);
+      points->add(Vec3f(0, float(i), 0));
+    }
+    mesh.addChannel(ints);
+    mesh.addChannel(points);
+    mesh.addChannel(new IntChannel("Group", &mesh));
+    mesh.removeChannel(ints);
+    mesh.removeChannel(points);
+  }
+  bool passed = ints->getSize() == 10 && points->getSize() == 10;
+  for(int i = 0; passed && i < 10; i++) {
+    passed = ints->getAt(i) == i && points->getAt(i)[1] == float(i);
+  }
+  ints->add(10);
+  passed = passed && ints->getAt(10) == 10;
+  delete ints;
+  delete points;
+  return passed;
+}
+
+static const void* getPositionData(const Mesh& mesh) {
+  return mesh.getChannelByName("Position")->getRawData();
+}
+
+static const void* getTriData(const Mesh& mesh) {
+  return mesh.getChannelByName("Tri")->getRawData();
+}
+
+// An instance shares the values of the mesh until one of them writes to a
+// channel, which copies that one only. Looking channels up does not copy.
+static bool testInstanceWritesAreIsolated() {
+  Mesh mesh;
+  fillMesh(&mesh, 1000);
+  Mesh instance;
+  instance.makeInstanceOf(&mesh);
+  Channel* const positions = instance.getChannelByName("Position");
+  Channel* const tris = instance.getChannelByName("Tri");
+  instance.getChannels();
+  bool passed = positions->getOwner() == &instance && instance.getRealization(positions) == tris &&
+    getPositionData(instance) == getPositionData(mesh) && getTriData(instance) == getTriData(mesh);
+
+  static_cast<Vec3fChannel*>(positions)->setAt(0, Vec3f(-1, -1, -1));
+  const void* const meshPositions = getPositionData(mesh);
+  static_cast<Vec3fChannel*>(mesh.getChannelByName("Position"))->getValues()[1] = Vec3f(-2, -2, -2);
+  passed = passed && hasPosition(instance, 0, -1) && hasPosition(instance, 1, 1) &&
+    hasPosition(mesh, 0, 0) && hasPosition(mesh, 1, -2) &&
+    getPositionData(mesh) == meshPositions && getPositionData(instance) != meshPositions &&
+    getTriData(instance) == getTriData(mesh);
+
+  static_cast<TriChannel*>(mesh.getChannelByName("Tri"))->getValues()[0] = Tri(2, 1, 0);
+  return passed && getTriData(instance) != getTriData(mesh) &&
+    static_cast<const TriChannel*>(tris)->getAt(0)[0] == 0;
+}
+
+// Instances keep the values they share after the mesh they are an
+// instance of is cleared and gone, and write to them in place once no
+// other channel shares them
+static bool testInstancesOutliveMesh() {
+  const int size = 100000;
+  Mesh* const mesh = new Mesh();
+  fillMesh(mesh, size);
+  Mesh first;
+  Mesh second;
+  first.makeInstanceOf(mesh);
+  second.makeInstanceOf(&first);
+  mesh->clear();
+  delete mesh;
+  bool passed = true;
+  for(int i = 0; passed && i < size; i++) {
+    passed = hasPosition(first, i, float(i)) && hasPosition(second, i, float(i));
+  }
+  second.clear();
+  const void* const positions = getPositionData(first);
+  static_cast<Vec3fChannel*>(first.getChannelByName("Position"))->setAt(0, Vec3f(-1, -1, -1));
+  return passed && getPositionData(first) == positions && hasPosition(first, 0, -1);
+}
+
+// Meshes delete the instances they made, never the channels of the mesh
+// they are an instance of nor channels made without one. A removed
+// instance keeps its values.
+static bool testInstancesAreDeletedByTheirMesh() {
+  CountedChannel::deletedCount = 0;
+  Mesh* const mesh = new Mesh();
+  mesh->addChannel(new CountedChannel("MaterialId", mesh));
+  static_cast<IntChannel*>(mesh->getChannelByName("MaterialId"))->add(7);
+  Mesh first;
+  Mesh second;
+  first.makeInstanceOf(mesh);
+  second.makeInstanceOf(mesh);
+  first.clear();
+  bool passed = CountedChannel::deletedCount == 0;
+  delete mesh;
+  passed = passed && CountedChannel::deletedCount == 1;
+  IntChannel* const removed = static_cast<IntChannel*>(second.getChannelByName("MaterialId"));
+  second.removeChannel(removed);
+  second.clear();
+  passed = passed && removed->getSize() == 1 && removed->getAt(0) == 7;
+  delete removed;
+
+  Mesh other;
+  IntChannel unowned("Group", NULL);
+  unowned.add(1);
+  other.addChannel(&unowned);
+  first.makeInstanceOf(&other);
+  other.clear();
+  first.clear();
+  return passed && unowned.getSize() == 1 && unowned.getAt(0) == 1;
+}
+
+// Instances take no memory for the values they share, which stay in the
+// arena of the mesh. Writing copies only the channel written to, into the
+// arena of the instance.
+static bool testInstancesShareMemory() {
+  const int size = 1 << 20;
+  const int instanceCount = 10;
+  Mesh mesh;
+  fillMesh(&mesh, size);
+  const Mesh& constMesh = mesh;
+  const size_t positionBytes = size_t(constMesh.getChannelByName("Position")->getMemoryUsage());
+  const size_t meshBytes = positionBytes + size_t(constMesh.getChannelByName("Tri")->getMemoryUsage());
+  // Bookkeeping of the meshes and channels
+  const size_t slack = 1 << 20;
+  const size_t meshArenaBytes = mesh.getArenaBytes();
+  const void* const positions = getPositionData(mesh);
+  bool passed = meshArenaBytes >= meshBytes;
+
+  const size_t heapBefore = heapBytes;
+  resetPeakHeapBytes();
+  Mesh instances[instanceCount];
+  for(int i = 0; i < instanceCount; i++) {
+    instances[i].makeInstanceOf(&mesh);
+    instances[i].getChannels();
+    instances[i].getChannelByName("Position");
+  }
+  passed = passed && peakHeapBytes - heapBefore < slack &&
+    mesh.getArenaBytes() == meshArenaBytes && getPositionData(mesh) == positions;
+  for(int i = 0; passed && i < instanceCount; i++) {
+    passed = instances[i].getArenaBytes() == 0 && getPositionData(instances[i]) == positions;
+  }
+
+  resetPeakHeapBytes();
+  static_cast<Vec3fChannel*>(instances[0].getChannelByName("Position"))->setAt(0, Vec3f(-1, -1, -1));
+  passed = passed && peakHeapBytes - heapBytes < slack &&
+    instances[0].getArenaBytes() >= positionBytes &&
+    instances[0].getArenaBytes() < positionBytes + slack &&
+    getTriData(instances[0]) == getTriData(mesh) &&
+    mesh.getArenaBytes() == meshArenaBytes && getPositionData(mesh) == positions;
+  for(int i = 1; passed && i < instanceCount; i++) {
+    passed = instances[i].getArenaBytes() == 0;
+  }
+  return passed;
+}
+
+static void writeFile(const string& filename, const string& text) {
+  FILE* const file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    throw runtime_error("Cannot write '" + filename + "'");
+  }
+  const bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  if(fclose(file) != 0 || !written) {
+    throw runtime_error("Error writing '" + filename + "'");
+  }
+}
+
+static void loadWithoutCache(const string& filename, Mesh* const mesh) {
+  OBJLoadOptions options;
+  options.useCache = false;
+  loadFromOBJFile(filename, mesh, options);
+}
+
+// Same name, size and bits of every value, padding aside, and realized on
+// a channel of the same name
+static bool haveSameChannel(const Mesh& mesh, const Channel& channel, const Mesh& reference,
+  const Channel& expected) {
+  const ElementType& type = channel.getElementType();
+  const ElementType& expectedType = expected.getElementType();
+  if(channel.getName() != expected.getName() || channel.getSize() != expected.getSize() ||
+    type.scalarType != expectedType.scalarType ||
+    type.componentCount != expectedType.componentCount) {
+    return false;
+  }
+  const Channel* const realization = mesh.getRealization(&channel);
+  const Channel* const expectedRealization = reference.getRealization(&expected);
+  if(!realization != !expectedRealization ||
+    (realization && realization->getName() != expectedRealization->getName())) {
+    return false;
+  }
+  for(int j = 0; j < type.componentCount && channel.getSize(); j++) {
+    const char* const values = static_cast<const char*>(channel.getComponentData(j));
+    const char* const expectedValues = static_cast<const char*>(expected.getComponentData(j));
+    for(int i = 0; i < channel.getSize(); i++) {
+      if(memcmp(values + size_t(i) * type.stride,
+        expectedValues + size_t(i) * expectedType.stride, 4)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool haveSameMaterial(const Material& material, const Material& expected) {
+  return material.name == expected.name &&
+    !memcmp(&material.ambient, &expected.ambient, 3 * sizeof(float)) &&
+    !memcmp(&material.diffuse, &expected.diffuse, 3 * sizeof(float)) &&
+    !memcmp(&material.specular, &expected.specular, 3 * sizeof(float)) &&
+    !memcmp(&material.shininess, &expected.shininess, sizeof(float)) &&
+    !memcmp(&material.opacity, &expected.opacity, sizeof(float)) &&
+    material.ambientMap == expected.ambientMap && material.diffuseMap == expected.diffuseMap &&
+    material.specularMap == expected.specularMap &&
+    material.shininessMap == expected.shininessMap &&
+    material.opacityMap == expected.opacityMap && material.bumpMap == expected.bumpMap;
+}
+
+// Every channel in the same order and the material and group tables
+static bool haveSameMesh(const Mesh& mesh, const Mesh& reference) {
+  const vector<Channel*>& channels = mesh.getChannels();
+  const vector<Channel*>& expected = reference.getChannels();
+  bool same = channels.size() == expected.size() &&
+    mesh.getMaterials().size() == reference.getMaterials().size() &&
+    mesh.getGroups() == reference.getGroups();
+  for(size_t i = 0; same && i < channels.size(); i++) {
+    same = haveSameChannel(mesh, *channels[i], reference, *expected[i]);
+  }
+  for(size_t i = 0; same && i < mesh.getMaterials().size(); i++) {
+    same = haveSameMaterial(mesh.getMaterials()[i], reference.getMaterials()[i]);
+  }
+  return same;
+}
+
+// Loads the text as an OBJ file, saves the mesh and loads that again.
+// True if both loads give the same mesh, and the first one the expected
+// material names and MaterialId values (none for no MaterialId channel).
+static bool roundTrips(const string& text, const vector<string>& materialNames,
+  const vector<int>& materialIds, const bool writeMaterialLibrary = true) {
+  const string filename = "obj_test_input.obj";
+  const string savedFilename = "obj_test_saved.obj";
+  writeFile(filename, text);
+  Mesh mesh;
+  Mesh saved;
+  try {
+    loadWithoutCache(filename, &mesh);
+    OBJSaveOptions options;
+    options.writeMaterialLibrary = writeMaterialLibrary;
+    saveToOBJFile(savedFilename, mesh, options);
+    loadWithoutCache(savedFilename, &saved);
+  } catch(...) {
+    remove(filename.c_str());
+    remove(savedFilename.c_str());
+    remove("obj_test_saved.mtl");
+    throw;
+  }
+  remove(filename.c_str());
+  remove(savedFilename.c_str());
+  remove("obj_test_saved.mtl");
+
+  const ChannelReader<int> ids(static_cast<const Mesh&>(mesh).getChannelByName("MaterialId"));
+  bool passed = ids.getSize() == int(materialIds.size()) &&
+    mesh.getMaterials().size() == materialNames.size();
+  for(size_t i = 0; passed && i < materialIds.size(); i++) {
+    passed = ids.getAt(int(i)) == materialIds[i];
+  }
+  for(size_t i = 0; passed && i < materialNames.size(); i++) {
+    passed = mesh.getMaterials()[i].name == materialNames[i];
+  }
+  return passed && haveSameMesh(saved, mesh);
+}
+
+static const char* const triangle = "v 0 0 0\nv 1 0 0\nv 0 1 0\n";
+
+// Materials named by usemtl lines before any face keep their ids and
+// order, although no face uses the first
+static bool testMaterialsBeforeFacesRoundTrip() {
+  const string names[] = { "A", "B" };
+  const int ids[] = { 1, 1 };
+  return roundTrips(string("usemtl A\nusemtl B\n") + triangle + "f 1 2 3\nf 1 2 3\n",
+    vector<string>(names, names + 2), vector<int>(ids, ids + 2));
+}
+
+// Faces before the first usemtl line have no material, -1, and materials
+// used again go back to their first id
+static bool testMaterialRunsRoundTrip() {
+  const string names[] = { "B", "A" };
+  const int ids[] = { -1, 0, 1, 0, 0 };
+  return roundTrips(string(triangle) + "f 1 2 3\nusemtl B\nf 1 2 3\nusemtl A\nf 1 2 3\n"
+    "usemtl B\nf 1 2 3\ng part\nf 1 2 3\n",
+    vector<string>(names, names + 2), vector<int>(ids, ids + 5)) &&
+    roundTrips(string(triangle) + "f 1 2 3\nusemtl B\nusemtl A\n",
+      vector<string>(names, names + 2), vector<int>(1, -1));
+}
+
+// A single material gives no MaterialId channel, with or without the
+// material library. Materials of the library no face uses come after it,
+// in the order of the library.
+static bool testSingleMaterialRoundTrip() {
+  writeFile("obj_test_input.mtl", "newmtl A\nKd 1 0 0\nnewmtl B\nKd 0 1 0\n");
+  bool passed = false;
+  try {
+    const string usedFirst[] = { "B", "A" };
+    const string unused[] = { "A", "B" };
+    passed = roundTrips(string("mtllib obj_test_input.mtl\nusemtl B\n") + triangle +
+      "f 1 2 3\n", vector<string>(usedFirst, usedFirst + 2), vector<int>()) &&
+      roundTrips(string("mtllib obj_test_input.mtl\n") + triangle + "f 1 2 3\n",
+        vector<string>(unused, unused + 2), vector<int>());
+  } catch(...) {
+    remove("obj_test_input.mtl");
+    throw;
+  }
+  remove("obj_test_input.mtl");
+  return passed && roundTrips(string("usemtl A\n") + triangle + "f 1 2 3\nf 1 2 3\n",
+    vector<string>(1, "A"), vector<int>(), false);
+}
+
+static bool hasTri(const Mesh& mesh, const string& name, const int index, const int value) {
+  const TriChannel* const tris = static_cast<const TriChannel*>(mesh.getChannelByName(name));
+  return tris && tris->getSize() > index && tris->getAt(index)[0] == value &&
+    tris->getAt(index)[1] == value && tris->getAt(index)[2] == value;
+}
+
+// Faces without normal or texcoord indices get -1 for them next to faces
+// with them, not the first normal or texcoord. So does "v//vn" for the
+// texcoords. The writer leaves them out again.
+static bool testMixedFaceFormats() {
+  const string text = string(triangle) + "vt 0 0\nvn 0 0 1\n"
+    "f 1 2 3\nf 1/1/1 2/1/1 3/1/1\nf 1//1 2//1 3//1\nf 1/1 2/1 3/1\n";
+  const string filename = "obj_test_input.obj";
+  writeFile(filename, text);
+  Mesh mesh;
+  try {
+    loadWithoutCache(filename, &mesh);
+  } catch(...) {
+    remove(filename.c_str());
+    throw;
+  }
+  remove(filename.c_str());
+  return hasTri(mesh, "Normal Tri", 0, -1) && hasTri(mesh, "Normal Tri", 1, 0) &&
+    hasTri(mesh, "Normal Tri", 2, 0) && hasTri(mesh, "Normal Tri", 3, -1) &&
+    hasTri(mesh, "TexCoord Tri", 0, -1) && hasTri(mesh, "TexCoord Tri", 1, 0) &&
+    hasTri(mesh, "TexCoord Tri", 2, -1) && hasTri(mesh, "TexCoord Tri", 3, 0) &&
+    roundTrips(text, vector<string>(), vector<int>());
+}
+
+int main() {
+  struct Test {
+    const char* name;
+    bool (*run)();
+  };
+  const Test tests[] = {
+    { "removed_channel_outlives_clear", testRemovedChannelOutlivesClear },
+    { "removed_channels_outlive_mesh", testRemovedChannelsOutliveMesh },
+    { "instance_writes_are_isolated", testInstanceWritesAreIsolated },
+    { "instances_outlive_mesh", testInstancesOutliveMesh },
+    { "instances_are_deleted_by_their_mesh", testInstancesAreDeletedByTheirMesh },
+    { "instances_share_memory", testInstancesShareMemory },
+    { "materials_before_faces_round_trip", testMaterialsBeforeFacesRoundTrip },
+    { "material_runs_round_trip", testMaterialRunsRoundTrip },
+    { "single_material_round_trip", testSingleMaterialRoundTrip },
+    { "mixed_face_formats", testMixedFaceFormats }
+  };
+  int failed = 0;
+  for(size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    bool passed = false;
+    try {
+      passed = tests[i].run();
+    } catch(const exception& e) {
+      printf("%s: %s\n", tests[i].name, e.what());
+    }
+    printf("%s %s\n", tests[i].name, passed ? "ok" : "FAILED");
+    failed += passed ? 0 : 1;
+  }
+  return failed > 0 ? 1 : 0;
+}
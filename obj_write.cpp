@@ -0,0 +1,292 @@
+#include <string.h>
+#include <climits>
+#include <string>
+#include <vector>
+#include "obj_common.h"
+#include "mex.h"
+
+using namespace Geometry;
+using namespace std;
+
+// "Normal Tri" can be given as NormalTri, which MATLAB allows as a field
+static string removeSpaces(const string& name) {
+  string result;
+  for (size_t i = 0; i < name.size(); i++) {
+    if (name[i] != ' ') {
+      result += name[i];
+    }
+  }
+  return result;
+}
+
+// The field of element index named name, with or without its spaces, or
+// NULL if the struct has none
+static const mxArray* getField(const mxArray* const array, const mwIndex index,
+  const char* const name) {
+  const string wanted = removeSpaces(name);
+  for (int i = 0; i < mxGetNumberOfFields(array); i++) {
+    if (removeSpaces(mxGetFieldNameByNumber(array, i)) == wanted) {
+      return mxGetFieldByNumber(array, index, i);
+    }
+  }
+  return NULL;
+}
+
+static bool isSupportedClass(const mxArray* const array) {
+  const mxClassID classID = mxGetClassID(array);
+  return classID == mxDOUBLE_CLASS || classID == mxSINGLE_CLASS ||
+    classID == mxINT32_CLASS || classID == mxUINT32_CLASS;
+}
+
+static void getElement(const mxArray* const array, const size_t index, float& value) {
+  switch (mxGetClassID(array)) {
+    case mxSINGLE_CLASS:
+      value = static_cast<const float*>(mxGetData(array))[index];
+      break;
+    case mxINT32_CLASS:
+      value = float(static_cast<const int*>(mxGetData(array))[index]);
+      break;
+    case mxUINT32_CLASS:
+      value = float(static_cast<const unsigned int*>(mxGetData(array))[index]);
+      break;
+    default:
+      value = float(static_cast<const double*>(mxGetData(array))[index]);
+      break;
+  }
+}
+
+// uint32 indices of 4294967295 are -1, as obj_read writes them
+static void getElement(const mxArray* const array, const size_t index, int& value) {
+  switch (mxGetClassID(array)) {
+    case mxSINGLE_CLASS:
+      value = int(static_cast<const float*>(mxGetData(array))[index]);
+      break;
+    case mxINT32_CLASS:
+      value = static_cast<const int*>(mxGetData(array))[index];
+      break;
+    case mxUINT32_CLASS:
+      value = int(static_cast<const unsigned int*>(mxGetData(array))[index]);
+      break;
+    default: {
+      const double element = static_cast<const double*>(mxGetData(array))[index];
+      value = element >= INT_MIN && element <= INT_MAX ? int(element) : -1;
+      break;
+    }
+  }
+}
+
+// The field as a channel of the mesh, a componentCount x n matrix for n
+// values (any shape for one component). base is taken off indices. NULL
+// if the struct has no such field or it is empty.
+template<typename T> static BaseChannel<T>* createChannel(const mxArray* const meshStruct,
+  const char* const name, const int base, Mesh* const mesh) {
+  typedef ElementTraits<T> Traits;
+  const mxArray* const field = getField(meshStruct, 0, name);
+  if (!field || mxGetNumberOfElements(field) == 0) {
+    return NULL;
+  }
+  const size_t componentCount = Traits::componentCount;
+  if (!isSupportedClass(field) || (componentCount > 1 && mxGetM(field) != componentCount) ||
+    mxGetNumberOfElements(field) / componentCount > size_t(INT_MAX)) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:invalidField",
+      "mesh.%s must be a %d x n matrix of class double, single, int32 or uint32.",
+      name, int(componentCount));
+  }
+  const int count = int(mxGetNumberOfElements(field) / componentCount);
+  BaseChannel<T>* const channel = new BaseChannel<T>(name, mesh);
+  channel->resize(count);
+  for (int i = 0; i < count; i++) {
+    T value;
+    for (size_t j = 0; j < componentCount; j++) {
+      typename Traits::Scalar component;
+      getElement(field, size_t(i) * componentCount + j, component);
+      Traits::setComponent(value, int(j), component - typename Traits::Scalar(base));
+    }
+    channel->setAt(i, value);
+  }
+  return channel;
+}
+
+// Adds the channel, realized on the tri channel if there is one
+static void addChannel(Mesh* const mesh, Channel* const channel, Channel* const tris) {
+  if (!channel) {
+    return;
+  }
+  mesh->addChannel(channel);
+  if (tris) {
+    mesh->addRealization(channel, tris);
+  }
+}
+
+// The mesh struct of obj_read as a mesh, with its tables
+static void createMesh(const mxArray* const meshStruct, const int base, Mesh* const mesh) {
+  if (!mxIsStruct(meshStruct) || mxGetNumberOfElements(meshStruct) != 1) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:meshNotStruct",
+      "The mesh must be a scalar struct, as obj_read returns it.");
+  }
+  Vec3fChannel* const positions = createChannel<Vec3f>(meshStruct, "Position", 0, mesh);
+  TriChannel* const tris = createChannel<Tri>(meshStruct, "Tri", base, mesh);
+  addChannel(mesh, positions, tris);
+  addChannel(mesh, tris, NULL);
+  Vec3fChannel* const normals = createChannel<Vec3f>(meshStruct, "Normal", 0, mesh);
+  TriChannel* const normalTris = createChannel<Tri>(meshStruct, "Normal Tri", base, mesh);
+  addChannel(mesh, normals, normalTris ? normalTris : tris);
+  addChannel(mesh, normalTris, NULL);
+  Vec2fChannel* const texCoords = createChannel<Vec2f>(meshStruct, "TexCoord", 0, mesh);
+  TriChannel* const texCoordTris = createChannel<Tri>(meshStruct, "TexCoord Tri", base, mesh);
+  addChannel(mesh, texCoords, texCoordTris ? texCoordTris : tris);
+  addChannel(mesh, texCoordTris, NULL);
+  addChannel(mesh, createChannel<int>(meshStruct, "MaterialId", base, mesh), NULL);
+  addChannel(mesh, createChannel<int>(meshStruct, "Group", base, mesh), tris);
+}
+
+static string getString(const mxArray* const array, const mwIndex index,
+  const char* const name) {
+  const mxArray* const field = getField(array, index, name);
+  char* const text = field && mxIsChar(field) ? mxArrayToString(field) : NULL;
+  const string result = text ? text : "";
+  mxFree(text);
+  return result;
+}
+
+static void getScalar(const mxArray* const array, const mwIndex index, const char* const name,
+  float& value) {
+  const mxArray* const field = getField(array, index, name);
+  if (field && isSupportedClass(field) && mxGetNumberOfElements(field) == 1) {
+    getElement(field, 0, value);
+  }
+}
+
+static void getVector(const mxArray* const array, const mwIndex index, const char* const name,
+  Vec3f& value) {
+  const mxArray* const field = getField(array, index, name);
+  if (field && isSupportedClass(field) && mxGetNumberOfElements(field) == 3) {
+    for (int i = 0; i < 3; i++) {
+      getElement(field, i, value[i]);
+    }
+  }
+}
+
+// The struct array obj_read returns as its second output. Fields it lacks
+// keep the defaults of a material the .mtl file does not define.
+static vector<Material> getMaterials(const mxArray* const array) {
+  vector<Material> materials;
+  if (mxGetNumberOfElements(array) == 0) {
+    return materials;
+  }
+  if (!mxIsStruct(array)) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:materialsNotStruct",
+      "The materials must be a struct array, as obj_read returns them, or [].");
+  }
+  for (size_t i = 0; i < mxGetNumberOfElements(array); i++) {
+    Material material(getString(array, i, "Name"));
+    getVector(array, i, "Ambient", material.ambient);
+    getVector(array, i, "Diffuse", material.diffuse);
+    getVector(array, i, "Specular", material.specular);
+    getScalar(array, i, "Shininess", material.shininess);
+    getScalar(array, i, "Opacity", material.opacity);
+    material.ambientMap = getString(array, i, "AmbientMap");
+    material.diffuseMap = getString(array, i, "DiffuseMap");
+    material.specularMap = getString(array, i, "SpecularMap");
+    material.shininessMap = getString(array, i, "ShininessMap");
+    material.opacityMap = getString(array, i, "OpacityMap");
+    material.bumpMap = getString(array, i, "BumpMap");
+    materials.push_back(material);
+  }
+  return materials;
+}
+
+// The struct array obj_read returns as its third output
+static vector<Group> getGroups(const mxArray* const array) {
+  vector<Group> groups;
+  if (mxGetNumberOfElements(array) == 0) {
+    return groups;
+  }
+  if (!mxIsStruct(array)) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:groupsNotStruct",
+      "The groups must be a struct array, as obj_read returns them, or [].");
+  }
+  for (size_t i = 0; i < mxGetNumberOfElements(array); i++) {
+    groups.push_back(Group(getString(array, i, "Name"), getString(array, i, "Object")));
+  }
+  return groups;
+}
+
+static bool getFlag(const mxArray* const value, const char* const option) {
+  if (!(mxIsLogical(value) || mxIsNumeric(value)) || mxGetNumberOfElements(value) != 1) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:invalidFlag",
+      "options.%s must be true or false.", option);
+  }
+  return mxGetScalar(value) != 0;
+}
+
+// What the options struct of obj_write asks for:
+//
+//   OneBased         true if the indices start at 1, as obj_read returns
+//                    them with OneBased. Missing indices are 0 then.
+//   MaterialLibrary  false to leave out the .mtl file, which is otherwise
+//                    written next to the OBJ file when there are materials
+static void parseOptions(const mxArray* const options, int& base, OBJSaveOptions& saveOptions) {
+  if (!mxIsStruct(options) || mxGetNumberOfElements(options) != 1) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:optionsNotStruct",
+      "Options must be a scalar struct.");
+  }
+  for (int i = 0; i < mxGetNumberOfFields(options); i++) {
+    const char* const option = mxGetFieldNameByNumber(options, i);
+    const mxArray* const value = mxGetFieldByNumber(options, 0, i);
+    if (!strcmp(option, "OneBased")) {
+      base = getFlag(value, option) ? 1 : 0;
+    } else if (!strcmp(option, "MaterialLibrary")) {
+      saveOptions.writeMaterialLibrary = getFlag(value, option);
+    } else {
+      mexErrMsgIdAndTxt("MATLAB:obj_write:unknownOption",
+        "Unknown option '%s'.", option);
+    }
+  }
+}
+
+// The gateway function: obj_write(filename, mesh, materials, groups,
+// options) writes what obj_read(filename) returns back to an OBJ file. The
+// materials, groups and options can be left out or [].
+void mexFunction(int nlhs, mxArray* /* plhs */[], int nrhs, const mxArray *prhs[]) {
+  if (nrhs < 2 || nrhs > 5) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:invalidNumInputs",
+      "Specify filename, mesh and optionally materials, groups and options.");
+  }
+  if (nlhs > 0) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:invalidNumOutputs", "No outputs are returned.");
+  }
+  if (mxIsChar(prhs[0]) != 1) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:inputNotString", "Filename must be a string.");
+  }
+  int base = 0;
+  OBJSaveOptions saveOptions;
+  if (nrhs > 4 && mxGetNumberOfElements(prhs[4]) > 0) {
+    parseOptions(prhs[4], base, saveOptions);
+  }
+
+  Mesh mesh;
+  createMesh(prhs[1], base, &mesh);
+  if (nrhs > 2) {
+    mesh.getMaterials() = getMaterials(prhs[2]);
+  }
+  if (nrhs > 3) {
+    mesh.getGroups() = getGroups(prhs[3]);
+  }
+
+  char* const filename = mxArrayToString(prhs[0]);
+  if (filename == NULL) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:conversionFailed",
+      "Could not convert input to string.");
+  }
+  string error;
+  try {
+    saveToOBJFile(filename, mesh, saveOptions);
+  } catch (const exception& e) {
+    error = e.what();
+  }
+  mxFree(filename);
+  if (!error.empty()) {
+    mexErrMsgIdAndTxt("MATLAB:obj_write:saveFailed", "%s", error.c_str());
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+	// What the binary files written next to a source file (mesh_cache.h,
+	// obj_index.h) share: the stamp that ties them to the source, the
+	// checksum of their contents and how they replace an older version.
+
+	// Size and modification time in nanoseconds, false if there is no such file
+	inline bool getFileStamp(const std::string& filename, uint64_t& size, int64_t& modified) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if(_stat64(filename.c_str(), &info) != 0) {
+			return false;
+		}
+		modified = int64_t(info.st_mtime) * 1000000000;
+#else
+		struct stat info;
+		if(stat(filename.c_str(), &info) != 0) {
+			return false;
+		}
+#ifdef __APPLE__
+		modified = int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+		modified = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+		size = uint64_t(info.st_size);
+		return true;
+	}
+
+	// Word at a time, with a final mix. Not cryptographic, it only has to catch
+	// truncated and damaged files. Fed in pieces, it gives the same result as
+	// if they were one buffer.
+	class Checksum {
+
+	private:
+
+		uint64_t hash;
+		uint64_t size;
+		char pending[8];
+
+		void addWord(const char* const data) {
+			uint64_t word;
+			memcpy(&word, data, sizeof(word));
+			hash = (hash ^ word) * 0x100000001b3ull;
+			hash ^= hash >> 29;
+		}
+
+	public:
+
+		Checksum() : hash(0xcbf29ce484222325ull), size(0) {
+		}
+
+		void add(const char* data, size_t count) {
+			size_t pendingCount = size_t(size % 8);
+			size += count;
+			if(pendingCount) {
+				const size_t fill = count < 8 - pendingCount ? count : 8 - pendingCount;
+				memcpy(pending + pendingCount, data, fill);
+				data += fill;
+				count -= fill;
+				pendingCount += fill;
+				if(pendingCount < 8) {
+					return;
+				}
+				addWord(pending);
+			}
+			for(; count >= 8; data += 8, count -= 8) {
+				addWord(data);
+			}
+			memcpy(pending, data, count);
+		}
+
+		uint64_t get() const {
+			uint64_t result = hash;
+			const size_t pendingCount = size_t(size % 8);
+			for(size_t i = 0; i < pendingCount; i++) {
+				result = (result ^ uint8_t(pending[i])) * 0x100000001b3ull;
+			}
+			result ^= size;
+			result ^= result >> 33;
+			result *= 0xff51afd7ed558ccdull;
+			result ^= result >> 33;
+			return result;
+		}
+	};
+
+	// A new file to write filename's next version to, in the same directory
+	// so that replaceFile() can rename it. Its name is unique to the process,
+	// thread and call, so loads of the same file that write at once, in one
+	// process or several, each have their own. NULL if it cannot be made.
+	inline FILE* createTemporaryFile(const std::string& filename, std::string& temporaryFilename) {
+		static std::atomic<unsigned> counter(0);
+		char suffix[64];
+#ifdef _WIN32
+		const long long processId = _getpid();
+#else
+		const long long processId = getpid();
+#endif
+		snprintf(suffix, sizeof(suffix), ".%lld.%zx.%u.tmp", processId,
+			std::hash<std::thread::id>()(std::this_thread::get_id()), counter++);
+		temporaryFilename = filename + suffix;
+#ifdef _WIN32
+		return fopen(temporaryFilename.c_str(), "wb");
+#else
+		// O_EXCL rather than overwriting whatever has the name by chance
+		const int descriptor = open(temporaryFilename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if(descriptor < 0) {
+			return NULL;
+		}
+		FILE* const file = fdopen(descriptor, "wb");
+		if(!file) {
+			close(descriptor);
+			remove(temporaryFilename.c_str());
+		}
+		return file;
+#endif
+	}
+
+	// Puts a finished temporary file in the place of filename, so that
+	// readers never see half of it. The temporary file is gone either way.
+	inline bool replaceFile(const std::string& temporaryFilename, const std::string& filename) {
+#ifdef _WIN32
+		// rename() does not replace existing files on Windows
+		remove(filename.c_str());
+#endif
+		if(rename(temporaryFilename.c_str(), filename.c_str()) != 0) {
+			remove(temporaryFilename.c_str());
+			return false;
+		}
+		return true;
+	}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+	// A fixed set of worker threads fed from one queue. The threads are
+	// joined when the pool goes away, so a pool is meant to live for one
+	// load (there is no global pool that would outlive a MEX file).
+	class ThreadPool {
+
+	private:
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()> > tasks;
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stopping;
+
+		// Not copyable, the workers point back at the pool
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+		void work() {
+			while(true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					while(!stopping && tasks.empty()) {
+						wake.wait(lock);
+					}
+					if(tasks.empty()) {
+						return;
+					}
+					task = tasks.front();
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		// Progress of one parallelFor, shared with the helpers it queued.
+		// Helpers that only get to run after everything is done must still
+		// find it alive.
+		struct Loop {
+			std::atomic<int> next;
+			std::atomic<int> done;
+			std::mutex mutex;
+			std::condition_variable finished;
+			std::exception_ptr error;
+		};
+
+		static void runLoop(Loop& loop, const int count, const std::function<void(int)>& task) {
+			while(true) {
+				const int index = loop.next++;
+				if(index >= count) {
+					return;
+				}
+				try {
+					task(index);
+				} catch(...) {
+					std::lock_guard<std::mutex> lock(loop.mutex);
+					if(!loop.error) {
+						loop.error = std::current_exception();
+					}
+				}
+				if(++loop.done == count) {
+					std::lock_guard<std::mutex> lock(loop.mutex);
+					loop.finished.notify_all();
+				}
+			}
+		}
+
+	public:
+
+		explicit ThreadPool(const int threadCount) : stopping(false) {
+			for(int i = 0; i < threadCount; i++) {
+				workers.push_back(std::thread(&ThreadPool::work, this));
+			}
+		}
+
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			const int workerCount = int(workers.size());
+			for(int i = 0; i < workerCount; i++) {
+				workers[i].join();
+			}
+		}
+
+		int getThreadCount() const {
+			return int(workers.size());
+		}
+
+		void submit(const std::function<void()>& task) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push_back(task);
+			}
+			wake.notify_one();
+		}
+
+		// Runs task(0) .. task(count - 1) on the workers and the calling
+		// thread and returns once all of them are done. The first exception
+		// a task throws is rethrown here, after the others have finished.
+		void parallelFor(const int count, const std::function<void(int)>& task) {
+			if(count <= 0) {
+				return;
+			}
+			const std::shared_ptr<Loop> loop(new Loop());
+			loop->next = 0;
+			loop->done = 0;
+
+			const int helperCount = std::min(int(workers.size()), count - 1);
+			for(int i = 0; i < helperCount; i++) {
+				// The task outlives every helper that can still pick up an index
+				const std::function<void(int)>* const sharedTask = &task;
+				submit([loop, count, sharedTask]() { runLoop(*loop, count, *sharedTask); });
+			}
+			runLoop(*loop, count, task);
+
+			std::unique_lock<std::mutex> lock(loop->mutex);
+			while(loop->done < count) {
+				loop->finished.wait(lock);
+			}
+			if(loop->error) {
+				std::rethrow_exception(loop->error);
+			}
+		}
+	};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cassert>
+
 namespace Geometry {
 	
 	template<int dimension> class Simplex {
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <ostream>
 
 template<typename T> class Vec2 {
 
@@ -159,14 +161,14 @@ public:
 
 	static Vec2 min(const Vec2& v0, const Vec2& v1) {
 		return Vec2(
-			Tools::min(v0.x, v1.x),
-			Tools::min(v0.y, v1.y));
+			std::min(v0.x, v1.x),
+			std::min(v0.y, v1.y));
 	}
 
 	static Vec2 max(const Vec2& v0, const Vec2& v1) {
 		return Vec2(
-			Tools::max(v0.x, v1.x),
-			Tools::max(v0.y, v1.y));
+			std::max(v0.x, v1.x),
+			std::max(v0.y, v1.y));
 	}
 };
 
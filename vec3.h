@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cfloat>
 #include <cmath>
@@ -290,16 +291,16 @@ public:
 
 	static Vec3 min(const Vec3& v0, const Vec3& v1) {
 		return Vec3(
-			Tools::min(v0.x, v1.x),
-			Tools::min(v0.y, v1.y),
-			Tools::min(v0.z, v1.z));
+			std::min(v0.x, v1.x),
+			std::min(v0.y, v1.y),
+			std::min(v0.z, v1.z));
 	}
 
 	static Vec3 max(const Vec3& v0, const Vec3& v1) {
 		return Vec3(
-			Tools::max(v0.x, v1.x),
-			Tools::max(v0.y, v1.y),
-			Tools::max(v0.z, v1.z));
+			std::max(v0.x, v1.x),
+			std::max(v0.y, v1.y),
+			std::max(v0.z, v1.z));
 	}
 };
 